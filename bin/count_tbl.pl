@@ -44,7 +44,7 @@
 =over
 
 =item B<--taxon-file, -i>
-  Taxon file.
+  Taxon file; read with gzip -dc if its name ends with .gz.
 
 =item B<--output-file, -o>
   Output file.
@@ -377,7 +377,15 @@ sub read2colTbl{
   ## my %vals;
   my %tbl;
   my $counter = 1;
-  open IN, "$file" or die "Cannot open $file for reading: $OS_ERROR\n";
+  if ( $file =~ /\.gz$/ )
+  {
+    # results of classify --gzip
+    open IN, "gzip -dc $file |" or die "Cannot open $file for reading: $OS_ERROR\n";
+  }
+  else
+  {
+    open IN, "$file" or die "Cannot open $file for reading: $OS_ERROR\n";
+  }
   foreach (<IN>)
   {
     if ($counter % 500 == 0)
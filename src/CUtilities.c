@@ -151,6 +151,23 @@ size_t fileSize ( const char * fileName )
     return fileInfo.st_size;
 }
 
+//-------------------------------------------------------------------- fnv1a ----
+//! continues the 64-bit FNV-1a hash h over len bytes of data; start with
+//! h = FNV1A_INIT
+unsigned long long fnv1a ( const void *data, size_t len, unsigned long long h )
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
 //----------------------------------------------------------------- readLine ----
 // reads a line from a buffer of size bSize, starting at a specified offset
 // of the buffer and writes the line into an array s of size sSize
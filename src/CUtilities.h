@@ -110,6 +110,12 @@ char* chomp(char *s);
 /// Stat a file to return its filesize, exit on failure
 size_t fileSize(const char * fileName);
 
+/// Initial value of the FNV-1a hash
+#define FNV1A_INIT 14695981039346656037ULL
+
+/// Continues the 64-bit FNV-1a hash h over len bytes of data
+unsigned long long fnv1a(const void *data, size_t len, unsigned long long h);
+
 /// Reads a line from a buffer
 int readLine(int offset, const char * buffer, int bSize, char * s, int sSize);
 
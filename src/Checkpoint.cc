@@ -0,0 +1,116 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "Checkpoint.hh"
+
+//----------------------------------------------------- readCheckpoint ----
+/// reads ckpt from file; returns false if file does not exist
+bool readCheckpoint( const char *file, checkpoint_t &ckpt )
+{
+  FILE *in = fopen(file, "r");
+  if ( !in )
+  {
+    if ( errno == ENOENT )
+      return false;
+    fprintf(stderr, "ERROR in %s at line %d: Cannot open checkpoint file %s: %s\n",
+	    __FILE__, __LINE__, file, strerror(errno));
+    exit(1);
+  }
+
+  int nKeys = 0;
+  char key[64];
+  char value[4096];
+  while ( fscanf(in, "%63s %4095[^\n]", key, value) == 2 )
+  {
+    nKeys++;
+    if ( strcmp(key, "input") == 0 )
+      ckpt.input = string(value);
+    else if ( strcmp(key, "inputSize") == 0 )
+      ckpt.inputSize = atoll(value);
+    else if ( strcmp(key, "inputMtime") == 0 )
+      ckpt.inputMtime = atoll(value);
+    else if ( strcmp(key, "models") == 0 )
+      ckpt.models = strtoull(value, NULL, 16);
+    else if ( strcmp(key, "interval") == 0 )
+      ckpt.interval = atol(value);
+    else if ( strcmp(key, "records") == 0 )
+      ckpt.records = atol(value);
+    else if ( strcmp(key, "leaves") == 0 )
+      ckpt.leaves = atol(value);
+    else if ( strcmp(key, "offset") == 0 )
+      ckpt.offset = atoll(value);
+    else if ( strcmp(key, "outBytes") == 0 )
+      ckpt.outBytes = atoll(value);
+    else if ( strcmp(key, "complete") == 0 )
+      ckpt.complete = atoi(value);
+    else
+      nKeys--;
+  }
+  fclose(in);
+
+  if ( nKeys != 10 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Checkpoint file %s is malformed\n",
+	    __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  return true;
+}
+
+//---------------------------------------------------- writeCheckpoint ----
+/// atomically replaces file with ckpt
+void writeCheckpoint( const char *file, const checkpoint_t &ckpt )
+{
+  string tmp = string(file) + string(".tmp");
+  FILE *out = fopen(tmp.c_str(), "w");
+  if ( !out )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot open %s for writing: %s\n",
+	    __FILE__, __LINE__, tmp.c_str(), strerror(errno));
+    exit(1);
+  }
+
+  fprintf(out, "input\t%s\n", ckpt.input.c_str());
+  fprintf(out, "inputSize\t%lld\n", ckpt.inputSize);
+  fprintf(out, "inputMtime\t%lld\n", ckpt.inputMtime);
+  fprintf(out, "models\t%016llx\n", ckpt.models);
+  fprintf(out, "interval\t%ld\n", ckpt.interval);
+  fprintf(out, "records\t%ld\n", ckpt.records);
+  fprintf(out, "leaves\t%ld\n", ckpt.leaves);
+  fprintf(out, "offset\t%lld\n", ckpt.offset);
+  fprintf(out, "outBytes\t%lld\n", ckpt.outBytes);
+  fprintf(out, "complete\t%d\n", ckpt.complete);
+
+  if ( fflush(out) != 0 || fsync(fileno(out)) != 0 || fclose(out) != 0 ||
+       rename(tmp.c_str(), file) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write checkpoint file %s: %s\n",
+	    __FILE__, __LINE__, file, strerror(errno));
+    exit(1);
+  }
+}
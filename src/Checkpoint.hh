@@ -0,0 +1,71 @@
+#ifndef CHECKPOINT_HH
+#define CHECKPOINT_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+//================================================= checkpoint_t ====
+/// Progress of the classification of a sample saved by --checkpoint and
+/// read by --resume
+///
+/// The checkpoint file is a list of 'key value' lines:
+///
+///   input       input file of the sample
+///   inputSize   size and modification time of the input; 0 if it is
+///   inputMtime  not a regular file
+///   models      fingerprint of the models, reference tree, error curves
+///               and the options that change the results
+///   interval    number of reads between checkpoints
+///   records     number of reads classified
+///   leaves      number of them classified to a leaf of the reference tree
+///   offset      offset of the next read in the (decompressed) input
+///   outBytes    size of the results file after the last classified read
+///   complete    1 if the whole input has been classified
+///
+/// The results file is flushed and fsynced before the checkpoint is
+/// written, and the checkpoint is written to a temporary file that
+/// replaces the previous one with rename(), so a checkpoint never
+/// describes results that are not on the disk.
+///
+typedef struct
+{
+  string input;
+  long long inputSize;
+  long long inputMtime;
+  unsigned long long models;
+  long interval;
+  long records;
+  long leaves;
+  long long offset;
+  long long outBytes;
+  int complete;
+} checkpoint_t;
+
+bool readCheckpoint( const char *file, checkpoint_t &ckpt );  /// false if file does not exist; exits if it is malformed
+void writeCheckpoint( const char *file, const checkpoint_t &ckpt );
+
+#endif
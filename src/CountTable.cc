@@ -0,0 +1,309 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+#include "CountTable.hh"
+#include "IOCUtilities.h"
+
+//----------------------------------------------------- sampleIdRule_t ----
+sampleIdRule_t::sampleIdRule_t( const char *rule )
+  : type_m(DEFAULT)
+{
+  if ( !rule || !strcmp(rule, "default") )
+  {
+    type_m = DEFAULT;
+  }
+  else if ( !strcmp(rule, "file") )
+  {
+    type_m = BY_FILE;
+  }
+  else if ( !strncmp(rule, "regex:", 6) )
+  {
+    type_m = REGEX;
+    int ret = regcomp(&re_m, rule + 6, REG_EXTENDED);
+    if ( ret )
+    {
+      char msg[256];
+      regerror(ret, &re_m, msg, sizeof(msg));
+      fprintf(stderr, "ERROR in %s at line %d: cannot compile sample ID regex %s: %s\n",
+	      __FILE__, __LINE__, rule + 6, msg);
+      exit(1);
+    }
+  }
+  else
+  {
+    fprintf(stderr, "ERROR in %s at line %d: unknown sample ID rule %s; use default, file or regex:<re>\n",
+	    __FILE__, __LINE__, rule);
+    exit(1);
+  }
+}
+
+//---------------------------------------------------- ~sampleIdRule_t ----
+sampleIdRule_t::~sampleIdRule_t()
+{
+  if ( type_m == REGEX )
+    regfree(&re_m);
+}
+
+//----------------------------------------------------------- sampleId ----
+bool sampleIdRule_t::sampleId( const char *readId, string &sampleId ) const
+{
+  if ( type_m == DEFAULT )
+  {
+    // <sampleID>_<digits>[:...]
+    const char *end = strchr(readId, ':');
+    if ( !end )
+      end = readId + strlen(readId);
+
+    const char *p = end;
+    while ( p > readId && p[-1] >= '0' && p[-1] <= '9' )
+      p--;
+
+    if ( p == end || p - readId < 2 || p[-1] != '_' )
+      return false;
+
+    sampleId.assign(readId, p - 1 - readId);
+    return true;
+  }
+  else if ( type_m == REGEX )
+  {
+    regmatch_t m[2];
+    if ( regexec(&re_m, readId, 2, m, 0) )
+      return false;
+
+    int i = ( m[1].rm_so >= 0 ) ? 1 : 0;
+    sampleId.assign(readId + m[i].rm_so, m[i].rm_eo - m[i].rm_so);
+    return true;
+  }
+
+  return false;
+}
+
+//------------------------------------------------------- countTable_t ----
+countTable_t::countTable_t( const decisionTree_t &dt, const sampleIdRule_t &rule )
+  : rule_m(rule), lastIdx_m(-1), nReads_m(0), nUnmatched_m(0)
+{
+  int n = dt.size();
+  for ( int i = 0; i < n; i++ )
+    labels_m.push_back( string(dt[i].label) );
+}
+
+//------------------------------------------------------- countTable_t ----
+countTable_t::countTable_t( const vector<string> &taxa, const sampleIdRule_t &rule )
+  : labels_m(taxa), rule_m(rule), lastIdx_m(-1), nReads_m(0), nUnmatched_m(0)
+{
+}
+
+//---------------------------------------------------------- sampleIdx ----
+/// index of the sample in counts_m; new samples are added
+int countTable_t::sampleIdx( const string &sampleId )
+{
+  map<string, int>::iterator it = sampleIdx_m.find( sampleId );
+
+  int idx;
+  if ( it != sampleIdx_m.end() )
+  {
+    idx = it->second;
+  }
+  else
+  {
+    idx = counts_m.size();
+    sampleIdx_m[ sampleId ] = idx;
+    counts_m.push_back( vector<long>( labels_m.size(), 0 ) );
+  }
+
+  lastSample_m = sampleId;
+  lastIdx_m = idx;
+
+  return idx;
+}
+
+//-------------------------------------------------------- addToSample ----
+void countTable_t::addToSample( const char *sampleId, int node, long count )
+{
+  nReads_m += count;
+
+  int idx = ( lastIdx_m >= 0 && lastSample_m == sampleId ) ? lastIdx_m : sampleIdx( string(sampleId) );
+  counts_m[idx][node] += count;
+}
+
+//-------------------------------------------------------------- merge ----
+void countTable_t::merge( const countTable_t &other )
+{
+  nReads_m     += other.nReads_m;
+  nUnmatched_m += other.nUnmatched_m;
+
+  int nNodes = labels_m.size();
+  map<string, int>::const_iterator it;
+  for ( it = other.sampleIdx_m.begin(); it != other.sampleIdx_m.end(); ++it )
+  {
+    vector<long> &dst = counts_m[ sampleIdx( it->first ) ];
+    const vector<long> &src = other.counts_m[ it->second ];
+
+    for ( int i = 0; i < nNodes; i++ )
+      dst[i] += src[i];
+  }
+}
+
+//-------------------------------------------------------- nonZeroTaxa ----
+/// nodes with non-zero total count sorted by decreasing total count
+void countTable_t::nonZeroTaxa( vector<int> &taxa ) const
+{
+  int nNodes = labels_m.size();
+  int nSamples = counts_m.size();
+
+  vector< pair<long, int> > colSums;
+  for ( int j = 0; j < nNodes; j++ )
+  {
+    long sum = 0;
+    for ( int i = 0; i < nSamples; i++ )
+      sum += counts_m[i][j];
+
+    if ( sum )
+      colSums.push_back( pair<long, int>(-sum, j) );
+  }
+
+  sort( colSums.begin(), colSums.end() );
+
+  taxa.clear();
+  int n = colSums.size();
+  for ( int i = 0; i < n; i++ )
+    taxa.push_back( colSums[i].second );
+}
+
+//----------------------------------------------------------- printTbl ----
+void countTable_t::printTbl( const char *file ) const
+{
+  vector<int> taxa;
+  nonZeroTaxa( taxa );
+  int nTaxa = taxa.size();
+
+  FILE *out = fOpen(file, "w");
+
+  fprintf(out, "sampleID");
+  for ( int j = 0; j < nTaxa; j++ )
+    fprintf(out, "\t%s", labels_m[ taxa[j] ].c_str());
+  fprintf(out, "\n");
+
+  map<string, int>::const_iterator it;
+  for ( it = sampleIdx_m.begin(); it != sampleIdx_m.end(); ++it )
+  {
+    const vector<long> &counts = counts_m[ it->second ];
+
+    fprintf(out, "%s", it->first.c_str());
+    for ( int j = 0; j < nTaxa; j++ )
+      fprintf(out, "\t%ld", counts[ taxa[j] ]);
+    fprintf(out, "\n");
+  }
+
+  fclose(out);
+}
+
+//------------------------------------------------------ printTriplets ----
+void countTable_t::printTriplets( const char *file ) const
+{
+  int nNodes = labels_m.size();
+
+  FILE *out = fOpen(file, "w");
+
+  fprintf(out, "sampleID\ttaxon\tcount\n");
+
+  map<string, int>::const_iterator it;
+  for ( it = sampleIdx_m.begin(); it != sampleIdx_m.end(); ++it )
+  {
+    const vector<long> &counts = counts_m[ it->second ];
+
+    for ( int j = 0; j < nNodes; j++ )
+      if ( counts[j] )
+	fprintf(out, "%s\t%s\t%ld\n", it->first.c_str(), labels_m[j].c_str(), counts[j]);
+  }
+
+  fclose(out);
+}
+
+//---------------------------------------------------------- printBiom ----
+void countTable_t::printBiom( const char *file ) const
+{
+  vector<int> taxa;
+  nonZeroTaxa( taxa );
+  int nTaxa = taxa.size();
+  int nSamples = sampleIdx_m.size();
+
+  char date[64];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+  FILE *out = fOpen(file, "w");
+
+  fprintf(out, "{\"id\": null,\n");
+  fprintf(out, " \"format\": \"Biological Observation Matrix 1.0.0\",\n");
+  fprintf(out, " \"format_url\": \"http://biom-format.org\",\n");
+  fprintf(out, " \"type\": \"OTU table\",\n");
+  fprintf(out, " \"generated_by\": \"classify\",\n");
+  fprintf(out, " \"date\": \"%s\",\n", date);
+  fprintf(out, " \"matrix_type\": \"sparse\",\n");
+  fprintf(out, " \"matrix_element_type\": \"int\",\n");
+  fprintf(out, " \"shape\": [%d, %d],\n", nTaxa, nSamples);
+
+  fprintf(out, " \"rows\": [");
+  for ( int j = 0; j < nTaxa; j++ )
+  {
+    fprintf(out, "%s\n  {\"id\": ", j ? "," : "");
+    jsonString( out, labels_m[ taxa[j] ].c_str() );
+    fprintf(out, ", \"metadata\": null}");
+  }
+  fprintf(out, "],\n");
+
+  // columns in the order of sample IDs
+  vector<int> colIdx;
+  fprintf(out, " \"columns\": [");
+  map<string, int>::const_iterator it;
+  int c = 0;
+  for ( it = sampleIdx_m.begin(); it != sampleIdx_m.end(); ++it, ++c )
+  {
+    colIdx.push_back( it->second );
+    fprintf(out, "%s\n  {\"id\": ", c ? "," : "");
+    jsonString( out, it->first.c_str() );
+    fprintf(out, ", \"metadata\": null}");
+  }
+  fprintf(out, "],\n");
+
+  fprintf(out, " \"data\": [");
+  bool first = true;
+  for ( int j = 0; j < nTaxa; j++ )
+    for ( c = 0; c < nSamples; c++ )
+    {
+      long count = counts_m[ colIdx[c] ][ taxa[j] ];
+      if ( count )
+      {
+	fprintf(out, "%s\n  [%d, %d, %ld]", first ? "" : ",", j, c, count);
+	first = false;
+      }
+    }
+  fprintf(out, "]\n}\n");
+
+  fclose(out);
+}
@@ -0,0 +1,122 @@
+#ifndef COUNTTABLE_HH
+#define COUNTTABLE_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <regex.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "DecisionTree.hh"
+
+using namespace std;
+
+//============================================== sampleIdRule_t ====
+/// Rule extracting sample IDs from read IDs
+///
+/// The rule is given by a string:
+///   default     - as in count_tbl.pl: the part of the read ID before
+///                 the first ':' has to be of the form <sampleID>_<index>,
+///                 where <index> is a sequence of digits
+///   file        - all reads of an input file belong to one sample, whose
+///                 ID is the sample name of the file
+///   regex:<re>  - <sampleID> is the first parenthesized subexpression
+///                 (or the whole match if there is none) of the POSIX
+///                 extended regular expression <re>
+///
+class sampleIdRule_t
+{
+public:
+  sampleIdRule_t( const char *rule="default" );
+  ~sampleIdRule_t();
+
+  bool byFile() const { return type_m == BY_FILE; }
+
+  /// copies to sampleId the sample ID of readId; returns false if the
+  /// read ID does not match the rule
+  bool sampleId( const char *readId, string &sampleId ) const;
+
+private:
+  enum { DEFAULT, BY_FILE, REGEX } type_m;
+  regex_t re_m;
+};
+
+//============================================== countTable_t ====
+/// Sample x taxon table of read counts
+///
+/// Reads are added during the classification walk. Each thread keeps its
+/// own table and the tables are merged with merge() at the end. Taxa are
+/// the nodes of the decision tree; a table can also be built from the
+/// taxon dictionary of a binary results file (see ResultsFile.hh).
+///
+class countTable_t
+{
+public:
+  countTable_t( const decisionTree_t &dt, const sampleIdRule_t &rule );
+  countTable_t( const vector<string> &taxa, const sampleIdRule_t &rule ); /// taxa in the order of the tree's nodes
+
+  inline void add( const char *readId, int node ); /// adds a read using the sample ID rule
+  void addToSample( const char *sampleId, int node, long count=1 );
+  void merge( const countTable_t &other );
+
+  bool byFile() const { return rule_m.byFile(); }  /// true if reads are counted by input file
+  long nReads() const { return nReads_m; }
+  long nUnmatched() const { return nUnmatched_m; }
+
+  void printTbl( const char *file ) const;       /// TSV; samples x taxa sorted by decreasing total count
+  void printTriplets( const char *file ) const;  /// TSV; <sample> <taxon> <count> for non-zero counts
+  void printBiom( const char *file ) const;      /// sparse BIOM 1.0 JSON; taxa as rows, samples as columns
+
+private:
+  int sampleIdx( const string &sampleId );
+  void nonZeroTaxa( vector<int> &taxa ) const;
+
+  vector<string> labels_m;             /// node index => taxon label
+  const sampleIdRule_t &rule_m;
+  map<string, int> sampleIdx_m;        /// sample ID => index in counts_m
+  vector< vector<long> > counts_m;     /// counts_m[sample][node]
+  string lastSample_m;                 /// reads usually come grouped by sample
+  int lastIdx_m;
+  string buf_m;
+  long nReads_m;
+  long nUnmatched_m;                   /// number of reads not matching the sample ID rule
+};
+
+//-------------------- inlines -------------------------------
+inline void countTable_t::add( const char *readId, int node )
+{
+  nReads_m++;
+
+  if ( !rule_m.sampleId( readId, buf_m ) )
+  {
+    nUnmatched_m++;
+    return;
+  }
+
+  int idx = ( lastIdx_m >= 0 && buf_m == lastSample_m ) ? lastIdx_m : sampleIdx( buf_m );
+  counts_m[idx][node]++;
+}
+
+#endif
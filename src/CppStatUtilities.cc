@@ -22,6 +22,8 @@ OR PERFORMANCE OF THIS SOFTWARE.
 
 
 #include <iostream>
+#include <algorithm>
+#include <math.h>
 #include "CppStatUtilities.hh"
 #include "CUtilities.h"
 
@@ -129,6 +131,204 @@ void summaryStats( double * data, int dataSize, summaryStats_t &summary, int sam
   free ( perc );
 }
 
+//--------------------------------------------------------- kllSketch_t ----
+kllSketch_t::kllSketch_t( int k )
+  : k_m(k), n_m(0), min_m(0), max_m(0), size_m(0), maxSize_m(0), seed_m(2463534242u)
+{
+  if ( k_m < 8 )
+    k_m = 8;
+
+  levels_m.push_back( vector<double>() );
+  updateMaxSize();
+}
+
+//------------------------------------------------------------ capacity ----
+//! capacity of the given level; capacities decrease geometrically with
+//! the distance from the top level
+int kllSketch_t::capacity( int level ) const
+{
+  int depth = (int)levels_m.size() - 1 - level;
+  int cap = (int)ceil( k_m * pow( 2.0/3.0, depth ) );
+
+  return ( cap < 2 ) ? 2 : cap;
+}
+
+//------------------------------------------------------- updateMaxSize ----
+void kllSketch_t::updateMaxSize()
+{
+  int nLevels = (int)levels_m.size();
+
+  maxSize_m = 0;
+  for ( int h = 0; h < nLevels; h++ )
+    maxSize_m += capacity(h);
+}
+
+//-------------------------------------------------------------- update ----
+void kllSketch_t::update( double x )
+{
+  if ( n_m == 0 )
+  {
+    min_m = x;
+    max_m = x;
+  }
+  else if ( x < min_m )
+    min_m = x;
+  else if ( x > max_m )
+    max_m = x;
+
+  n_m++;
+  levels_m[0].push_back(x);
+  size_m++;
+
+  // one compaction may leave the sketch at capacity, e.g. when it only
+  // moves items to a full level above
+  while ( size_m >= maxSize_m )
+    compress();
+}
+
+//------------------------------------------------------------ compress ----
+//! compacts the lowest level that is at or above its capacity
+void kllSketch_t::compress()
+{
+  int nLevels = (int)levels_m.size();
+
+  for ( int h = 0; h < nLevels; h++ )
+  {
+    if ( (int)levels_m[h].size() < capacity(h) )
+      continue;
+
+    if ( h + 1 == nLevels )
+    {
+      levels_m.push_back( vector<double>() );
+      nLevels++;
+    }
+
+    vector<double> &lv = levels_m[h];
+    vector<double> &up = levels_m[h+1];
+
+    sort(lv.begin(), lv.end());
+
+    // an odd item stays at its level
+    int m = (int)lv.size();
+    bool odd = m % 2;
+    double last = lv[m-1];
+    if ( odd )
+      m--;
+
+    seed_m = seed_m * 1103515245u + 12345u;
+    int offset = (seed_m >> 16) & 1;
+
+    for ( int i = offset; i < m; i += 2 )
+      up.push_back(lv[i]);
+
+    lv.clear();
+    if ( odd )
+      lv.push_back(last);
+
+    size_m -= m / 2;
+    break;
+  }
+
+  updateMaxSize();
+}
+
+//--------------------------------------------------------------- merge ----
+void kllSketch_t::merge( const kllSketch_t &other )
+{
+  if ( other.n_m == 0 )
+    return;
+
+  if ( n_m == 0 )
+  {
+    min_m = other.min_m;
+    max_m = other.max_m;
+  }
+  else
+  {
+    if ( other.min_m < min_m ) min_m = other.min_m;
+    if ( other.max_m > max_m ) max_m = other.max_m;
+  }
+
+  int nLevels = (int)other.levels_m.size();
+  while ( (int)levels_m.size() < nLevels )
+    levels_m.push_back( vector<double>() );
+
+  for ( int h = 0; h < nLevels; h++ )
+  {
+    levels_m[h].insert(levels_m[h].end(), other.levels_m[h].begin(), other.levels_m[h].end());
+    size_m += (int)other.levels_m[h].size();
+  }
+
+  n_m += other.n_m;
+  updateMaxSize();
+
+  while ( size_m >= maxSize_m )
+    compress();
+}
+
+//----------------------------------------------------------- quantiles ----
+//! writes to q the quantiles of the probabilities given in prob
+void kllSketch_t::quantiles( const double *prob, int probLen, double *q ) const
+{
+  if ( n_m == 0 )
+  {
+    for ( int j = 0; j < probLen; j++ )
+      q[j] = 0;
+    return;
+  }
+
+  // items sorted by value together with their weights
+  vector< pair<double, long> > items;
+  items.reserve(size_m);
+
+  int nLevels = (int)levels_m.size();
+  for ( int h = 0; h < nLevels; h++ )
+  {
+    long w = 1L << h;
+    int m = (int)levels_m[h].size();
+    for ( int i = 0; i < m; i++ )
+      items.push_back( pair<double, long>(levels_m[h][i], w) );
+  }
+
+  sort(items.begin(), items.end());
+
+  long total = 0;
+  int nItems = (int)items.size();
+  for ( int i = 0; i < nItems; i++ )
+    total += items[i].second;
+
+  for ( int j = 0; j < probLen; j++ )
+  {
+    if ( prob[j] <= 0 )
+    {
+      q[j] = min_m;
+      continue;
+    }
+
+    if ( prob[j] >= 1 )
+    {
+      q[j] = max_m;
+      continue;
+    }
+
+    double rank = prob[j] * total;
+    long cum = 0;
+    int i = 0;
+    while ( i < nItems - 1 && cum + items[i].second < rank )
+      cum += items[i++].second;
+
+    q[j] = items[i].first;
+  }
+}
+
+//------------------------------------------------------------ quantile ----
+double kllSketch_t::quantile( double p ) const
+{
+  double q;
+  quantiles( &p, 1, &q );
+  return q;
+}
+
 //---------------------------------------------------------- whichMax ----
 //! returns index of maximum value of data array of length dataLen
 void whichMax( double * data, int dataLen, double & maxVal, int & maxInd )
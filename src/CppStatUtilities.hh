@@ -65,6 +65,46 @@ struct summaryStats_t
 
 void summaryStats( double * a, int dataSize, summaryStats_t & summary, int sample = 10000, double constant = MAD_CONST);
 
+//! KLL streaming quantile sketch
+/*!
+  Keeps a bounded number of samples of a stream of doubles, so that
+  quantiles of streams of any length can be estimated in O(k) memory.
+  Level h holds items of weight 2^h; when the sketch is full the
+  lowest overfull level is sorted and every other item (starting at a
+  random offset) is promoted to the next level. The rank error is about
+  1.7/k with high probability. Sketches built with the same k can be
+  merged, e.g. to combine per-thread or per-sample statistics.
+*/
+class kllSketch_t
+{
+public:
+  kllSketch_t( int k = 200 );
+
+  void update( double x );                        //!< adds x to the sketch
+  void merge( const kllSketch_t &other );         //!< adds all items of other to the sketch
+  double quantile( double p ) const;              //!< p-th quantile, 0 <= p <= 1; 0 if the sketch is empty
+  void quantiles( const double *prob, int probLen, double *q ) const; //!< quantiles of all elements of prob
+
+  long n() const { return n_m; }                  //!< number of items added to the sketch
+  double min() const { return min_m; }            //!< exact minimum
+  double max() const { return max_m; }            //!< exact maximum
+  int size() const { return size_m; }             //!< number of retained items
+
+private:
+  int capacity( int level ) const;
+  void updateMaxSize();
+  void compress();
+
+  int k_m;
+  long n_m;
+  double min_m;
+  double max_m;
+  int size_m;                           //!< number of items in all levels
+  int maxSize_m;                        //!< sum of level capacities
+  unsigned int seed_m;                  //!< state of the generator of compaction offsets
+  vector< vector<double> > levels_m;
+};
+
 void whichMax( double * data, int dataLen, double & maxVal, int & maxInd );
 void whichMin( double * data, int dataLen, double & minVal, int & minInd );
 
@@ -0,0 +1,273 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <queue>
+#include <algorithm>
+
+#include "DecisionTree.hh"
+#include "IOCppUtilities.hh"
+#include "IOCUtilities.h"
+#include "CUtilities.h"
+
+//--------------------------------------------------------- readErrTbl ----
+/// reads two column table of classification errors of a model
+errTbl_t * readErrTbl( const char *file )
+{
+  double **errTbl;
+  int nrow, ncol;
+  int header = 0;
+  readMatrix( file, &errTbl, &nrow, &ncol, header );
+
+  if ( ncol != 2 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: errTbl should have two columns and ncol=%d\n", __FILE__, __LINE__, ncol);
+    fprintf(stderr, "%s: \n", file);
+    printDblTbl(errTbl, nrow, ncol);
+    exit(1);
+  }
+
+  errTbl_t *errObj = new errTbl_t;
+  errObj->errTbl = errTbl;
+  errObj->nrow = nrow;
+  errObj->thld = errTbl[0][0];
+
+  MALLOC(errObj->x, double*, nrow * sizeof(double));
+  for ( int j = 0; j < nrow; ++j )
+    errObj->x[j] = errTbl[j][0];
+
+  errObj->xmax = errTbl[nrow-1][0];
+
+  errObj->nCells    = 0;
+  errObj->cellScale = 0;
+  errObj->cells     = NULL;
+
+  return errObj;
+}
+
+//------------------------------------------------------- buildErrGrid ----
+/// Builds a uniform grid of nCells cells over [thld, xmax] of the error
+/// curve, so that errGridLookup() replaces binary search over the whole
+/// table with a multiply, a floor and a load.
+///
+/// Each cell stores the range of rows that contain the nearest
+/// neighbours of all x of the cell. If the errors in that range differ by
+/// at most 2*tol, the cell stores their midrange and the lookup deviates
+/// from the exact step function by at most tol; otherwise the lookup
+/// runs bsearchDbl() over the (short) row range only, which gives
+/// exactly the same result as the search over the whole table. With
+/// tol=0 only cells with a constant error are collapsed.
+void buildErrGrid( errTbl_t *errObj, int nCells, double tol )
+{
+  if ( errObj->cells )
+  {
+    free(errObj->cells);
+    errObj->cells = NULL;
+  }
+  errObj->nCells    = 0;
+  errObj->cellScale = 0;
+
+  int nrow = errObj->nrow;
+  double range = errObj->xmax - errObj->thld;
+
+  if ( nCells <= 0 || nrow < 2 || !(range > 0) )
+    return;
+
+  MALLOC(errObj->cells, errCell_t*, nCells * sizeof(errCell_t));
+  errObj->nCells    = nCells;
+  errObj->cellScale = nCells / range;
+
+  double *x = errObj->x;
+  double *xEnd = x + nrow;
+  double cellLen = range / nCells;
+
+  for ( int c = 0; c < nCells; c++ )
+  {
+    double c0 = errObj->thld + c * cellLen;
+    double c1 = ( c == nCells - 1 ) ? errObj->xmax : c0 + cellLen;
+
+    // one extra row on each side covers the rounding of the cell index
+    // and the nearest neighbours of the cell's end points
+    int lo = (int)(lower_bound(x, xEnd, c0) - x) - 2;
+    int hi = (int)(upper_bound(x, xEnd, c1) - x) + 1;
+    if ( lo < 0 ) lo = 0;
+    if ( hi > nrow - 1 ) hi = nrow - 1;
+
+    double emin = errObj->errTbl[lo][1];
+    double emax = emin;
+    for ( int i = lo + 1; i <= hi; i++ )
+    {
+      double e = errObj->errTbl[i][1];
+      if ( e < emin ) emin = e;
+      if ( e > emax ) emax = e;
+    }
+
+    errCell_t &cell = errObj->cells[c];
+    cell.lo = lo;
+
+    if ( emax - emin <= 2 * tol )
+    {
+      cell.len = 0;
+      cell.err = ( emin == emax ) ? emin : 0.5 * ( emin + emax );
+    }
+    else
+    {
+      cell.len = hi - lo + 1;
+      cell.err = 0;
+    }
+  }
+}
+
+//----------------------------------------------------- decisionTree_t ----
+decisionTree_t::decisionTree_t()
+  : depth_m(0)
+{
+}
+
+//---------------------------------------------------- ~decisionTree_t ----
+decisionTree_t::~decisionTree_t()
+{
+  int n = nodes_m.size();
+  for ( int i = 0; i < n; i++ )
+    free(nodes_m[i].label);
+}
+
+//------------------------------------------------------------ compile ----
+void decisionTree_t::compile( NewickTree_t &nt, map<string, errTbl_t *> &errTbls )
+{
+  NewickNode_t *root = nt.root();
+  if ( !root )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: empty reference tree\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  nodes_m.clear();
+  depth_m = 0;
+
+  // breadth-first traversal; the children of a node are enqueued
+  // together, so they get consecutive indices
+  queue<NewickNode_t *> bfs;
+  vector<NewickNode_t *> newickNodes;
+  bfs.push(root);
+
+  while ( !bfs.empty() )
+  {
+    NewickNode_t *node = bfs.front();
+    bfs.pop();
+
+    newickNodes.push_back(node);
+
+    int numChildren = node->children_m.size();
+    for ( int i = 0; i < numChildren; i++ )
+      bfs.push( node->children_m[i] );
+  }
+
+  int n = newickNodes.size();
+  map<NewickNode_t *, int> nodeIdx;
+  for ( int i = 0; i < n; i++ )
+    nodeIdx[ newickNodes[i] ] = i;
+
+  nodes_m.resize(n);
+  int nextChild = 1;
+  for ( int i = 0; i < n; i++ )
+  {
+    NewickNode_t *node = newickNodes[i];
+    dtNode_t &nd = nodes_m[i];
+
+    // loadTree() leaves the root attached to a dummy parent
+    nd.parent      = ( node == root ) ? -1 : nodeIdx[ node->parent_m ];
+    nd.numChildren = node->children_m.size();
+    nd.firstChild  = nd.numChildren ? nextChild : -1;
+    nd.model_idx   = node->model_idx;
+    nd.depth       = nd.parent < 0 ? 0 : nodes_m[nd.parent].depth + 1;
+    nd.errTbl      = NULL;
+    nd.thld        = -HUGE_VAL;
+    nd.xmax        = -HUGE_VAL;
+    STRDUP(nd.label, node->label.c_str());
+
+    nextChild += nd.numChildren;
+
+    if ( nd.depth > depth_m )
+      depth_m = nd.depth;
+
+    if ( nd.parent >= 0 && errTbls.size() )
+    {
+      map<string, errTbl_t *>::iterator it = errTbls.find( node->label );
+      if ( it == errTbls.end() )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: there is no error table of %s\n",
+		__FILE__, __LINE__, node->label.c_str());
+	exit(1);
+      }
+
+      nd.errTbl = it->second;
+      nd.thld   = it->second->thld;
+      nd.xmax   = it->second->xmax;
+    }
+  }
+}
+
+//---------------------------------------------------------- findLabel ----
+int decisionTree_t::findLabel( const char *label ) const
+{
+  int n = nodes_m.size();
+  for ( int i = 0; i < n; i++ )
+    if ( strcmp(nodes_m[i].label, label) == 0 )
+      return i;
+
+  return -1;
+}
+
+//-------------------------------------------------------- fingerprint ----
+/// continues the FNV-1a hash h over the structure, labels, model indices
+/// and error curves, including their lookup grids, of the tree
+unsigned long long decisionTree_t::fingerprint( unsigned long long h ) const
+{
+  int n = nodes_m.size();
+  for ( int i = 0; i < n; i++ )
+  {
+    const dtNode_t &nd = nodes_m[i];
+    int v[] = { nd.parent, nd.firstChild, nd.numChildren, nd.model_idx };
+    h = fnv1a( v, sizeof(v), h );
+    h = fnv1a( nd.label, strlen(nd.label) + 1, h );
+
+    const errTbl_t *e = nd.errTbl;
+    if ( !e )
+      continue;
+
+    for ( int j = 0; j < e->nrow; j++ )
+      h = fnv1a( e->errTbl[j], 2 * sizeof(double), h );
+
+    h = fnv1a( &e->nCells, sizeof(e->nCells), h );
+    for ( int j = 0; j < e->nCells; j++ )
+    {
+      h = fnv1a( &e->cells[j].lo, sizeof(int), h );
+      h = fnv1a( &e->cells[j].len, sizeof(int), h );
+      h = fnv1a( &e->cells[j].err, sizeof(double), h );
+    }
+  }
+
+  return h;
+}
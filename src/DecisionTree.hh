@@ -0,0 +1,164 @@
+#ifndef DECISIONTREE_HH
+#define DECISIONTREE_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "Newick.hh"
+#include "CStatUtilities.h"
+
+using namespace std;
+
+//----------------------------------------------- errCell_t ----
+/// cell of the uniform grid over [thld, xmax] of an error curve
+typedef struct
+{
+  int lo;       /// first row of errTbl that can be hit from the cell
+  int len;      /// number of rows to search; 0 if the error is constant over the cell
+  double err;   /// the error over the cell when len is 0
+} errCell_t;
+
+//----------------------------------------------- errTbl_t ----
+/// holds errTbl and log10cProb.thld
+typedef struct
+{
+  double **errTbl; ///
+  int nrow;
+  double thld;  /// the first element of x
+  double *x;    /// the first column of errTbl
+  double xmax;  /// the max of x
+  int nCells;       /// number of cells of the lookup grid; 0 if there is no grid
+  double cellScale; /// nCells / (xmax - thld)
+  errCell_t *cells; /// lookup grid
+} errTbl_t;
+
+errTbl_t * readErrTbl( const char *file );
+void buildErrGrid( errTbl_t *errObj, int nCells, double tol );
+inline double errGridLookup( const errTbl_t *errObj, double x );
+inline double errBsearchLookup( const errTbl_t *errObj, double x );
+
+//----------------------------------------------- dtNode_t ----
+/// node of a compiled decision tree
+typedef struct
+{
+  int parent;           /// index of the parent node; -1 for the root
+  int firstChild;       /// index of the first child; children occupy [firstChild, firstChild+numChildren)
+  int numChildren;
+  int model_idx;        /// index of the node's model in MarkovChains2_t
+  int depth;            /// depth of the node; the root's depth is 0
+  double thld;          /// copy of errTbl->thld; -inf if there is no error table
+  double xmax;          /// copy of errTbl->xmax
+  const errTbl_t *errTbl; /// error curve of the node's model; NULL if not used
+  char *label;
+} dtNode_t;
+
+//============================================== decisionTree_t ====
+/// Flat, array based copy of the reference tree used by the
+/// classification walk
+///
+/// Nodes are stored in breadth-first order, so that the children of
+/// each node form a contiguous range of indices, and each node carries
+/// everything the walk needs - model index, error threshold and error
+/// curve - so that classifying a sequence requires no string
+/// comparisons or map lookups.
+///
+class decisionTree_t
+{
+public:
+  decisionTree_t();
+  ~decisionTree_t();
+
+  /// builds the flat tree from nt; nt.modelIdx() has to be called
+  /// first. If errTbls is not empty, each non-root node has to have an
+  /// error table in it.
+  void compile( NewickTree_t &nt, map<string, errTbl_t *> &errTbls );
+
+  int root() const { return 0; }
+  int size() const { return (int)nodes_m.size(); }
+  int depth() const { return depth_m; }
+  int findLabel( const char *label ) const;   /// index of the node with the given label or -1
+  unsigned long long fingerprint( unsigned long long h ) const; /// continues the FNV-1a hash h over the tree and its error curves
+
+  const dtNode_t & operator[]( int i ) const { return nodes_m[i]; }
+  inline double error( int i, double x ) const;
+  inline double exactError( int i, double x ) const;
+
+private:
+  vector<dtNode_t> nodes_m;
+  int depth_m;
+};
+
+//-------------------- inlines -------------------------------
+/// error at x, thld < x <= xmax, using the lookup grid
+inline double errGridLookup( const errTbl_t *errObj, double x )
+{
+  int c = (int)( (x - errObj->thld) * errObj->cellScale );
+  if ( c >= errObj->nCells )
+    c = errObj->nCells - 1;
+
+  const errCell_t &cell = errObj->cells[c];
+  if ( !cell.len )
+    return cell.err;
+
+  int ierr = cell.lo + bsearchDbl( errObj->x + cell.lo, cell.len, x );
+  return errObj->errTbl[ierr][1];
+}
+
+/// error at x, thld < x <= xmax, using binary search over the whole table
+inline double errBsearchLookup( const errTbl_t *errObj, double x )
+{
+  int ierr = bsearchDbl( errObj->x, errObj->nrow, x );
+  return errObj->errTbl[ierr][1];
+}
+
+/// classification error of the i-th node's model at the normalized
+/// log10 probability x; only valid for x > thld
+inline double decisionTree_t::error( int i, double x ) const
+{
+  const dtNode_t &nd = nodes_m[i];
+
+  if ( x > nd.xmax )
+    return 0;
+
+  if ( nd.errTbl->nCells )
+    return errGridLookup( nd.errTbl, x );
+
+  return errBsearchLookup( nd.errTbl, x );
+}
+
+/// same as error(), but always using binary search; used to check the grid
+inline double decisionTree_t::exactError( int i, double x ) const
+{
+  const dtNode_t &nd = nodes_m[i];
+
+  if ( x > nd.xmax )
+    return 0;
+
+  return errBsearchLookup( nd.errTbl, x );
+}
+
+#endif
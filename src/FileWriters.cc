@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "FileWriters.hh"
+#include "GzStream.hh"
+#include "IOCUtilities.h"
+#include "CUtilities.h"
+
+//----------------------------------------------------- fileWriters_t ----
+fileWriters_t::fileWriters_t( int maxOpen, size_t bufSize, int gzLevel )
+  : nOpen_m(0), maxOpen_m(maxOpen), bufSize_m(bufSize), gzLevel_m(gzLevel)
+{
+  if ( maxOpen_m <= 0 )
+  {
+    // leave some descriptors for the input, results and model files
+    struct rlimit rl;
+    if ( getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY )
+      maxOpen_m = (int)rl.rlim_cur - 32;
+    else
+      maxOpen_m = 1000;
+
+    if ( maxOpen_m > 1000 )
+      maxOpen_m = 1000;
+  }
+
+  if ( maxOpen_m < 1 )
+    maxOpen_m = 1;
+}
+
+//---------------------------------------------------- ~fileWriters_t ----
+fileWriters_t::~fileWriters_t()
+{
+  closeAll();
+}
+
+//--------------------------------------------------------------- add ----
+/// registers file and returns its index; the file is not opened until
+/// the first call of fp(); with gzip compression .gz is appended to its name
+int fileWriters_t::add( const char *file, const char *mode )
+{
+  file_t f;
+  f.path   = string(file) + string(gzLevel_m > 0 ? ".gz" : "");
+  f.mode   = string(mode);
+  f.fp     = NULL;
+  f.buf    = NULL;
+  f.opened = false;
+  f.lru    = lru_m.end();
+
+  files_m.push_back(f);
+
+  return (int)files_m.size() - 1;
+}
+
+//-------------------------------------------------------------- open ----
+FILE * fileWriters_t::open( int idx )
+{
+  if ( nOpen_m >= maxOpen_m )
+    close( lru_m.back() );
+
+  file_t &f = files_m[idx];
+
+  // once the file has been written to, it can only be appended to
+  const char *mode = f.opened ? "a" : f.mode.c_str();
+  f.opened = true;
+
+  if ( gzLevel_m > 0 )
+  {
+    // the gzip stream collects bufSize_m bytes before deflating them
+    f.fp = gzWriteOpen(f.path.c_str(), mode, gzLevel_m, false, bufSize_m);
+  }
+  else
+  {
+    f.fp = fOpen(f.path.c_str(), mode);
+    MALLOC(f.buf, char*, bufSize_m * sizeof(char));
+    setvbuf(f.fp, f.buf, _IOFBF, bufSize_m);
+  }
+
+  lru_m.push_front(idx);
+  f.lru = lru_m.begin();
+  nOpen_m++;
+
+  return f.fp;
+}
+
+//------------------------------------------------------------- close ----
+void fileWriters_t::close( int idx )
+{
+  file_t &f = files_m[idx];
+
+  if ( !f.fp )
+    return;
+
+  fclose(f.fp);
+  if ( f.buf )
+    free(f.buf);
+  f.fp  = NULL;
+  f.buf = NULL;
+
+  lru_m.erase(f.lru);
+  f.lru = lru_m.end();
+  nOpen_m--;
+}
+
+//------------------------------------------------------------- flush ----
+void fileWriters_t::flush()
+{
+  list<int>::iterator it;
+  for ( it = lru_m.begin(); it != lru_m.end(); ++it )
+    fflush(files_m[*it].fp);
+}
+
+//---------------------------------------------------------- closeAll ----
+void fileWriters_t::closeAll()
+{
+  while ( !lru_m.empty() )
+    close( lru_m.back() );
+}
@@ -0,0 +1,101 @@
+#ifndef FILEWRITERS_HH
+#define FILEWRITERS_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <list>
+
+using namespace std;
+
+//============================================== fileWriters_t ====
+/// Manager of a large number of buffered output files
+///
+/// Files are registered once with add() and then written through the
+/// handle returned by fp(). At most maxOpen of them are kept open at any
+/// time; when the limit is reached the least recently used file is
+/// flushed and closed, and reopened in append mode the next time it is
+/// written to. This replaces fopen(..., "a")/fclose() pairs around every
+/// single record.
+///
+/// Parameters:
+/// maxOpen - maximal number of simultaneously open files; if <= 0 it is
+///           derived from the soft RLIMIT_NOFILE limit of the process
+/// bufSize - size of the stdio buffer allocated for each open file
+/// gzLevel - if > 0, the files are gzip compressed at this level; each
+///           reopening appends a new gzip member (see GzStream.hh)
+///
+class fileWriters_t
+{
+public:
+  fileWriters_t( int maxOpen=0, size_t bufSize=64*1024, int gzLevel=0 );
+  ~fileWriters_t();
+
+  int add( const char *file, const char *mode="a" ); /// registers file; returns its writer index
+  inline FILE * fp( int idx );                       /// returns an open handle of the idx-th file
+  void flush();                                      /// flushes all open files
+  void closeAll();                                   /// flushes and closes all open files
+
+  int size() const { return (int)files_m.size(); }
+  int maxOpen() const { return maxOpen_m; }
+  const char *file( int idx ) const { return files_m[idx].path.c_str(); }
+
+private:
+  FILE * open( int idx );
+  void close( int idx );
+
+  struct file_t
+  {
+    string path;                 /// path of the file
+    string mode;                 /// mode used when the file is opened for the first time
+    FILE *fp;                    /// handle; NULL if the file is currently closed
+    char *buf;                   /// stdio buffer of fp
+    bool opened;                 /// true if the file has been opened at least once
+    list<int>::iterator lru;     /// position of the file in lru_m
+  };
+
+  vector<file_t> files_m;
+  list<int> lru_m;               /// indices of open files; the most recently used file is at the front
+  int nOpen_m;                   /// number of currently open files
+  int maxOpen_m;
+  size_t bufSize_m;
+  int gzLevel_m;
+};
+
+//-------------------- inlines -------------------------------
+inline FILE * fileWriters_t::fp( int idx )
+{
+  file_t &f = files_m[idx];
+
+  if ( !f.fp )
+    return open( idx );
+
+  if ( f.lru != lru_m.begin() )
+    lru_m.splice( lru_m.begin(), lru_m, f.lru );
+
+  return f.fp;
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "FlatScorer.hh"
+
+//------------------------------------------------------ flatScorer_t ----
+flatScorer_t::flatScorer_t( const MarkovChains2_t *probModel, const decisionTree_t &dt )
+{
+  for ( int i = 0; i < dt.size(); i++ )
+  {
+    if ( dt[i].numChildren )
+      continue;
+
+    leaves_m.push_back(i);
+
+    string s = dt[i].label;
+    for ( int p = dt[i].parent; p > dt.root(); p = dt[p].parent )
+      s = string(dt[p].label) + ";" + s;
+    lineage_m.push_back(s);
+  }
+
+  nLeaves_m = (int)leaves_m.size();
+  stride_m  = ( (nLeaves_m + FLAT_BLOCK - 1) / FLAT_BLOCK ) * FLAT_BLOCK;
+
+  int hi;
+  probModel->kmerRange(lo_m, hi);
+  nRows_m = hi - lo_m;
+
+  size_t size = bytes();
+  if ( size > (size_t)FLAT_MAX_MB << 20 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: The flat scoring table of %d species models would take %lu MB, "
+	    "more than the limit of %d MB; classify without --flat\n",
+	    __FILE__, __LINE__, nLeaves_m, (unsigned long)((size + (1 << 20) - 1) >> 20), FLAT_MAX_MB);
+    exit(1);
+  }
+
+  if ( posix_memalign((void **)&tbl_m, 64, size) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Could not allocate %lu bytes for the flat scoring table\n",
+	    __FILE__, __LINE__, (unsigned long)size);
+    exit(1);
+  }
+  memset(tbl_m, 0, size);
+
+  for ( int j = 0; j < nLeaves_m; j++ )
+  {
+    const double *lp = probModel->log10cProbs( dt[leaves_m[j]].model_idx ) + lo_m;
+    double *t = tbl_m + j;
+    for ( int r = 0; r < nRows_m; r++, t += stride_m )
+      *t = lp[r];
+  }
+}
+
+//----------------------------------------------------- ~flatScorer_t ----
+flatScorer_t::~flatScorer_t()
+{
+  free(tbl_m);
+}
+
+//------------------------------------------------------------- score ----
+void flatScorer_t::score( const int *kmers, int n, double *x ) const
+{
+  for ( int b = 0; b < stride_m; b += FLAT_BLOCK )
+  {
+#ifdef __SSE2__
+    __m128d a0 = _mm_setzero_pd();
+    __m128d a1 = _mm_setzero_pd();
+    __m128d a2 = _mm_setzero_pd();
+    __m128d a3 = _mm_setzero_pd();
+
+    for ( int p = 0; p < n; p++ )
+    {
+      const double *row = tbl_m + (size_t)(kmers[p] - lo_m) * stride_m + b;
+      a0 = _mm_add_pd( a0, _mm_load_pd(row) );
+      a1 = _mm_add_pd( a1, _mm_load_pd(row + 2) );
+      a2 = _mm_add_pd( a2, _mm_load_pd(row + 4) );
+      a3 = _mm_add_pd( a3, _mm_load_pd(row + 6) );
+    }
+
+    _mm_storeu_pd( x + b,     a0 );
+    _mm_storeu_pd( x + b + 2, a1 );
+    _mm_storeu_pd( x + b + 4, a2 );
+    _mm_storeu_pd( x + b + 6, a3 );
+#else
+    double a[FLAT_BLOCK];
+    for ( int j = 0; j < FLAT_BLOCK; j++ )
+      a[j] = 0;
+
+    for ( int p = 0; p < n; p++ )
+    {
+      const double *row = tbl_m + (size_t)(kmers[p] - lo_m) * stride_m + b;
+      for ( int j = 0; j < FLAT_BLOCK; j++ )
+	a[j] += row[j];
+    }
+
+    for ( int j = 0; j < FLAT_BLOCK; j++ )
+      x[b + j] = a[j];
+#endif
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef FLATSCORER_HH
+#define FLATSCORER_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <string>
+#include <vector>
+
+#include "MarkovChains2.hh"
+#include "DecisionTree.hh"
+
+using namespace std;
+
+#define FLAT_BLOCK 8 // number of leaves whose scores are kept in registers by score()
+#define FLAT_MAX_MB 1024 // largest table (in MB) flatScorer_t is allowed to allocate
+
+//============================================== flatScorer_t ====
+/// Scoring of a read with all leaf (species) models of a decision tree
+/// in one pass
+///
+/// The log10 conditional probabilities of the leaf models are copied
+/// into one interleaved table: the row of a k-mer holds its conditional
+/// probability under each of the leaves, so the scores of all leaves are
+/// accumulated from a single sequential read of one cache-line aligned
+/// row per position of the read, instead of one random access into a
+/// separate table per model. With SSE2 the accumulation is done for
+/// FLAT_BLOCK leaves at a time in vector registers.
+///
+/// The terms are added in the order of MarkovChains2_t::log10prob(), so
+/// the scores are the same as the ones of the models themselves.
+///
+/// The table takes 8 bytes per k-mer of the model order and leaf
+/// (e.g. 512 MB for order 7 and 1000 species); a table larger than
+/// FLAT_MAX_MB is refused with an error.
+///
+class flatScorer_t
+{
+public:
+  flatScorer_t( const MarkovChains2_t *probModel, const decisionTree_t &dt );
+  ~flatScorer_t();
+
+  /// log10 probabilities of the read with k-mer indices kmers (see
+  /// MarkovChains2_t::kmerIndices()) under all leaves; x has to have
+  /// room for stride() values
+  void score( const int *kmers, int n, double *x ) const;
+
+  int size() const { return nLeaves_m; }
+  int stride() const { return stride_m; }
+  size_t bytes() const { return (size_t)nRows_m * stride_m * sizeof(double); } /// size of the table
+  int leaf( int j ) const { return leaves_m[j]; }              /// decision tree node of the j-th leaf
+  const char *lineage( int j ) const { return lineage_m[j].c_str(); } /// ';' separated labels of the j-th leaf and its ancestors below the root
+
+private:
+  int nLeaves_m;
+  int stride_m;                 /// nLeaves_m rounded up to a multiple of FLAT_BLOCK
+  int lo_m;                     /// k-mer index of the first row of tbl_m
+  int nRows_m;
+  double *tbl_m;                /// tbl_m[(v - lo_m) * stride_m + j] = log10 cond. prob. of the k-mer v under the j-th leaf
+  vector<int> leaves_m;
+  vector<string> lineage_m;
+};
+
+#endif
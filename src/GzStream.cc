@@ -0,0 +1,287 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <string>
+#include "GzStream.hh"
+#include "CUtilities.h"
+
+using namespace std;
+
+//------------------------------------------------------- gzStream_t ----
+/// state of a stream opened by gzWriteOpen()
+struct gzStream_t
+{
+  string path;
+  int fd;
+  z_stream zs;
+  unsigned char *out;            /// deflate output buffer
+  size_t outSize;
+
+  char *buf[2];                  /// blocks filled by the writer
+  size_t bufSize;
+  size_t len;                    /// number of bytes in buf[cur]
+  int cur;                       /// index of the block being filled
+
+  bool background;               /// true if blocks are deflated by thread
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  char *pending;                 /// block waiting for the compressor; NULL if none
+  size_t pendingLen;
+  bool done;                     /// set by close; the compressor exits when no block is pending
+};
+
+//------------------------------------------------------- gzWriteAll ----
+static void gzWriteAll( gzStream_t *s, const unsigned char *p, size_t n )
+{
+  while ( n )
+  {
+    ssize_t w = write(s->fd, p, n);
+    if ( w < 0 )
+    {
+      if ( errno == EINTR )
+	continue;
+      fprintf(stderr, "ERROR in %s at line %d: cannot write to %s: %s\n",
+	      __FILE__, __LINE__, s->path.c_str(), strerror(errno));
+      exit(1);
+    }
+    p += w;
+    n -= w;
+  }
+}
+
+//--------------------------------------------------------- gzDeflate ----
+/// deflates n bytes of data and writes the output; with flush == Z_FINISH
+/// also ends the gzip member
+static void gzDeflate( gzStream_t *s, char *data, size_t n, int flush )
+{
+  s->zs.next_in  = (Bytef *)data;
+  s->zs.avail_in = (uInt)n;
+
+  int ret;
+  do
+  {
+    s->zs.next_out  = s->out;
+    s->zs.avail_out = (uInt)s->outSize;
+    ret = deflate(&s->zs, flush);
+    if ( ret == Z_STREAM_ERROR )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: deflate() failed on %s\n",
+	      __FILE__, __LINE__, s->path.c_str());
+      exit(1);
+    }
+    gzWriteAll(s, s->out, s->outSize - s->zs.avail_out);
+  }
+  while ( s->zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END) );
+}
+
+//----------------------------------------------------- gzCompressor ----
+/// compressor thread: deflates the blocks handed over by gzSubmit()
+static void *gzCompressor( void *arg )
+{
+  gzStream_t *s = (gzStream_t *)arg;
+
+  pthread_mutex_lock(&s->lock);
+  while ( 1 )
+  {
+    while ( !s->pending && !s->done )
+      pthread_cond_wait(&s->cond, &s->lock);
+
+    if ( !s->pending )
+      break;
+
+    char *block = s->pending;
+    size_t n = s->pendingLen;
+    pthread_mutex_unlock(&s->lock);
+
+    gzDeflate(s, block, n, Z_NO_FLUSH);
+
+    pthread_mutex_lock(&s->lock);
+    s->pending = NULL;
+    pthread_cond_broadcast(&s->cond);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return NULL;
+}
+
+//--------------------------------------------------------- gzSubmit ----
+/// passes the current block on to be compressed and switches the writer
+/// to the other block
+static void gzSubmit( gzStream_t *s )
+{
+  if ( !s->len )
+    return;
+
+  if ( !s->background )
+  {
+    gzDeflate(s, s->buf[0], s->len, Z_NO_FLUSH);
+    s->len = 0;
+    return;
+  }
+
+  pthread_mutex_lock(&s->lock);
+  while ( s->pending )
+    pthread_cond_wait(&s->cond, &s->lock);
+  s->pending    = s->buf[s->cur];
+  s->pendingLen = s->len;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+
+  s->cur ^= 1;
+  s->len  = 0;
+}
+
+//---------------------------------------------------------- gzWrite ----
+static ssize_t gzWrite( void *cookie, const char *data, size_t n )
+{
+  gzStream_t *s = (gzStream_t *)cookie;
+
+  size_t left = n;
+  while ( left )
+  {
+    size_t k = s->bufSize - s->len;
+    if ( k > left )
+      k = left;
+    memcpy(s->buf[s->cur] + s->len, data, k);
+    s->len += k;
+    data   += k;
+    left   -= k;
+
+    if ( s->len == s->bufSize )
+      gzSubmit(s);
+  }
+
+  return n;
+}
+
+//---------------------------------------------------------- gzClose ----
+static int gzClose( void *cookie )
+{
+  gzStream_t *s = (gzStream_t *)cookie;
+
+  gzSubmit(s);
+
+  if ( s->background )
+  {
+    pthread_mutex_lock(&s->lock);
+    s->done = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+  }
+
+  gzDeflate(s, NULL, 0, Z_FINISH);
+  deflateEnd(&s->zs);
+
+  int ret = close(s->fd);
+
+  free(s->buf[0]);
+  if ( s->background )
+    free(s->buf[1]);
+  free(s->out);
+  delete s;
+
+  return ret;
+}
+
+//------------------------------------------------------- gzWriteOpen ----
+FILE *gzWriteOpen( const char *file, const char *mode, int level,
+		   bool background, size_t blockSize )
+{
+  int flags = O_WRONLY | O_CREAT | (mode[0] == 'a' ? O_APPEND : O_TRUNC);
+  int fd = open(file, flags, 0666);
+  if ( fd < 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot open %s for %s: %s\n",
+	    __FILE__, __LINE__, file, mode, strerror(errno));
+    exit(1);
+  }
+
+  gzStream_t *s = new gzStream_t;
+  s->path       = string(file);
+  s->fd         = fd;
+  s->bufSize    = blockSize;
+  s->len        = 0;
+  s->cur        = 0;
+  s->background = background;
+  s->pending    = NULL;
+  s->pendingLen = 0;
+  s->done       = false;
+  s->buf[1]     = NULL;
+
+  // 15 + 16: 32K window with a gzip header; the small streams of the
+  // unthreaded writers use a 4K window and less hash memory
+  memset(&s->zs, 0, sizeof(s->zs));
+  int ret = background
+    ? deflateInit2(&s->zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)
+    : deflateInit2(&s->zs, level, Z_DEFLATED, 12 + 16, 5, Z_DEFAULT_STRATEGY);
+  if ( ret != Z_OK )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: deflateInit2() failed for %s (level %d)\n",
+	    __FILE__, __LINE__, file, level);
+    exit(1);
+  }
+
+  s->outSize = background ? blockSize / 2 : 16*1024;
+  MALLOC(s->out, unsigned char*, s->outSize * sizeof(unsigned char));
+  MALLOC(s->buf[0], char*, blockSize * sizeof(char));
+
+  if ( background )
+  {
+    MALLOC(s->buf[1], char*, blockSize * sizeof(char));
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if ( pthread_create(&s->thread, NULL, gzCompressor, s) )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: cannot start the compressor thread of %s\n",
+	      __FILE__, __LINE__, file);
+      exit(1);
+    }
+  }
+
+  cookie_io_functions_t io;
+  io.read  = NULL;
+  io.write = gzWrite;
+  io.seek  = NULL;
+  io.close = gzClose;
+
+  FILE *fp = fopencookie(s, "w", io);
+  if ( !fp )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: fopencookie() failed for %s\n",
+	    __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  return fp;
+}
@@ -0,0 +1,51 @@
+#ifndef GZSTREAM_HH
+#define GZSTREAM_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+
+//------------------------------------------------------- gzWriteOpen ----
+/// Opens a gzip compressed output stream on file and returns it as an
+/// ordinary FILE* handle (via fopencookie()), so that the existing
+/// fprintf()/fwrite() writers need not change; fclose() finishes the gzip
+/// member and closes the file.
+///
+/// Writes are collected in blocks of blockSize bytes. If background is
+/// true, each full block is handed over to a separate compressor thread
+/// (two blocks alternate), so that deflating overlaps with the writer;
+/// otherwise the block is deflated in the writer's thread with a smaller
+/// zlib window, which suits a large number of simultaneously open small
+/// files.
+///
+/// mode is "w" (truncate) or "a" (append); appending to a gzip file
+/// starts a new member, and concatenated members are a valid gzip file
+/// (gzip -dc, zcat and seqReader_t read them as one stream). level is
+/// the zlib compression level (1 - fastest, 9 - smallest). Exits with an
+/// error message if the file cannot be opened or written.
+///
+FILE *gzWriteOpen( const char *file, const char *mode, int level,
+		   bool background=true, size_t blockSize=1024*1024 );
+
+#endif
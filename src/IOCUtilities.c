@@ -23,6 +23,9 @@
  *
  */
 
+#include <sys/stat.h>
+#include <sys/types.h>
+
 #include "IOCUtilities.h"
 #include "CUtilities.h"
 
@@ -63,6 +66,52 @@ FILE *_fOpen ( const char *file, const char *format, const char * cppfile, int l
     return f;
 }
 
+//----------------------------------------------------------------- mkDir ----
+//! create a directory and its missing parents, as mkdir -p does, without
+//! starting a shell; exit with an error message if it cannot be created
+void _mkDir ( const char *dir, const char * cppfile, int line )
+{
+    struct stat st;
+    char *path;
+    char *p;
+
+    if ( dir == NULL || dir[0] == '\0' )
+    {
+        fprintf ( stderr, "%s line:%d  Empty directory name\n\n", cppfile, line );
+        exit ( 1 );
+    }
+
+    STRDUP ( path, dir );
+
+    for ( p = path + 1; ; p++ )
+    {
+        if ( *p != '/' && *p != '\0' )
+            continue;
+
+        char c = *p;
+        *p = '\0';
+
+        if ( mkdir ( path, 0777 ) != 0 && errno != EEXIST )
+        {
+            fprintf ( stderr, "%s line:%d  Cannot create directory %s: %s\n\n",
+                      cppfile, line, path, strerror ( errno ) );
+            exit ( 1 );
+        }
+
+        *p = c;
+        if ( c == '\0' )
+            break;
+    }
+
+    if ( stat ( path, &st ) != 0 || !S_ISDIR ( st.st_mode ) )
+    {
+        fprintf ( stderr, "%s line:%d  %s is not a directory\n\n", cppfile, line, path );
+        exit ( 1 );
+    }
+
+    free ( path );
+}
+
 // ---------------------------- getLine ---------------------------
 char* GetLine(FILE* inputfile)
 /*
@@ -544,3 +593,21 @@ void writeCharTbl(char *inFile, const char ***tbl, int nRows, int nCols )
 
   fclose(out);
 }
+
+
+//----------------------------------------------------------- jsonString ----
+void jsonString( FILE *out, const char *s )
+// prints s as a JSON string
+{
+  fputc('"', out);
+  for ( ; *s; s++ )
+  {
+    if ( *s == '"' || *s == '\\' )
+      fprintf(out, "\\%c", *s);
+    else if ( (unsigned char)*s < 0x20 )
+      fprintf(out, "\\u%04x", *s);
+    else
+      fputc(*s, out);
+  }
+  fputc('"', out);
+}
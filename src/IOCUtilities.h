@@ -42,6 +42,10 @@ FILE *_fOpen ( const char *file, const char *format, const char *sourceFile, int
 
 #define fOpen(x,y)   _fOpen((x), (y), __FILE__, __LINE__)
 
+void _mkDir ( const char *dir, const char *sourceFile, int line );
+
+#define mkDir(x)     _mkDir((x), __FILE__, __LINE__)
+
 char * readTable( const char *inFile, double ***matrix, int *nrow, int *ncol,
 		  char ***rowNames, char ***colNames );
 
@@ -52,6 +56,8 @@ void writeCharTbl(char *inFile, const char ***tbl, int nRows, int nCols );
 
 char* GetLine(FILE* inputfile);
 
+void jsonString( FILE *out, const char *s );
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@ OR PERFORMANCE OF THIS SOFTWARE.
 #include "CUtilities.h"
 #include "CppUtilities.hh"
 #include "strings.hh"
+#include "SeqReader.hh"
 
 #define LINE_LEN  10000
 
@@ -274,16 +275,10 @@ void readFasta( const char *file, map<string,string> &seqTbl)
   char *id, *seq;
   int seqLen;
 
-  FILE *in = fOpen(file, "r");
+  seqReader_t reader( file );
 
-  while ( getNextFastaRecord( in, id, seq, seqLen) )
-  {
-    seqTbl.insert(make_pair(string(id),string(seq)));
-    free(id);
-    free(seq);
-  }
-
-  fclose(in);
+  while ( reader.next( id, seq, seqLen) )
+    seqTbl.insert(make_pair(string(id),string(seq, seqLen)));
 }
 
 
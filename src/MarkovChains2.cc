@@ -31,6 +31,7 @@ OR PERFORMANCE OF THIS SOFTWARE.
 #include "CppUtilities.hh"
 #include "strings.hh"
 #include "DNAsequence.hh"
+#include "SeqReader.hh"
 
 using namespace std;
 
@@ -69,7 +70,8 @@ MarkovChains2_t::MarkovChains2_t(int order,
 				 char *dir,
 				 int maxNumAmbCodes,
 				 int pseudoCountType)
-  : order_m(order), dir_m(dir),  maxNumAmbCodes_m(maxNumAmbCodes), pseudoCountType_m(pseudoCountType)
+  : order_m(order), dir_m(dir),  maxNumAmbCodes_m(maxNumAmbCodes), pseudoCountType_m(pseudoCountType),
+    mapped_m(false)
 {
   int maxWordLen = order_m+1;
 
@@ -79,8 +81,6 @@ MarkovChains2_t::MarkovChains2_t(int order,
   wordStrgs_m.resize(maxWordLen);
   for ( int k = 1; k <= maxWordLen; ++k )
     getAllKmers(k, wordStrgs_m[k-1]);
-
-  MALLOC(cProb_m, double*, nAllWords_m * sizeof(double));
   #if 0
   cerr << "in MarkovChains2_t::MarkovChains2_t() order_m=" << order_m
        << "\tmaxWordLen=" << maxWordLen
@@ -115,6 +115,7 @@ MarkovChains2_t::MarkovChains2_t(int order,
     }
 
     createMooreMachine();
+    allocTables();
 
     MALLOC(cProb_m, double*, nAllWords_m * sizeof(double));
 
@@ -152,6 +153,11 @@ MarkovChains2_t::MarkovChains2_t(int order,
   {
     createModelIds();
     createMooreMachine();
+    allocTables();
+
+    // nAllWords_m is set by createMooreMachine()
+    MALLOC(cProb_m, double*, nAllWords_m * sizeof(double));
+
     initIUPACambCodeHashVals();
 
     for ( int i = 0; i < maxWordLen; ++i )
@@ -170,7 +176,8 @@ MarkovChains2_t::MarkovChains2_t(int order,
 				 char *dir,
 				 int maxNumAmbCodes,
 				 int pseudoCountType)
-  : order_m(order), dir_m(dir),  maxNumAmbCodes_m(maxNumAmbCodes), pseudoCountType_m(pseudoCountType)
+  : order_m(order), dir_m(dir),  maxNumAmbCodes_m(maxNumAmbCodes), pseudoCountType_m(pseudoCountType),
+    mapped_m(false)
 {
   int maxWordLen = order_m+1;
 
@@ -191,6 +198,7 @@ MarkovChains2_t::MarkovChains2_t(int order,
 
   createModelIds();
   createMooreMachine();
+  allocTables();
   initIUPACambCodeHashVals();
 
   for ( int i = 0; i < maxWordLen; ++i )
@@ -201,6 +209,52 @@ MarkovChains2_t::MarkovChains2_t(int order,
 }
 
 
+//--------------------------------------------------------- MarkovChains2_t ----
+/// MarkovChains2_t version using the log10 conditional probability table
+/// of a mapped model bundle in place: nothing is read or parsed, and only
+/// the transition function of the Moore machine is built. The tables of
+/// the lower orders are the first nAllWords_m values of the bundle's
+/// nWords long rows, so the bundle can be of a higher order
+MarkovChains2_t::MarkovChains2_t(int order,
+				 const vector<const char *> &modelIds,
+				 const double *log10cProbs,
+				 int nWords,
+				 int maxNumAmbCodes)
+  : order_m(order), dir_m(NULL),  maxNumAmbCodes_m(maxNumAmbCodes), pseudoCountType_m(recPdoCount),
+    mapped_m(true)
+{
+  getAllKmers( 1, nucs_m );
+
+  char *idStr;
+  size_t nModels = modelIds.size();
+  for ( size_t i = 0; i < nModels; ++i )
+  {
+    STRDUP(idStr, modelIds[i]);
+    modelIds_m.push_back(idStr);
+  }
+
+  printCounts_m = false;
+  counts_m = NULL;
+  createMooreMachine();
+
+  if ( !nModels || nWords < nAllWords_m )
+  {
+    cerr << "Error in MarkovChains2_t::MarkovChains2_t(): the bundle has " << nModels
+	 << " models with " << nWords << " words each; at least one model with "
+	 << nAllWords_m << " words is needed" << endl;
+    exit(1);
+  }
+
+  MALLOC(log10cProb_m, double**, nModels * sizeof(double*));
+  for ( size_t i = 0; i < nModels; ++i )
+    log10cProb_m[i] = (double *)log10cProbs + i * nWords;
+
+  MALLOC(cProb_m, double*, nAllWords_m * sizeof(double));
+
+  initIUPACambCodeHashVals();
+}
+
+
 //-------------------------------------------------------- readModelIds ----
 bool MarkovChains2_t::readModelIds()
 {
@@ -266,8 +320,9 @@ MarkovChains2_t::~MarkovChains2_t()
 
   if ( log10cProb_m )
   {
-    for ( int i = 0; i < nModels; ++i )
-      free(log10cProb_m[i]);
+    if ( !mapped_m )
+      for ( int i = 0; i < nModels; ++i )
+	free(log10cProb_m[i]);
     free(log10cProb_m);
   }
 
@@ -303,6 +358,24 @@ MarkovChains2_t::~MarkovChains2_t()
   free(cProb_m);
 }
 
+//-------------------------------------------------------------- fingerprint ----
+/// continues the FNV-1a hash h over the order, the model ids and the
+/// log10 conditional probability tables of all models; two instances
+/// have the same fingerprint only if they classify identically
+unsigned long long MarkovChains2_t::fingerprint( unsigned long long h )
+{
+  h = fnv1a( &order_m, sizeof(order_m), h );
+
+  int nModels = modelIds_m.size();
+  for ( int i = 0; i < nModels; ++i )
+  {
+    h = fnv1a( modelIds_m[i], strlen(modelIds_m[i]) + 1, h );
+    h = fnv1a( log10cProb_m[i], nAllWords_m * sizeof(double), h );
+  }
+
+  return h;
+}
+
 //------------------------------------------------------------------- setupIOfiles ----
 /// setupIOfiles intialize basic parameter strings and file names
 void MarkovChains2_t::setupIOfiles()
@@ -347,6 +420,22 @@ void MarkovChains2_t::setupIOfiles()
   #endif
 }
 
+//------------------------------------------------------------ allocTables ----
+/// allocates the k-mer count and log10 conditional probability tables of
+/// all models; createMooreMachine() has to be called first
+void MarkovChains2_t::allocTables()
+{
+  int nModels = modelIds_m.size();
+  MALLOC(counts_m, double**, nModels * sizeof(double*));
+  MALLOC(log10cProb_m, double**, nModels * sizeof(double*));
+
+  for ( int i = 0; i < nModels; ++i )
+  {
+    CALLOC(counts_m[i], double*, nAllWords_m * sizeof(double));
+    MALLOC(log10cProb_m[i], double*, nAllWords_m * sizeof(double));
+  }
+}
+
 //----------------------------------------------------- createMooreMachine ----
 void MarkovChains2_t::createMooreMachine( )
 /// creating Moore machine as describe
@@ -376,18 +465,14 @@ void MarkovChains2_t::createMooreMachine( )
   cerr << endl;
   #endif
 
-  nAllWords_m = hashFnUL(order_m+2);
-
-  int nModels = modelIds_m.size();
-  MALLOC(counts_m, double**, nModels * sizeof(double*));
-  MALLOC(log10cProb_m, double**, nModels * sizeof(double*));
-
-  for ( int i = 0; i < nModels; ++i )
+  if ( order_m < 0 )
   {
-    CALLOC(counts_m[i], double*, nAllWords_m * sizeof(double));
-    MALLOC(log10cProb_m[i], double*, nAllWords_m * sizeof(double));
+    cerr << "Error in MarkovChains2_t::createMooreMachine(): negative order " << order_m << endl;
+    exit(1);
   }
 
+  nAllWords_m = hashFnUL(order_m+2);
+
   //-- setting up tr_m
   MALLOC(tr_m, int**, nAllWords_m * sizeof(int*));
 
@@ -744,6 +829,170 @@ double MarkovChains2_t::log10probIUPAC( const char *frag, int fragLen, int model
   return meanLog10prob / n;
 }
 
+//------------------------------------------------- expandedPaths -----------
+/// cost of scoring frag with one model: returns the number of paths
+/// log10probIUPAC() follows, i.e. the product of the numbers of bases of
+/// the ambiguity codes of frag (1 for an ACGT sequence), or HUGE_VAL if
+/// frag contains a character that is neither a base nor an ambiguity
+/// code. nAmbCodes is set to the number of ambiguity codes and nKmers to
+/// the number of k-mers log10probSkipAmb() can score
+double MarkovChains2_t::expandedPaths( const char *frag, int fragLen, int *nAmbCodes, int *nKmers ) const
+{
+  double paths = 1;
+  int nAmb = 0;
+  int nScored = 0;
+  int run = 0; // number of ACGT bases ending at k
+  int rank = order_m + 1;
+
+  for ( int k = 0; k < fragLen; ++k )
+  {
+    if ( intACGTLookup[int(frag[k])] > -1 )
+    {
+      if ( ++run > rank )
+	nScored++;
+      continue;
+    }
+
+    run = 0;
+    switch ( frag[k] )
+    {
+      case 'R': case 'Y': case 'S': case 'W': case 'K': case 'M':
+	paths *= 2;
+	break;
+      case 'B': case 'D': case 'H': case 'V':
+	paths *= 3;
+	break;
+      case 'N':
+	paths *= 4;
+	break;
+      default:
+	paths = HUGE_VAL;
+	nAmb--;
+    }
+    nAmb++;
+  }
+
+  *nAmbCodes = nAmb;
+  *nKmers    = nScored;
+
+  return paths;
+}
+
+//---------------------------------------------- log10probSkipAmb -----------
+/// degraded but linear time version of log10probIUPAC() for reads whose
+/// ambiguity codes would expand to too many paths: the chain is restarted
+/// after each non-ACGT character and only the k-mers made of ACGT bases
+/// are scored. Their sum is scaled to the number of k-mers log10prob()
+/// scores, so that normLog10probSkipAmb() is comparable with the taxon
+/// thresholds; returns 1 if no k-mer can be scored. For an ACGT sequence
+/// the value is that of log10prob()
+double MarkovChains2_t::log10probSkipAmb( const char *frag, int fragLen, int modelIdx )
+{
+  double log10probVal = 0;
+  int nScored = 0;
+  int run = 0;
+  int v = 0, i;
+  int rank = order_m + 1;
+
+  for ( int k = 0; k < fragLen; ++k )
+  {
+    if ( (i=intACGTLookup[int(frag[k])]) < 0 )
+    {
+      run = 0;
+      continue;
+    }
+
+    if ( run++ == 0 )
+    {
+      v = i + 1;
+      continue;
+    }
+
+    v = tr_m[v][i];
+    if ( run > rank )
+    {
+      log10probVal += log10cProb_m[modelIdx][v];
+      nScored++;
+    }
+  }
+
+  if ( !nScored )
+    return 1; // log10 of probability has to be <= 0, so returned value 1 means error
+
+  return log10probVal * (fragLen - rank) / nScored;
+}
+
+//--------------------------------------------------- kmerIndices -----------
+/// writes to idx the k-mer indices (states of the Moore machine) of the
+/// positions of frag scored by log10prob(), so that frag can be scored
+/// with any number of models by log10probKmers() without walking the
+/// transition table again; idx has to have room for fragLen indices.
+/// Returns the number of indices, or -1 if frag contains a non-ACGT
+/// character (such reads are scored by log10prob() itself)
+int MarkovChains2_t::kmerIndices( const char *frag, int fragLen, int *idx ) const
+{
+  int k, v = 0, i, n = 0;
+  int rank = order_m + 1;
+
+  for ( k = 0; k < fragLen; ++k )
+  {
+    if ( (i=intACGTLookup[int(frag[k])]) < 0 )
+      return -1;
+
+    if ( k == 0 )
+      v = i + 1;
+    else
+      v = tr_m[v][i];
+
+    if ( k >= rank )
+      idx[n++] = v;
+  }
+
+  return n;
+}
+
+//--------------------------------------------------- kmerIndices -----------
+/// kmerIndices() of a frag given by the codes of its bases (0,1,2,3 for
+/// A,C,G,T as intACGTLookup[], negative otherwise), as written by
+/// seqReader_t together with the sequence, so that no character lookup
+/// is needed
+int MarkovChains2_t::kmerIndices( const signed char *codes, int fragLen, int *idx ) const
+{
+  int k, v = 0, i, n = 0;
+  int rank = order_m + 1;
+
+  for ( k = 0; k < fragLen; ++k )
+  {
+    if ( (i=codes[k]) < 0 )
+      return -1;
+
+    if ( k == 0 )
+      v = i + 1;
+    else
+      v = tr_m[v][i];
+
+    if ( k >= rank )
+      idx[n++] = v;
+  }
+
+  return n;
+}
+
+//------------------------------------------------ log10probKmers -----------
+/// log10 probability of the read whose k-mer indices idx were computed by
+/// kmerIndices() given the modelIdx-th model; the terms are added in the
+/// order of log10prob(), which gives the same value
+double MarkovChains2_t::log10probKmers( const int *idx, int n, int modelIdx ) const
+{
+  const double *lp = log10cProb_m[modelIdx];
+  double log10probVal = 0;
+
+  for ( int j = 0; j < n; ++j )
+    log10probVal += lp[ idx[j] ];
+
+  return log10probVal;
+}
+
 // ---------------------------------------------------- log10prob -----------
 /// computes a Markov Chains estimate of log10 probability that frag
 /// comes from i-th model, where i=modelIdx
@@ -802,6 +1051,55 @@ double MarkovChains2_t::log10prob( const char *frag, int fragLen, int modelIdx )
   return log10probVal;
 }
 
+// ---------------------------------------------------- log10probLowOrder -----------
+/// computes a log10 probability that frag comes from the modelIdx-th model
+/// using its conditional probabilities of the given order <= order_m
+///
+/// The lower order tables are read together with the full order one, so
+/// the estimate is a cheap approximation of log10prob(); k-mers containing
+/// a non-ACGT base are skipped. Returns the number of k-mers used in n.
+double MarkovChains2_t::log10probLowOrder( const char *frag, int fragLen, int modelIdx,
+					   int order, int *n )
+{
+  if ( order > order_m )
+    order = order_m;
+
+  int wordLen = order + 1;
+  int offset = hashUL_m[order];  // hash of the first word of length wordLen
+  int high = 1;                  // weight of the last base of a word
+  for ( int j = 1; j < wordLen; j++ )
+    high *= 4;
+
+  double log10probVal = 0;
+  int v = 0;    // hash of the last wordLen bases without the offset
+  int run = 0;  // number of consecutive ACGT bases ending at k
+  int nWords = 0;
+  const double *cProb = log10cProb_m[modelIdx];
+
+  for ( int k = 0; k < fragLen; k++ )
+  {
+    int i = intACGTLookup[int(frag[k])];
+    if ( i < 0 )
+    {
+      run = 0;
+      v = 0;
+      continue;
+    }
+
+    v = v / 4 + i * high;
+    if ( ++run >= wordLen )
+    {
+      log10probVal += cProb[ offset + v ];
+      nWords++;
+    }
+  }
+
+  if ( n )
+    *n = nWords;
+
+  return log10probVal;
+}
+
 // ---------------------------------------------------- log10probVect -----------
 
 /// computes conditional probabilities at each position of the sequence given the
@@ -1061,9 +1359,10 @@ void MarkovChains2_t::wordCounts( int kIdx,
   int seqLen;
   vector<int> idxs;
 
-  FILE *fp = fOpen(file, "r");
+  seqReader_t reader( file );
+  reader.copySeqs( true ); // words are cut out of seq in place
 
-  while ( getNextFastaRecord( fp, id, seq, seqLen) )
+  while ( reader.next( id, seq, seqLen ) )
   {
     int nWords = seqLen - wordLen + 1;
     for ( int j = 0; j < nWords; ++j )
@@ -1088,9 +1387,6 @@ void MarkovChains2_t::wordCounts( int kIdx,
 
       word[wordLen] = c;
     }
-
-    free(id);
-    free(seq);
   }
 
   if ( pseudoCountType_m == zeroOffset1 )
@@ -1177,8 +1473,6 @@ void MarkovChains2_t::wordCounts( int kIdx,
       }
     }
   }
-
-  fclose(fp);
 }
 
 //------------------------------------------------------ wordCountsR ----
@@ -1196,9 +1490,10 @@ void MarkovChains2_t::wordCountsR( int kIdx,
   char *id, *seq;
   int seqLen;
 
-  FILE *fp = fOpen(file, "r");
+  seqReader_t reader( file );
+  reader.copySeqs( true ); // words are cut out of seq in place
 
-  while ( getNextFastaRecord( fp, id, seq, seqLen) )
+  while ( reader.next( id, seq, seqLen ) )
   {
     int nWords = seqLen - wordLen + 1;
 
@@ -1241,9 +1536,6 @@ void MarkovChains2_t::wordCountsR( int kIdx,
 
       word[wordLen] = c;
     }
-
-    free(id);
-    free(seq);
   }
 
   int lL = hashUL_m[wordLen-1];
@@ -1333,9 +1625,6 @@ void MarkovChains2_t::wordCountsR( int kIdx,
       }
     }
   }
-
-
-  fclose(fp);
 }
 
 
@@ -1354,17 +1643,16 @@ void MarkovChains2_t::wordCountsR( int kIdx,
   char *id, *seq;
   int seqLen;
 
-  FILE *fp = fOpen(file, "r");
+  seqReader_t reader( file );
+  reader.copySeqs( true ); // words are cut out of seq in place
 
-  while ( getNextFastaRecord( fp, id, seq, seqLen) )
+  while ( reader.next( id, seq, seqLen ) )
   {
     if ( !foundSeq && strcmp(id, seqID)==0 )
     {
       STRDUP(seq_m, seq);
       seqLen_m = seqLen;
       foundSeq = true;
-      free(id);
-      free(seq);
       //fprintf(stderr, "in wordCountsR() seq_m: %s\n", seq_m);
       //fprintf(stderr, "\nFound %s in wordCountsR()\tfile=%s\tmodelIdx=%d\n", seqID, file, modelIdx);
       continue;
@@ -1411,9 +1699,6 @@ void MarkovChains2_t::wordCountsR( int kIdx,
 
       word[wordLen] = c;
     }
-
-    free(id);
-    free(seq);
   }
 
   int lL = hashUL_m[wordLen-1];
@@ -1503,9 +1788,6 @@ void MarkovChains2_t::wordCountsR( int kIdx,
       }
     }
   }
-
-
-  fclose(fp);
 }
 
 //------------------------------------------------- printWordCountsTbl ----
@@ -115,23 +115,40 @@ public:
 		   int maxNumAmbCodes=5,
 		   int pseudoCountType=zeroOffset4mk );
 
+  MarkovChains2_t( int order,                      // models of a model bundle (see ModelBundle.hh) of order >= order;
+		   const vector<const char *> &modelIds, // log10cProbs - its nModels x nWords table, used in place;
+		   const double *log10cProbs,          // it has to outlive the object
+		   int nWords,
+		   int maxNumAmbCodes=5 );
+
   ~MarkovChains2_t();
 
   double log10prob( const char *frag, int fragLen, int modelIdx );      // version for processing sequences without IUPAC ambiguous codes
   double log10probIUPAC( const char *frag, int fragLen, int modelIdx ); // version accepting IUPAC codes
   double log10probR( char *frag, int fragLen, int modelIdx );           // old (restart) version of log10prob()
   int log10probVect( const char *frag, int fragLen, int modelIdx, double *probs ); // computes conditional probabilities at each position of the sequence given the modelIdx-th model
+  double log10probLowOrder( const char *frag, int fragLen, int modelIdx, int order, int *n=NULL ); // log10prob() estimate from the model's order <= order_m conditional probabilities
+  double log10probSkipAmb( const char *frag, int fragLen, int modelIdx ); // log10prob() estimate from the k-mers without ambiguity codes only; linear in fragLen
+  double expandedPaths( const char *frag, int fragLen, int *nAmbCodes, int *nKmers ) const; // number of paths log10probIUPAC() follows for frag
+  int kmerIndices( const char *frag, int fragLen, int *idx ) const;   // k-mer indices of the positions of an ACGT frag scored by log10prob()
+  int kmerIndices( const signed char *codes, int fragLen, int *idx ) const; // kmerIndices() of a frag given by its base codes (see seqReader_t::codes())
+  double log10probKmers( const int *idx, int n, int modelIdx ) const; // log10prob() from the k-mer indices of kmerIndices()
 
   // normalized versions of the above routines where the output from the above functions is divided by the sequence length
   inline double normLog10prob( const char *frag, int fragLen, int modelIdx );
   inline double normLog10probIUPAC( const char *frag, int fragLen, int modelIdx );
   inline double normLog10probR( char *frag, int fragLen, int modelIdx );
+  inline double normLog10probSkipAmb( const char *frag, int fragLen, int modelIdx );
 
   inline const vector<char *> & modelIds();
   inline void modelIds( vector<string> &v);
   inline const vector<vector<char *> > & wordStrgs() const;
   inline void printCounts();
   inline int order();
+  int maxNumAmbCodes() const { return maxNumAmbCodes_m; }
+  const double *log10cProbs( int modelIdx ) const { return log10cProb_m[modelIdx]; } /// log10 conditional probabilities of the modelIdx-th model indexed by k-mer index
+  int nWords() const { return nAllWords_m; } /// number of log10 conditional probabilities of each model
+  void kmerRange( int &lo, int &hi ) const { lo = hashUL_m[order_m]; hi = hashUL_m[order_m+1]; } /// [lo, hi) contains all indices written by kmerIndices()
 
   void sample( const char *faFile, const char *txFile, int sampleSize, int seqLen=534 ); /// random samples from MC models
   void sample( char ***_seqTbl, int modelIdx, int sampleSize, int seqLen=534 );
@@ -140,6 +157,8 @@ public:
 
   void printCounts( bool x ) { printCounts_m = x; }
 
+  unsigned long long fingerprint( unsigned long long h ); /// continues the FNV-1a hash h over the order, model ids and conditional probabilities
+
 private:
   inline int hashFn(const char *s, int sLen); /// ACGT string hash function
   void hashFnIUPAC(const char *s, int sLen, vector<int> &v);/// ACGT string hash function accepting IUPAC codes
@@ -149,6 +168,7 @@ private:
   bool readModelIds();
   void createModelIds();
   void createMooreMachine();
+  void allocTables();
   void getKmers(int k);
 
   void wordCounts( int kIdx, const char *file, int modelIdx );
@@ -202,6 +222,8 @@ private:
   vector<int> Hcode_m;
   vector<int> Vcode_m;
   vector<int> Ncode_m;
+
+  bool mapped_m;              /// if true, the rows of log10cProb_m point into a model bundle and are not freed
 };
 
 //-------------------- inlines -------------------------------
@@ -266,6 +288,11 @@ inline double MarkovChains2_t::normLog10probR( char *frag, int fragLen, int mode
   return log10probR( frag, fragLen, modelIdx ) / fragLen;
 }
 
+inline double MarkovChains2_t::normLog10probSkipAmb( const char *frag, int fragLen, int modelIdx )
+{
+  return log10probSkipAmb( frag, fragLen, modelIdx ) / fragLen;
+}
+
 inline int MarkovChains2_t::order()
 {
   return order_m;
@@ -0,0 +1,381 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ModelBundle.hh"
+#include "CUtilities.h"
+#include "IOCUtilities.h"
+
+//----------------------------------------------------- modelBundle_t ----
+modelBundle_t::modelBundle_t( const char *file )
+  : file_m(file), map_m(NULL), size_m(0)
+{
+  int fd = open(file, O_RDONLY);
+  struct stat st;
+  if ( fd < 0 || fstat(fd, &st) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot open %s: %s\n", __FILE__, __LINE__, file, strerror(errno));
+    exit(1);
+  }
+  size_m = st.st_size;
+
+  if ( size_m < sizeof(mcbHeader_t) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is not a model bundle\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  map_m = (char *)mmap(NULL, size_m, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if ( map_m == MAP_FAILED )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot map %s: %s\n", __FILE__, __LINE__, file, strerror(errno));
+    exit(1);
+  }
+
+  const mcbHeader_t *hdr = (const mcbHeader_t *)map_m;
+  if ( memcmp(hdr->magic, MCB_MAGIC, 8) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is not a model bundle\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  if ( hdr->version != MCB_VERSION || hdr->byteOrder != MCB_BYTE_ORDER )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is a version %u bundle of byte order %08x; only version %d of byte order %08x can be read\n",
+	    __FILE__, __LINE__, file, hdr->version, hdr->byteOrder, MCB_VERSION, MCB_BYTE_ORDER);
+    exit(1);
+  }
+
+  nSections_m = hdr->nSections;
+  size_t tocSize = (size_t)nSections_m * sizeof(mcbSection_t);
+  if ( hdr->fileSize != size_m || sizeof(mcbHeader_t) + tocSize > size_m )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is truncated\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  toc_m = (const mcbSection_t *)(map_m + sizeof(mcbHeader_t));
+  if ( fnv1a(toc_m, tocSize, FNV1A_INIT) != hdr->tocChecksum )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: the section table of %s is corrupted\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  for ( int i = 0; i < nSections_m; i++ )
+  {
+    const mcbSection_t &s = toc_m[i];
+    if ( s.offset % MCB_ALIGN || s.offset > size_m || s.size > size_m - s.offset )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: section %.16s of %s is out of bounds\n", __FILE__, __LINE__, s.name, file);
+      exit(1);
+    }
+
+    if ( strncmp(s.name, "log10cProb", sizeof(s.name)) != 0 &&
+	 fnv1a(map_m + s.offset, s.size, FNV1A_INIT) != s.checksum )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: section %.16s of %s is corrupted\n", __FILE__, __LINE__, s.name, file);
+      exit(1);
+    }
+  }
+
+  meta_m = (const mcbMeta_t *)(map_m + section("meta", sizeof(mcbMeta_t))->offset);
+  int nModels = meta_m->nModels;
+
+  strings( section("modelIds", 0), nModels, modelIds_m );
+
+  const mcbSection_t *s = section("log10cProb", (size_t)nModels * meta_m->nWords * sizeof(double));
+  log10cProb_m = (const double *)(map_m + s->offset);
+  madvise(map_m + s->offset, s->size, MADV_WILLNEED); // starts reading it in
+
+  errIndex_m = (const mcbErrTbl_t *)(map_m + section("errIndex", nModels * sizeof(mcbErrTbl_t))->offset);
+  s = section("errTbls", 0);
+  errTbls_m = map_m + s->offset;
+  for ( int i = 0; i < nModels; i++ )
+    if ( errIndex_m[i].nrow < 0 ||
+	 errIndex_m[i].offset + 3 * errIndex_m[i].nrow * sizeof(double) > s->size )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: the error table of %s in %s is out of bounds\n",
+	      __FILE__, __LINE__, modelIds_m[i], file);
+      exit(1);
+    }
+
+  strings( section("thldIds", 0), meta_m->nThlds, thldIds_m );
+  thlds_m = (const double *)(map_m + section("thlds", meta_m->nThlds * sizeof(double))->offset);
+
+  s = section("tree", 1);
+  tree_m = map_m + s->offset;
+  if ( tree_m[s->size - 1] )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: the tree of %s is not terminated\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+}
+
+//---------------------------------------------------- ~modelBundle_t ----
+modelBundle_t::~modelBundle_t()
+{
+  if ( map_m )
+    munmap(map_m, size_m);
+}
+
+//---------------------------------------------------------- isBundle ----
+bool modelBundle_t::isBundle( const char *path )
+{
+  struct stat st;
+  if ( stat(path, &st) != 0 || !S_ISREG(st.st_mode) )
+    return false;
+
+  FILE *in = fopen(path, "r");
+  if ( !in )
+    return false;
+
+  char magic[8];
+  bool ok = fread(magic, 1, 8, in) == 8 && memcmp(magic, MCB_MAGIC, 8) == 0;
+  fclose(in);
+
+  return ok;
+}
+
+//------------------------------------------------------------ verify ----
+bool modelBundle_t::verify() const
+{
+  for ( int i = 0; i < nSections_m; i++ )
+    if ( fnv1a(map_m + toc_m[i].offset, toc_m[i].size, FNV1A_INIT) != toc_m[i].checksum )
+      return false;
+
+  return true;
+}
+
+//------------------------------------------------------------ errTbl ----
+errTbl_t * modelBundle_t::errTbl( int i ) const
+{
+  int nrow = (int)errIndex_m[i].nrow;
+  if ( !nrow )
+    return NULL;
+
+  const double *rows = (const double *)(errTbls_m + errIndex_m[i].offset);
+
+  errTbl_t *errObj = new errTbl_t;
+  MALLOC(errObj->errTbl, double**, nrow * sizeof(double*));
+  for ( int j = 0; j < nrow; j++ )
+    errObj->errTbl[j] = (double *)rows + 2 * j;
+
+  errObj->nrow = nrow;
+  errObj->thld = rows[0];
+  errObj->x    = (double *)rows + 2 * nrow;
+  errObj->xmax = rows[2 * (nrow - 1)];
+
+  errObj->nCells    = 0;
+  errObj->cellScale = 0;
+  errObj->cells     = NULL;
+
+  return errObj;
+}
+
+//----------------------------------------------------------- section ----
+/// the section with the given name, which has to be at least minSize bytes
+const mcbSection_t * modelBundle_t::section( const char *name, size_t minSize ) const
+{
+  for ( int i = 0; i < nSections_m; i++ )
+    if ( strncmp(toc_m[i].name, name, sizeof(toc_m[i].name)) == 0 )
+    {
+      if ( toc_m[i].size < minSize )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: section %s of %s is too short\n", __FILE__, __LINE__, name, file_m.c_str());
+	exit(1);
+      }
+      return &toc_m[i];
+    }
+
+  fprintf(stderr, "ERROR in %s at line %d: %s has no %s section\n", __FILE__, __LINE__, file_m.c_str(), name);
+  exit(1);
+}
+
+//----------------------------------------------------------- strings ----
+/// the n '\0' terminated strings of section s
+void modelBundle_t::strings( const mcbSection_t *s, int n, vector<const char *> &v ) const
+{
+  const char *p = map_m + s->offset;
+  const char *end = p + s->size;
+
+  for ( int i = 0; i < n; i++ )
+  {
+    const char *e = p < end ? (const char *)memchr(p, '\0', end - p) : NULL;
+    if ( !e )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: section %.16s of %s has fewer than %d strings\n",
+	      __FILE__, __LINE__, s->name, file_m.c_str(), n);
+      exit(1);
+    }
+    v.push_back(p);
+    p = e + 1;
+  }
+}
+
+//=================================================== writeModelBundle ====
+// section of a bundle being written: the concatenation of parts
+typedef struct
+{
+  const char *name;
+  vector<const void *> parts;
+  vector<size_t> lens;
+} mcbPart_t;
+
+static void addPart( mcbPart_t &s, const void *data, size_t len )
+{
+  s.parts.push_back(data);
+  s.lens.push_back(len);
+}
+
+//-------------------------------------------------- writeModelBundle ----
+/// the bundle is written to <file>.tmp, which is then renamed to file
+void writeModelBundle( const char *file, MarkovChains2_t *probModel,
+		       const vector<errTbl_t *> &errTbls,
+		       const vector<string> &thldIds, const vector<double> &thlds,
+		       const string &tree )
+{
+  const vector<char *> &modelIds = probModel->modelIds();
+  int nModels = modelIds.size();
+  int nThlds  = thldIds.size();
+
+  mcbMeta_t meta;
+  meta.order   = probModel->order();
+  meta.nModels = nModels;
+  meta.nWords  = probModel->nWords();
+  meta.nThlds  = nThlds;
+
+  vector<mcbPart_t> sections(8);
+  const char *names[] = { "meta", "modelIds", "log10cProb", "errIndex", "errTbls", "thldIds", "thlds", "tree" };
+  for ( int i = 0; i < 8; i++ )
+    sections[i].name = names[i];
+
+  addPart( sections[0], &meta, sizeof(meta) );
+
+  for ( int i = 0; i < nModels; i++ )
+  {
+    addPart( sections[1], modelIds[i], strlen(modelIds[i]) + 1 );
+    addPart( sections[2], probModel->log10cProbs(i), meta.nWords * sizeof(double) );
+  }
+
+  // the rows of the error tables and their x columns are copied out of
+  // the row pointers of readErrTbl()
+  vector<mcbErrTbl_t> errIndex(nModels);
+  vector<vector<double> > errData(nModels);
+  uint64_t offset = 0;
+  for ( int i = 0; i < nModels; i++ )
+  {
+    errTbl_t *e = i < (int)errTbls.size() ? errTbls[i] : NULL;
+    errIndex[i].offset = offset;
+    errIndex[i].nrow   = e ? e->nrow : 0;
+    if ( !e )
+      continue;
+
+    for ( int j = 0; j < e->nrow; j++ )
+    {
+      errData[i].push_back( e->errTbl[j][0] );
+      errData[i].push_back( e->errTbl[j][1] );
+    }
+    for ( int j = 0; j < e->nrow; j++ )
+      errData[i].push_back( e->x[j] );
+
+    addPart( sections[4], &errData[i][0], errData[i].size() * sizeof(double) );
+    offset += errData[i].size() * sizeof(double);
+  }
+  addPart( sections[3], &errIndex[0], nModels * sizeof(mcbErrTbl_t) );
+
+  for ( int i = 0; i < nThlds; i++ )
+    addPart( sections[5], thldIds[i].c_str(), thldIds[i].size() + 1 );
+  if ( nThlds )
+    addPart( sections[6], &thlds[0], nThlds * sizeof(double) );
+
+  addPart( sections[7], tree.c_str(), tree.size() + 1 );
+
+  // layout and checksums
+  int nSections = sections.size();
+  vector<mcbSection_t> toc(nSections);
+  uint64_t pos = sizeof(mcbHeader_t) + nSections * sizeof(mcbSection_t);
+  for ( int i = 0; i < nSections; i++ )
+  {
+    mcbSection_t &t = toc[i];
+    memset(&t, 0, sizeof(t));
+    strncpy(t.name, sections[i].name, sizeof(t.name));
+
+    pos = ( (pos + MCB_ALIGN - 1) / MCB_ALIGN ) * MCB_ALIGN;
+    t.offset   = pos;
+    t.checksum = FNV1A_INIT;
+    for ( int j = 0; j < (int)sections[i].parts.size(); j++ )
+    {
+      t.size    += sections[i].lens[j];
+      t.checksum = fnv1a( sections[i].parts[j], sections[i].lens[j], t.checksum );
+    }
+    pos += t.size;
+  }
+
+  mcbHeader_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, MCB_MAGIC, 8);
+  hdr.version     = MCB_VERSION;
+  hdr.byteOrder   = MCB_BYTE_ORDER;
+  hdr.nSections   = nSections;
+  hdr.fileSize    = pos;
+  hdr.tocChecksum = fnv1a( &toc[0], nSections * sizeof(mcbSection_t), FNV1A_INIT );
+
+  string tmpFile = string(file) + string(".tmp");
+  FILE *out = fOpen(tmpFile.c_str(), "w");
+
+  fwrite(&hdr, sizeof(hdr), 1, out);
+  fwrite(&toc[0], sizeof(mcbSection_t), nSections, out);
+
+  static const char zeros[MCB_ALIGN] = { 0 };
+  uint64_t written = sizeof(mcbHeader_t) + nSections * sizeof(mcbSection_t);
+  for ( int i = 0; i < nSections; i++ )
+  {
+    fwrite(zeros, 1, toc[i].offset - written, out);
+    for ( int j = 0; j < (int)sections[i].parts.size(); j++ )
+      fwrite(sections[i].parts[j], 1, sections[i].lens[j], out);
+    written = toc[i].offset + toc[i].size;
+  }
+
+  if ( fflush(out) != 0 || ferror(out) || fsync(fileno(out)) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write %s: %s\n", __FILE__, __LINE__, tmpFile.c_str(), strerror(errno));
+    exit(1);
+  }
+  fclose(out);
+
+  if ( rename(tmpFile.c_str(), file) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot rename %s to %s: %s\n",
+	    __FILE__, __LINE__, tmpFile.c_str(), file, strerror(errno));
+    exit(1);
+  }
+}
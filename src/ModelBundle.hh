@@ -0,0 +1,168 @@
+#ifndef MODELBUNDLE_HH
+#define MODELBUNDLE_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "DecisionTree.hh"
+#include "MarkovChains2.hh"
+
+using namespace std;
+
+//============================================== model bundle file ====
+/// Single file binary copy of an MC models directory (.mcb)
+///
+/// The file starts with a 64 byte header
+///
+///   "MCBUNDLE"       magic
+///   uint32 version   MCB_VERSION
+///   uint32 byteOrder MCB_BYTE_ORDER as written; files are read only on
+///                    machines of the same byte order
+///   uint32 nSections
+///   uint32 reserved
+///   uint64 fileSize
+///   uint64 tocChecksum  FNV-1a hash of the section table
+///
+/// followed by the section table of nSections mcbSection_t records and
+/// the sections, each starting at a multiple of MCB_ALIGN bytes, so that
+/// the tables can be used in place from a read-only shared mapping
+///
+///   meta        mcbMeta_t
+///   modelIds    nModels '\0' terminated model ids (modelIds.txt)
+///   log10cProb  nModels x nWords doubles; the log10 conditional
+///               probabilities of all k-mers of length 1..order+1 of each
+///               model, as held by MarkovChains2_t (MC<k>.log10cProb)
+///   errIndex    nModels mcbErrTbl_t records; nrow is 0 for models
+///               without an error table
+///   errTbls     for each error table nrow (x, error) rows followed by
+///               the nrow values of x (<model>_error.txt)
+///   thldIds     nThlds '\0' terminated taxon names, and
+///   thlds       their nThlds thresholds (ncProbThlds.txt)
+///   tree        '\0' terminated Newick string (refTx.tree)
+///
+/// Each section carries the FNV-1a hash of its bytes.
+///
+#define MCB_MAGIC      "MCBUNDLE"
+#define MCB_VERSION    1
+#define MCB_BYTE_ORDER 0x01020304
+#define MCB_ALIGN      4096
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t nSections;
+  uint32_t reserved;
+  uint64_t fileSize;
+  uint64_t tocChecksum;
+  char pad[24];
+} mcbHeader_t;
+
+typedef struct
+{
+  char name[16];
+  uint64_t offset;   /// from the start of the file
+  uint64_t size;     /// in bytes
+  uint64_t checksum; /// FNV-1a hash of the section's bytes
+  uint64_t reserved;
+} mcbSection_t;
+
+typedef struct
+{
+  int32_t order;     /// order of the Markov chains
+  int32_t nModels;
+  int32_t nWords;    /// number of log10cProb values of each model
+  int32_t nThlds;
+} mcbMeta_t;
+
+typedef struct
+{
+  uint64_t offset;   /// of the table in the errTbls section
+  int64_t nrow;
+} mcbErrTbl_t;
+
+//============================================== modelBundle_t ====
+/// Read-only memory mapping of a model bundle
+///
+/// The file is checked (magic, version, byte order, size and section
+/// bounds) and the checksums of all sections but log10cProb, the only
+/// large one, are verified when it is opened; verify() checks all of
+/// them. Tables returned by the accessors point into the mapping and are
+/// valid as long as the bundle is; as the mapping is shared, processes
+/// using the same bundle share its pages in the page cache.
+///
+class modelBundle_t
+{
+public:
+  modelBundle_t( const char *file );
+  ~modelBundle_t();
+
+  static bool isBundle( const char *path ); /// true if path is a regular file starting with MCB_MAGIC
+  bool verify() const;                      /// true if the checksums of all sections match
+
+  int order() const { return meta_m->order; }
+  int nModels() const { return meta_m->nModels; }
+  int nWords() const { return meta_m->nWords; }
+  const vector<const char *> & modelIds() const { return modelIds_m; }
+  const double *log10cProbs() const { return log10cProb_m; } /// nModels() x nWords() table
+  errTbl_t *errTbl( int i ) const;          /// error table of the i-th model using the mapped rows; NULL if there is none
+  int nThlds() const { return meta_m->nThlds; }
+  const char *thldId( int i ) const { return thldIds_m[i]; }
+  double thld( int i ) const { return thlds_m[i]; }
+  const char *tree() const { return tree_m; }
+  const char *file() const { return file_m.c_str(); }
+
+private:
+  const mcbSection_t *section( const char *name, size_t minSize ) const;
+  void strings( const mcbSection_t *s, int n, vector<const char *> &v ) const;
+
+  string file_m;
+  char *map_m;
+  size_t size_m;
+  const mcbSection_t *toc_m;
+  int nSections_m;
+  const mcbMeta_t *meta_m;
+  vector<const char *> modelIds_m;
+  const double *log10cProb_m;
+  const mcbErrTbl_t *errIndex_m;
+  const char *errTbls_m;
+  vector<const char *> thldIds_m;
+  const double *thlds_m;
+  const char *tree_m;
+};
+
+/// writes the models of probModel with their error tables (errTbls[i] of
+/// the i-th model, NULL if it has none), the thresholds of ncProbThlds.txt
+/// and the Newick string of the reference tree to a bundle file
+void writeModelBundle( const char *file, MarkovChains2_t *probModel,
+		       const vector<errTbl_t *> &errTbls,
+		       const vector<string> &thldIds, const vector<double> &thlds,
+		       const string &tree );
+
+#endif
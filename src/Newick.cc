@@ -38,7 +38,7 @@ using namespace std;
 
 //--------------------------------------------- NewickNode_t() -----
 NewickNode_t::NewickNode_t(NewickNode_t * parent)
-  : parent_m(parent)
+  : parent_m(parent), model_idx(-1)
 {
   #if DEBUG
   fprintf(stderr,"in NewickTree_t(parent)\t(parent==NULL)=%d\n",(int)(parent==NULL));
@@ -412,6 +412,17 @@ void NewickTree_t::rmNodesWith1child()
 
 //--------------------------------------------- loadTree -----
 bool NewickTree_t::loadTree(const char *file)
+{
+  FILE * fp = fOpen(file, "r");
+  bool ok = loadTree(fp, file);
+  fclose(fp);
+
+  return ok;
+}
+
+//--------------------------------------------- loadTree -----
+/// reads the tree from fp; file is its name used in error messages
+bool NewickTree_t::loadTree(FILE *fp, const char *file)
 {
   #define DEBUGLT 0
 
@@ -419,8 +430,6 @@ bool NewickTree_t::loadTree(const char *file)
   fprintf(stderr, "in NewickTree_t::loadTree()\n");
   #endif
 
-  FILE * fp = fOpen(file, "r");
-
   char str[256];
   NewickNode_t * cur = new NewickNode_t();
   int LINE = 1;
@@ -72,6 +72,7 @@ public:
   ~NewickTree_t();
 
   bool loadTree(const char *file);
+  bool loadTree(FILE *fp, const char *file);
   void loadFullTxTree(const char *file);
 
   void rmNodesWith1child();
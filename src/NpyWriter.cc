@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "NpyWriter.hh"
+#include "IOCUtilities.h"
+
+#define NPY_HEADER_LEN 128 // magic, version, header length and the padded dictionary
+
+//------------------------------------------------------- npyWriter_t ----
+npyWriter_t::npyWriter_t( const char *file, int nCols )
+  : out_m(NULL), file_m(file), nCols_m(nCols), nRows_m(0)
+{
+  out_m = fOpen(file, "w");
+  writeHeader();
+}
+
+//------------------------------------------------------ ~npyWriter_t ----
+npyWriter_t::~npyWriter_t()
+{
+  close();
+}
+
+//------------------------------------------------------- writeHeader ----
+/// writes the header of an nRows_m x nCols_m float32 matrix in C order; the dictionary is padded with spaces to NPY_HEADER_LEN
+/// bytes, which leaves room for any number of rows
+void npyWriter_t::writeHeader()
+{
+  char header[NPY_HEADER_LEN];
+  memset(header, ' ', NPY_HEADER_LEN);
+
+  memcpy(header, "\x93NUMPY\x01\x00", 8);
+  int dictLen = NPY_HEADER_LEN - 10;
+  header[8] = dictLen & 0xff;
+  header[9] = dictLen >> 8;
+
+  unsigned short one = 1;
+  const char *descr = *(unsigned char*)&one ? "<f4" : ">f4"; // floats are written in the host's byte order
+
+  char dict[NPY_HEADER_LEN];
+  int n = snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (%ld, %d), }",
+		   descr, nRows_m, nCols_m);
+  memcpy(header + 10, dict, n);
+  header[NPY_HEADER_LEN - 1] = '\n';
+
+  if ( fwrite(header, 1, NPY_HEADER_LEN, out_m) != NPY_HEADER_LEN )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write to %s\n", __FILE__, __LINE__, file_m.c_str());
+    exit(1);
+  }
+}
+
+//--------------------------------------------------------------- add ----
+void npyWriter_t::add( const float *row )
+{
+  if ( fwrite(row, sizeof(float), nCols_m, out_m) != (size_t)nCols_m )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write to %s\n", __FILE__, __LINE__, file_m.c_str());
+    exit(1);
+  }
+  nRows_m++;
+}
+
+//------------------------------------------------------------- close ----
+void npyWriter_t::close()
+{
+  if ( !out_m )
+    return;
+
+  rewind(out_m);
+  writeHeader();
+
+  if ( fclose(out_m) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write to %s\n", __FILE__, __LINE__, file_m.c_str());
+    exit(1);
+  }
+  out_m = NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef NPYWRITER_HH
+#define NPYWRITER_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+//============================================== npyWriter_t ====
+/// Writer of a float32 matrix in the NumPy .npy format (version 1.0)
+///
+/// Rows are appended one at a time, so the number of rows is not known
+/// until the writer is closed; the header is written with room for any
+/// row count and its shape is filled in by close(). The file can be read
+/// with numpy.load() or memory-mapped with numpy.load(file, mmap_mode='r').
+///
+/// Parameters:
+/// file  - output file
+/// nCols - number of columns of the matrix
+///
+class npyWriter_t
+{
+public:
+  npyWriter_t( const char *file, int nCols );
+  ~npyWriter_t();
+
+  void add( const float *row );  /// appends a row of nCols values
+  void close();                  /// writes the final shape and closes the file
+
+  long nRows() const { return nRows_m; }
+
+private:
+  void writeHeader();
+
+  FILE *out_m;
+  string file_m;
+  int nCols_m;
+  long nRows_m;
+};
+
+#endif
@@ -0,0 +1,240 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "PrimerTrim.hh"
+
+//------------------------------------------------------------- baseSet ----
+/// set of the bases A=1, C=2, G=4, T=8 an IUPAC code stands for; 0 if c is
+/// not a nucleotide code
+static int baseSet( char c )
+{
+  switch ( c )
+  {
+    case 'A': case 'a': return 1;
+    case 'C': case 'c': return 2;
+    case 'G': case 'g': return 4;
+    case 'T': case 't': case 'U': case 'u': return 8;
+    case 'R': case 'r': return 1|4;
+    case 'Y': case 'y': return 2|8;
+    case 'S': case 's': return 2|4;
+    case 'W': case 'w': return 1|8;
+    case 'K': case 'k': return 4|8;
+    case 'M': case 'm': return 1|2;
+    case 'B': case 'b': return 2|4|8;
+    case 'D': case 'd': return 1|4|8;
+    case 'H': case 'h': return 1|2|8;
+    case 'V': case 'v': return 1|2|4;
+    case 'N': case 'n': return 1|2|4|8;
+  }
+  return 0;
+}
+
+//---------------------------------------------------------- complement ----
+/// complement of an IUPAC code
+static char complement( char c )
+{
+  const char *from = "ACGTURYSWKMBDHVN";
+  const char *to   = "TGCAAYRSWMKVHDBN";
+  const char *p = strchr(from, toupper(c));
+  return p ? to[p - from] : 'N';
+}
+
+//--------------------------------------------------- primerTrimmer_t ----
+primerTrimmer_t::primerTrimmer_t( const char *fwd, const char *rev, int maxErr, int offset )
+  : nPrimers_m(0), hasFwd_m(fwd && *fwd), hasRev_m(rev && *rev)
+{
+  if ( hasFwd_m )
+  {
+    string p(fwd), c(fwd);
+    for ( int i = 0; i < (int)c.size(); i++ )
+      c[i] = complement(c[i]);
+
+    compile( p, maxErr, offset, fwd_m );
+    compile( c, maxErr, offset, fwdTail_m );
+    nPrimers_m++;
+  }
+
+  if ( hasRev_m )
+  {
+    string p(rev), c(rev);
+    for ( int i = 0; i < (int)c.size(); i++ )
+      c[i] = complement(c[i]);
+
+    compile( p, maxErr, offset, rev_m );
+    compile( c, maxErr, offset, revTail_m );
+    nPrimers_m++;
+  }
+}
+
+//----------------------------------------------------------- compile ----
+void primerTrimmer_t::compile( const string &p, int maxErr, int offset, pattern_t &pat )
+{
+  pat.len = p.size();
+  if ( pat.len < 1 || pat.len > 64 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: primer %s has to have 1 to 64 bases\n",
+	    __FILE__, __LINE__, p.c_str());
+    exit(1);
+  }
+
+  memset(pat.peq, 0, sizeof(pat.peq));
+  for ( int i = 0; i < pat.len; i++ )
+  {
+    int s = baseSet( p[i] );
+    if ( !s )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %c of primer %s is not an IUPAC nucleotide code\n",
+	      __FILE__, __LINE__, p[i], p.c_str());
+      exit(1);
+    }
+
+    for ( int c = 0; c < 256; c++ )
+      if ( baseSet( (char)c ) & s )
+	pat.peq[c] |= 1ULL << i;
+  }
+
+  pat.high   = 1ULL << (pat.len - 1);
+  pat.maxErr = maxErr < 0 ? pat.len / 10 : maxErr;
+  pat.window = offset + pat.len + pat.maxErr;
+}
+
+//------------------------------------------------------------ search ----
+/// finds the best match of pat within the first (or, if fromEnd, the
+/// last) pat.window bases of seq; returns the number of bases from that
+/// end of seq to the end of the match, -1 if there is no match with at
+/// most pat.maxErr edits. If fromEnd, the bases are read backwards, so
+/// pat has to be given reversed.
+///
+/// Myers' algorithm keeps a column of the edit distance matrix of pat
+/// against the bases read so far as bit vectors of its vertical deltas;
+/// the distance of the whole pattern is updated from the top bit. The
+/// match can start anywhere, so the top row is left at 0. An equally good
+/// end right after the best one is preferred, as it is the same match with
+/// a mismatch instead of a deletion at the last primer base.
+int primerTrimmer_t::search( const pattern_t &pat, const char *seq, int seqLen, bool fromEnd ) const
+{
+  int n = seqLen < pat.window ? seqLen : pat.window;
+
+  uint64_t Pv = ~0ULL, Mv = 0;
+  int score = pat.len;
+  int best = pat.maxErr + 1, bestEnd = -1;
+
+  for ( int j = 0; j < n; j++ )
+  {
+    unsigned char c = fromEnd ? seq[seqLen - 1 - j] : seq[j];
+    uint64_t Eq = pat.peq[c];
+    uint64_t Xv = Eq | Mv;
+    uint64_t Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+    uint64_t Ph = Mv | ~(Xh | Pv);
+    uint64_t Mh = Pv & Xh;
+
+    if ( Ph & pat.high )
+      score++;
+    else if ( Mh & pat.high )
+      score--;
+
+    Ph <<= 1;
+    Mh <<= 1;
+    Pv = Mh | ~(Xv | Ph);
+    Mv = Ph & Xv;
+
+    if ( score < best || (score == best && j == bestEnd) )
+    {
+      best = score;
+      bestEnd = j + 1;
+    }
+  }
+
+  return bestEnd;
+}
+
+//---------------------------------------------------------- trimEnds ----
+/// searches for head at the start and tail at the end of seq; start and
+/// end are set to the trimmed read's bounds; returns the number of
+/// primers found
+int primerTrimmer_t::trimEnds( const pattern_t *head, const pattern_t *tail,
+			       const char *seq, int seqLen, int &start, int &end ) const
+{
+  int found = 0;
+  start = 0;
+  end = seqLen;
+
+  if ( head )
+  {
+    int n = search( *head, seq, seqLen, false );
+    if ( n >= 0 )
+    {
+      start = n;
+      found++;
+    }
+  }
+
+  if ( tail )
+  {
+    int n = search( *tail, seq, seqLen, true );
+    if ( n >= 0 )
+    {
+      end = seqLen - n;
+      found++;
+    }
+  }
+
+  if ( end <= start ) // the primers overlap; nothing would be left
+    return 0;
+
+  return found;
+}
+
+//-------------------------------------------------------------- trim ----
+int primerTrimmer_t::trim( char *&seq, int &seqLen ) const
+{
+  int start, end;
+  int found = trimEnds( hasFwd_m ? &fwd_m : NULL, hasRev_m ? &revTail_m : NULL,
+			seq, seqLen, start, end );
+
+  if ( found < nPrimers_m ) // maybe the read is in the reverse orientation
+  {
+    int rcStart, rcEnd;
+    int rcFound = trimEnds( hasRev_m ? &rev_m : NULL, hasFwd_m ? &fwdTail_m : NULL,
+			    seq, seqLen, rcStart, rcEnd );
+    if ( rcFound > found )
+    {
+      found = rcFound;
+      start = rcStart;
+      end = rcEnd;
+    }
+  }
+
+  if ( found )
+  {
+    seq += start;
+    seqLen = end - start;
+  }
+
+  return found;
+}
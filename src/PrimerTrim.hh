@@ -0,0 +1,88 @@
+#ifndef PRIMERTRIM_HH
+#define PRIMERTRIM_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+//============================================== primerTrimmer_t ====
+/// Removes PCR primers (and whatever precedes them) from the ends of reads
+///
+/// A read in the forward orientation starts with the forward primer and
+/// ends with the reverse complement of the reverse primer; a read in the
+/// reverse orientation starts with the reverse primer and ends with the
+/// reverse complement of the forward one. The primers are searched for
+/// within the first and last offset + length + maxErr bases of the read
+/// with Myers' bit-parallel approximate string matching (edit distance at
+/// most maxErr), where a degenerate IUPAC position of a primer matches
+/// any of its bases and an ambiguous base of the read matches any primer
+/// base it may stand for.
+///
+/// trim() only moves the start and shortens the length of the read, so
+/// it works on reads that are views into a read-only input buffer.
+///
+/// Parameters:
+/// fwd, rev - primers 5' to 3'; either can be NULL; at most 64 bases each
+/// maxErr   - max edit distance of a match; if < 0, a tenth of the
+///            primer's length
+/// offset   - max number of bases (adapters, barcodes) preceding a primer
+///
+class primerTrimmer_t
+{
+public:
+  primerTrimmer_t( const char *fwd, const char *rev, int maxErr=-1, int offset=30 );
+
+  /// trims seq of length seqLen in place; returns the number of primers
+  /// found and removed: 0 (read left as is), 1 or 2
+  int trim( char *&seq, int &seqLen ) const;
+
+  int nPrimers() const { return nPrimers_m; }
+
+private:
+  struct pattern_t
+  {
+    uint64_t peq[256];  /// peq[c] - bit i is set if the read base c matches position i of the pattern
+    uint64_t high;      /// bit of the last position of the pattern
+    int len;
+    int maxErr;
+    int window;         /// number of bases of the read that are searched
+  };
+
+  void compile( const string &p, int maxErr, int offset, pattern_t &pat );
+  int search( const pattern_t &pat, const char *seq, int seqLen, bool fromEnd ) const;
+  int trimEnds( const pattern_t *head, const pattern_t *tail,
+		const char *seq, int seqLen, int &start, int &end ) const;
+
+  int nPrimers_m;
+  bool hasFwd_m, hasRev_m;
+  pattern_t fwd_m;      /// forward primer; searched at the start of forward reads
+  pattern_t rev_m;      /// reverse primer; searched at the start of reverse reads
+  pattern_t fwdTail_m;  /// complement of the forward primer; searched backwards from the end of reverse reads
+  pattern_t revTail_m;  /// complement of the reverse primer; searched backwards from the end of forward reads
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include "ReadMargins.hh"
+#include "IOCUtilities.h"
+#include "GzStream.hh"
+
+//----------------------------------------------------- readMargins_t ----
+readMargins_t::readMargins_t( const char *file, const decisionTree_t &dt, int gzLevel )
+  : out_m(NULL), dt_m(dt)
+{
+  out_m = gzLevel > 0 ? gzWriteOpen(file, "w", gzLevel) : fOpen(file, "w");
+  fprintf(out_m, "read\tdepth\tbest\tscore\tsecond\tscore2\tmargin\tpass\n");
+}
+
+//---------------------------------------------------- ~readMargins_t ----
+readMargins_t::~readMargins_t()
+{
+  if ( out_m )
+    fclose(out_m);
+}
@@ -0,0 +1,91 @@
+#ifndef READMARGINS_HH
+#define READMARGINS_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+
+#include "DecisionTree.hh"
+
+using namespace std;
+
+//============================================== readMargins_t ====
+/// Per-level best and second best children of the classification walk
+///
+/// For each read and each internal node visited by the walk the margins
+/// file gets one tab separated row
+///
+///   <read id> <depth> <best> <score> <second> <score2> <margin> <pass>
+///
+/// where best and second are the children with the highest and the
+/// second highest normalized log10 probability (score and score2) of the
+/// read, margin = score - score2 and pass is 0 if best failed its error
+/// threshold and the walk stopped at the parent. If the node has only one
+/// child, second, score2 and margin are NA.
+///
+/// The rows are built from the scores the walk has already computed, so
+/// the file gives the close calls of a run without a second scoring pass
+/// as with --print-nc-probs.
+///
+/// If gzLevel > 0 the file is gzip compressed at that level (see
+/// GzStream.hh).
+///
+class readMargins_t
+{
+public:
+  readMargins_t( const char *file, const decisionTree_t &dt, int gzLevel=0 );
+  ~readMargins_t();
+
+  inline void level( const char *id, int firstChild, const double *x,
+		     int numChildren, int imax, bool pass );
+
+private:
+  FILE *out_m;
+  const decisionTree_t &dt_m;
+};
+
+//-------------------- inlines -------------------------------
+inline void readMargins_t::level( const char *id, int firstChild, const double *x,
+				  int numChildren, int imax, bool pass )
+{
+  const dtNode_t &best = dt_m[firstChild + imax];
+
+  int i2 = -1;
+  for ( int i = 0; i < numChildren; i++ )
+    if ( i != imax && ( i2 < 0 || x[i] > x[i2] ) )
+      i2 = i;
+
+  if ( i2 < 0 )
+  {
+    fprintf(out_m, "%s\t%d\t%s\t%f\tNA\tNA\tNA\t%d\n", id, best.depth,
+	    best.label, x[imax], (int)pass);
+    return;
+  }
+
+  fprintf(out_m, "%s\t%d\t%s\t%f\t%s\t%f\t%f\t%d\n", id, best.depth,
+	  best.label, x[imax], dt_m[firstChild + i2].label, x[i2],
+	  x[imax] - x[i2], (int)pass);
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ReadTrace.hh"
+#include "IOCUtilities.h"
+#include "GzStream.hh"
+#include "CUtilities.h"
+
+//------------------------------------------------------- readTrace_t ----
+/// taxa is a comma separated list of node labels; if NULL or empty all
+/// reads are traced
+readTrace_t::readTrace_t( const char *file, const decisionTree_t &dt, const char *taxa, int gzLevel )
+  : out_m(NULL), dt_m(dt), all_m(true), hit_m(false), id_m(NULL)
+{
+  selected_m.assign( dt.size(), 0 );
+
+  if ( taxa && *taxa )
+  {
+    all_m = false;
+
+    char *list;
+    STRDUP(list, taxa);
+
+    char *saveptr;
+    for ( char *tx = strtok_r(list, ",", &saveptr); tx; tx = strtok_r(NULL, ",", &saveptr) )
+    {
+      int node = dt.findLabel( tx );
+      if ( node < 0 )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: --trace-taxa: %s is not a node of the reference tree\n",
+		__FILE__, __LINE__, tx);
+	exit(1);
+      }
+      selected_m[node] = 1;
+    }
+
+    free(list);
+  }
+
+  out_m = gzLevel > 0 ? gzWriteOpen(file, "w", gzLevel) : fOpen(file, "w");
+  fprintf(out_m, "# S\tread\tdepth\tparent\ttaxon\tscore\tthld\tbest\n");
+  fprintf(out_m, "# R\tread\tdepth\ttaxon\terr\n");
+}
+
+//------------------------------------------------------ ~readTrace_t ----
+readTrace_t::~readTrace_t()
+{
+  if ( out_m )
+    fclose(out_m);
+}
+
+//--------------------------------------------------------------- end ----
+/// writes the buffered steps and the final node of the current read
+void readTrace_t::end( int node, double err )
+{
+  if ( selected_m[node] )
+    hit_m = true;
+
+  if ( !hit_m )
+    return;
+
+  int n = steps_m.size();
+  for ( int i = 0; i < n; i++ )
+  {
+    const dtNode_t &child = dt_m[ steps_m[i].child ];
+
+    fprintf(out_m, "S\t%s\t%d\t%s\t%s\t%f\t", id_m, child.depth,
+	    dt_m[child.parent].label, child.label, steps_m[i].score);
+
+    if ( isinf(child.thld) )
+      fprintf(out_m, "NA");
+    else
+      fprintf(out_m, "%f", child.thld);
+
+    fprintf(out_m, "\t%d\n", (int)steps_m[i].best);
+  }
+
+  fprintf(out_m, "R\t%s\t%d\t%s\t%.4f\n", id_m, dt_m[node].depth, dt_m[node].label, err);
+}
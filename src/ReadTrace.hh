@@ -0,0 +1,106 @@
+#ifndef READTRACE_HH
+#define READTRACE_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "DecisionTree.hh"
+
+using namespace std;
+
+//============================================== readTrace_t ====
+/// Per-read trace of the classification walk
+///
+/// For each traced read the trace file gets one 'S' (step) row for each
+/// model evaluated during the walk and one 'R' (result) row:
+///
+///   S <read id> <depth> <parent> <taxon> <score> <thld> <best>
+///   R <read id> <depth> <taxon> <err>
+///
+/// where score is the normalized log10 probability of the read given
+/// taxon's model, thld is the taxon's error threshold (NA if there is
+/// none) and best is 1 for the child with the highest score. Columns are
+/// tab separated.
+///
+/// If a list of taxa is given, only the reads for which at least one of
+/// them was evaluated or assigned are written; the steps of a read are
+/// buffered until its result is known.
+///
+/// The walk calls the trace only through a readTrace_t pointer that is
+/// NULL when tracing is off, so a disabled trace costs one predictable
+/// branch per call site.
+///
+/// If gzLevel > 0 the file is gzip compressed at that level (see
+/// GzStream.hh).
+///
+class readTrace_t
+{
+public:
+  readTrace_t( const char *file, const decisionTree_t &dt, const char *taxa=NULL, int gzLevel=0 );
+  ~readTrace_t();
+
+  inline void begin( const char *id );
+  inline void step( int child, double score, bool best );
+  void end( int node, double err );
+
+private:
+  struct step_t
+  {
+    int child;
+    double score;
+    bool best;
+  };
+
+  FILE *out_m;
+  const decisionTree_t &dt_m;
+  vector<char> selected_m;       /// selected_m[i] is 1 if the i-th node is to be traced
+  bool all_m;                    /// true if all reads are traced
+  bool hit_m;                    /// true if the current read touched a selected node
+  const char *id_m;              /// id of the current read
+  vector<step_t> steps_m;        /// buffered steps of the current read
+};
+
+//-------------------- inlines -------------------------------
+inline void readTrace_t::begin( const char *id )
+{
+  id_m  = id;
+  hit_m = all_m;
+  steps_m.clear();
+}
+
+inline void readTrace_t::step( int child, double score, bool best )
+{
+  step_t s;
+  s.child = child;
+  s.score = score;
+  s.best  = best;
+  steps_m.push_back(s);
+
+  if ( selected_m[child] )
+    hit_m = true;
+}
+
+#endif
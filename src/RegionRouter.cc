@@ -0,0 +1,169 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "RegionRouter.hh"
+#include "CUtilities.h"
+#include "IOCUtilities.h"
+#include "CppUtilities.hh"
+#include "DNAsequence.hh"
+
+//---------------------------------------------------- regionRouter_t ----
+regionRouter_t::regionRouter_t( int order )
+  : order_m(order), nWords_m(1)
+{
+  for ( int j = 0; j <= order_m; j++ )
+    nWords_m *= 4;
+}
+
+//--------------------------------------------------- ~regionRouter_t ----
+regionRouter_t::~regionRouter_t()
+{
+  for ( int i = 0; i < (int)cProb_m.size(); i++ )
+    free(cProb_m[i]);
+}
+
+//--------------------------------------------------------------- add ----
+int regionRouter_t::add( const char *name, const char *mcDir )
+{
+  char file[4096];
+  snprintf(file, sizeof(file), "%s/MC%d.log10cProb", mcDir, order_m);
+  FILE *in = fOpen(file, "r");
+
+  size_t alloc = 1024*1024;
+  char *line;
+  MALLOC(line, char*, alloc * sizeof(char));
+
+  // the header lists the k-mers; the table of each model is on its own line
+  if ( !ReadLine(in, line, alloc) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is empty\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  double *sum; // sums of the models' conditional probabilities
+  MALLOC(sum, double*, nWords_m * sizeof(double));
+  for ( int i = 0; i < nWords_m; i++ )
+    sum[i] = 0;
+
+  int nModels = 0;
+  while ( ReadLine(in, line, alloc) )
+  {
+    char *brkt;
+    char *word = strtok_r(line, "\t", &brkt); // model ID
+    if ( !word )
+      continue;
+
+    int i = 0;
+    for ( word = strtok_r(NULL, "\t", &brkt); word; word = strtok_r(NULL, "\t", &brkt), i++ )
+    {
+      if ( i == nWords_m )
+	break;
+      sum[i] += pow(10.0, strtod(word, (char **)NULL));
+    }
+
+    if ( i != nWords_m )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %s has %d instead of %d columns\n",
+	      __FILE__, __LINE__, file, i, nWords_m);
+      exit(1);
+    }
+    nModels++;
+  }
+
+  fclose(in);
+  free(line);
+
+  if ( !nModels )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s has no models\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  // the mean of conditional distributions is a conditional distribution
+  for ( int i = 0; i < nWords_m; i++ )
+    sum[i] = log10( sum[i] / nModels );
+
+  names_m.push_back( string(name) );
+  cProb_m.push_back( sum );
+
+  return (int)names_m.size() - 1;
+}
+
+//------------------------------------------------------------- score ----
+/// log10 probability of seq given the chain cProb; k-mers containing a
+/// non-ACGT base are skipped
+double regionRouter_t::score( const double *cProb, const char *seq, int seqLen ) const
+{
+  int high = nWords_m / 4; // weight of the last base of a word
+  int v = 0;               // hash of the last order_m + 1 bases
+  int run = 0;             // number of consecutive ACGT bases ending at k
+  double s = 0;
+
+  for ( int k = 0; k < seqLen; k++ )
+  {
+    int i = intACGTLookup[ (int)seq[k] ];
+    if ( i < 0 )
+    {
+      run = 0;
+      v = 0;
+      continue;
+    }
+
+    v = v / 4 + i * high;
+    if ( ++run > order_m )
+      s += cProb[v];
+  }
+
+  return s;
+}
+
+//------------------------------------------------------------- route ----
+int regionRouter_t::route( const char *seq, const char *rcseq, int seqLen ) const
+{
+  int best = 0;
+  double bestScore = -HUGE_VAL;
+
+  for ( int r = 0; r < (int)cProb_m.size(); r++ )
+  {
+    double s = score( cProb_m[r], seq, seqLen );
+    if ( rcseq )
+    {
+      double rc = score( cProb_m[r], rcseq, seqLen );
+      if ( rc > s )
+	s = rc;
+    }
+
+    if ( s > bestScore )
+    {
+      bestScore = s;
+      best = r;
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,66 @@
+#ifndef REGIONROUTER_HH
+#define REGIONROUTER_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define ROUTE_ORDER 3 // order of the region signatures
+
+//============================================== regionRouter_t ====
+/// Assignment of reads to the amplicon regions of several model sets
+///
+/// The signature of a region is a single Markov chain of order ROUTE_ORDER
+/// pooled from all models of the region's model directory: its conditional
+/// probability of a base after a k-mer is the mean of those of the models,
+/// read from <dir>/MC<order>.log10cProb. A read is routed to the region
+/// whose chain gives it the highest log10 probability. Only the small
+/// low order table of each region is read, so the full models of a region
+/// can be loaded when its first read is seen.
+///
+class regionRouter_t
+{
+public:
+  regionRouter_t( int order=ROUTE_ORDER );
+  ~regionRouter_t();
+
+  int add( const char *name, const char *mcDir ); /// reads the signature of the region; returns its index
+  int route( const char *seq, const char *rcseq, int seqLen ) const; /// index of the region of the read; rcseq may be NULL
+
+  int size() const { return (int)names_m.size(); }
+  const char *name( int i ) const { return names_m[i].c_str(); }
+
+private:
+  double score( const double *cProb, const char *seq, int seqLen ) const;
+
+  int order_m;
+  int nWords_m;                /// number of k-mers of length order_m + 1
+  vector<string> names_m;
+  vector<double *> cProb_m;    /// region => pooled log10 conditional probabilities indexed as in MarkovChains2_t
+};
+
+#endif
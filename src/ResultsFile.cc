@@ -0,0 +1,409 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "ResultsFile.hh"
+#include "IOCUtilities.h"
+
+//------------------------------------------------------ little-endian ----
+static void putU32( unsigned char *p, uint32_t x )
+{
+  p[0] = x; p[1] = x >> 8; p[2] = x >> 16; p[3] = x >> 24;
+}
+
+static uint32_t getU32( const unsigned char *p )
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//--------------------------------------------------------- floatToHalf ----
+/// IEEE 754 binary16 closest to x (round to nearest even)
+static uint16_t floatToHalf( float x )
+{
+  uint32_t f;
+  memcpy(&f, &x, 4);
+
+  uint16_t sign = (f >> 16) & 0x8000;
+  int e = (int)((f >> 23) & 0xff) - 127 + 15;
+  uint32_t m = f & 0x7fffff;
+
+  if ( ((f >> 23) & 0xff) == 0xff )             // inf or nan
+    return sign | 0x7c00 | ( m ? 0x200 : 0 );
+  if ( e >= 31 )                                // overflow
+    return sign | 0x7c00;
+  if ( e <= 0 )                                 // subnormal or zero
+  {
+    if ( e < -10 )
+      return sign;
+    m |= 0x800000;
+    int shift = 14 - e;
+    uint32_t h = m >> shift;
+    uint32_t rem = m & ((1u << shift) - 1);
+    uint32_t half = 1u << (shift - 1);
+    if ( rem > half || (rem == half && (h & 1)) )
+      h++;
+    return sign | h;
+  }
+
+  uint32_t h = (e << 10) | (m >> 13);
+  uint32_t rem = m & 0x1fff;
+  if ( rem > 0x1000 || (rem == 0x1000 && (h & 1)) )
+    h++;                                        // may carry into the exponent
+  return sign | h;
+}
+
+//--------------------------------------------------------- halfToFloat ----
+static float halfToFloat( uint16_t h )
+{
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  int e = (h >> 10) & 0x1f;
+  uint32_t m = h & 0x3ff;
+  uint32_t f;
+
+  if ( e == 0 )
+  {
+    if ( m == 0 )
+      f = sign;
+    else
+    {
+      e = 1;
+      while ( !(m & 0x400) )
+      {
+	m <<= 1;
+	e--;
+      }
+      m &= 0x3ff;
+      f = sign | ((e - 15 + 127) << 23) | (m << 13);
+    }
+  }
+  else if ( e == 31 )
+    f = sign | 0x7f800000 | (m << 13);
+  else
+    f = sign | ((e - 15 + 127) << 23) | (m << 13);
+
+  float x;
+  memcpy(&x, &f, 4);
+  return x;
+}
+
+//---------------------------------------------------- resultsWriter_t ----
+resultsWriter_t::resultsWriter_t( FILE *out, const decisionTree_t &dt, bool ids,
+				  bool half, bool append )
+  : out_m(out), flags_m(RES_FLAGS)
+{
+  int nTaxa = dt.size();
+
+  if ( ids )
+    flags_m |= RES_IDS;
+  if ( half )
+    flags_m |= RES_HALF;
+  if ( nTaxa > 0xffff )
+    flags_m |= RES_NODE32;
+
+  nodes_m.reserve(RES_BLOCK);
+  errs_m.reserve(RES_BLOCK);
+  readFlags_m.reserve(RES_BLOCK);
+
+  if ( append )
+    return;
+
+  unsigned char buf[8];
+  fwrite(RES_MAGIC, 1, 4, out_m);
+  putU32(buf, flags_m);
+  putU32(buf + 4, nTaxa);
+  fwrite(buf, 1, 8, out_m);
+
+  for ( int i = 0; i < nTaxa; i++ )
+  {
+    size_t len = strlen(dt[i].label);
+    if ( len > 0xffff )
+      len = 0xffff;
+    buf[0] = len;
+    buf[1] = len >> 8;
+    fwrite(buf, 1, 2, out_m);
+    fwrite(dt[i].label, 1, len, out_m);
+  }
+}
+
+//--------------------------------------------------- ~resultsWriter_t ----
+resultsWriter_t::~resultsWriter_t()
+{
+  flush();
+}
+
+//---------------------------------------------------------------- add ----
+void resultsWriter_t::add( const char *id, int node, double err, bool degraded )
+{
+  nodes_m.push_back( node );
+  readFlags_m.push_back( degraded ? RES_DEGRADED : 0 );
+
+  if ( flags_m & RES_HALF )
+  {
+    errs_m.push_back( (float)err );
+  }
+  else
+  {
+    // rounded as in the text format, so that the conversion to text
+    // prints the same digits
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.4f", err);
+    errs_m.push_back( strtof(buf, NULL) );
+  }
+
+  if ( flags_m & RES_IDS )
+    ids_m.append( id, strlen(id) + 1 );
+
+  if ( nodes_m.size() == RES_BLOCK )
+    flush();
+}
+
+//------------------------------------------------------- compressColumn ----
+/// compresses len bytes of data into comp
+void resultsWriter_t::compressColumn( const void *data, size_t len, vector<unsigned char> &comp )
+{
+  uLongf n = compressBound(len);
+  comp.resize(n);
+
+  if ( len && compress2(&comp[0], &n, (const Bytef *)data, len, Z_BEST_SPEED) != Z_OK )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: compress2() failed\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  comp.resize( len ? n : 0 );
+}
+
+//-------------------------------------------------------------- flush ----
+void resultsWriter_t::flush()
+{
+  uint32_t n = nodes_m.size();
+  if ( !n )
+    return;
+
+  int nodeSize = ( flags_m & RES_NODE32 ) ? 4 : 2;
+  int errSize  = ( flags_m & RES_HALF ) ? 2 : 4;
+
+  int nCols = ( flags_m & RES_FLAGS ) ? 4 : 3;
+  unsigned char head[36];
+  putU32(head, n);
+
+  // node column followed by the error column in one buffer
+  col_m.resize( n * (nodeSize + errSize) );
+  unsigned char *p = &col_m[0];
+  for ( uint32_t i = 0; i < n; i++, p += nodeSize )
+  {
+    uint32_t x = nodes_m[i];
+    p[0] = x;
+    p[1] = x >> 8;
+    if ( nodeSize == 4 )
+    {
+      p[2] = x >> 16;
+      p[3] = x >> 24;
+    }
+  }
+
+  for ( uint32_t i = 0; i < n; i++, p += errSize )
+  {
+    if ( errSize == 2 )
+    {
+      uint16_t h = floatToHalf( errs_m[i] );
+      p[0] = h;
+      p[1] = h >> 8;
+    }
+    else
+    {
+      uint32_t f;
+      memcpy(&f, &errs_m[i], 4);
+      putU32(p, f);
+    }
+  }
+
+  size_t rawLen[4] = { n * (size_t)nodeSize, n * (size_t)errSize, ids_m.size(), n };
+  const void *data[4] = { &col_m[0], &col_m[0] + rawLen[0], ids_m.data(), &readFlags_m[0] };
+
+  // the block header needs the lengths of the compressed columns
+  for ( int c = 0; c < nCols; c++ )
+  {
+    compressColumn( data[c], rawLen[c], comp_m[c] );
+    putU32(head + 4 + 4*c, rawLen[c]);
+    putU32(head + 4 + 4*nCols + 4*c, comp_m[c].size());
+  }
+
+  fwrite(head, 1, 4 + 8*nCols, out_m);
+  for ( int c = 0; c < nCols; c++ )
+    if ( comp_m[c].size() )
+      fwrite(&comp_m[c][0], 1, comp_m[c].size(), out_m);
+
+  nodes_m.clear();
+  errs_m.clear();
+  ids_m.clear();
+  readFlags_m.clear();
+}
+
+//---------------------------------------------------- resultsReader_t ----
+resultsReader_t::resultsReader_t( const char *file )
+  : file_m(file), nReads_m(0), next_m(0), idPos_m(0), index_m(0), readFlag_m(0)
+{
+  in_m = fOpen(file, "rb");
+
+  unsigned char buf[8];
+  if ( fread(buf, 1, 4, in_m) != 4 || memcmp(buf, RES_MAGIC, 4) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is not a binary results file\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  bool ok = ( fread(buf, 1, 8, in_m) == 8 );
+  flags_m = getU32(buf);
+  uint32_t nTaxa = getU32(buf + 4);
+
+  for ( uint32_t i = 0; ok && i < nTaxa; i++ )
+  {
+    ok = ( fread(buf, 1, 2, in_m) == 2 );
+    size_t len = buf[0] | (buf[1] << 8);
+    string label(len, ' ');
+    if ( ok && len )
+      ok = ( fread(&label[0], 1, len, in_m) == len );
+    taxa_m.push_back(label);
+  }
+
+  if ( !ok )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: truncated header of %s\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  headerSize_m = ftell(in_m);
+}
+
+//--------------------------------------------------- ~resultsReader_t ----
+resultsReader_t::~resultsReader_t()
+{
+  fclose(in_m);
+}
+
+//---------------------------------------------------------- readColumn ----
+void resultsReader_t::readColumn( size_t rawLen, size_t compLen, vector<unsigned char> &col )
+{
+  col.resize( rawLen + 1 );
+  comp_m.resize( compLen + 1 );
+
+  uLongf n = rawLen;
+  if ( fread(&comp_m[0], 1, compLen, in_m) != compLen ||
+       ( rawLen && ( uncompress(&col[0], &n, &comp_m[0], compLen) != Z_OK || n != rawLen ) ) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is truncated or corrupted\n", __FILE__, __LINE__, file_m.c_str());
+    exit(1);
+  }
+}
+
+//----------------------------------------------------------- readBlock ----
+/// false at the end of the file
+bool resultsReader_t::readBlock()
+{
+  size_t nCols = ( flags_m & RES_FLAGS ) ? 4 : 3;
+  size_t headLen = 4 + 8*nCols;
+  unsigned char head[36];
+  size_t n = fread(head, 1, headLen, in_m);
+  if ( n == 0 )
+    return false;
+
+  nReads_m = getU32(head);
+  size_t nodeSize = ( flags_m & RES_NODE32 ) ? 4 : 2;
+  size_t errSize  = ( flags_m & RES_HALF ) ? 2 : 4;
+  const unsigned char *compLen = head + 4 + 4*nCols;
+
+  if ( n != headLen || !nReads_m ||
+       getU32(head + 4) != nReads_m * nodeSize || getU32(head + 8) != nReads_m * errSize ||
+       ( nCols == 4 && getU32(head + 16) != nReads_m ) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is truncated or corrupted\n", __FILE__, __LINE__, file_m.c_str());
+    exit(1);
+  }
+
+  readColumn( getU32(head + 4), getU32(compLen), nodes_m );
+  readColumn( getU32(head + 8), getU32(compLen + 4), errs_m );
+  readColumn( getU32(head + 12), getU32(compLen + 8), ids_m );
+  ids_m.back() = '\0';
+  if ( nCols == 4 )
+    readColumn( getU32(head + 16), getU32(compLen + 12), readFlags_m );
+
+  next_m  = 0;
+  idPos_m = 0;
+
+  return true;
+}
+
+//---------------------------------------------------------------- next ----
+bool resultsReader_t::next( const char *&id, int &node, double &err )
+{
+  if ( next_m == nReads_m && !readBlock() )
+    return false;
+
+  uint32_t i = next_m++;
+  index_m++;
+  readFlag_m = ( flags_m & RES_FLAGS ) ? readFlags_m[i] : 0;
+
+  if ( flags_m & RES_NODE32 )
+    node = getU32( &nodes_m[4*i] );
+  else
+    node = nodes_m[2*i] | (nodes_m[2*i+1] << 8);
+
+  if ( node < 0 || node >= (int)taxa_m.size() )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is corrupted\n", __FILE__, __LINE__, file_m.c_str());
+    exit(1);
+  }
+
+  if ( flags_m & RES_HALF )
+  {
+    err = halfToFloat( errs_m[2*i] | (errs_m[2*i+1] << 8) );
+  }
+  else
+  {
+    uint32_t f = getU32( &errs_m[4*i] );
+    float x;
+    memcpy(&x, &f, 4);
+    err = x;
+  }
+
+  if ( flags_m & RES_IDS )
+  {
+    id = (const char *)&ids_m[idPos_m];
+    idPos_m += strlen(id) + 1;
+    if ( idPos_m > ids_m.size() - 1 )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %s is corrupted\n", __FILE__, __LINE__, file_m.c_str());
+      exit(1);
+    }
+  }
+  else
+  {
+    snprintf(indexStr_m, sizeof(indexStr_m), "%ld", index_m);
+    id = indexStr_m;
+  }
+
+  return true;
+}
@@ -0,0 +1,151 @@
+#ifndef RESULTSFILE_HH
+#define RESULTSFILE_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "DecisionTree.hh"
+
+using namespace std;
+
+//============================================== binary results file ====
+/// Columnar binary alternative to MC_order<k>_results.txt
+///
+/// The file starts with a header
+///
+///   "MCR1"           magic
+///   uint32 flags     RES_IDS - read ID column present; otherwise reads are
+///                    identified by their 1-based index in the file
+///                    RES_HALF - errors are float16; otherwise float32
+///                    RES_NODE32 - node ids are uint32; otherwise uint16
+///                    RES_FLAGS - per-read flag column present; bit
+///                    RES_DEGRADED marks the reads scored by the degraded
+///                    path of --read-budget
+///   uint32 nTaxa     followed by nTaxa labels, each as uint16 length and
+///                    the label's characters, in the order of the nodes
+///                    of the decision tree
+///
+/// followed by blocks of at most RES_BLOCK reads, each
+///
+///   uint32 nReads
+///   uint32 rawLen[nCols], compLen[nCols]   of the node, error, ID and,
+///                                          with RES_FLAGS, flag columns
+///   the nCols (3 or 4) columns, each zlib compressed
+///
+/// The ID column holds '\0' terminated read IDs and the flag column one
+/// uint8 per read. All integers are
+/// little-endian. float32 errors are rounded to the 4 decimals of the
+/// text format, so the text converted back is the same as the one classify
+/// writes; float16 errors keep about 3 significant digits.
+///
+/// Blocks are self-contained, so files written with the same header can
+/// be concatenated by dropping all but the first header (mergeResults).
+///
+#define RES_MAGIC  "MCR1"
+#define RES_IDS    1
+#define RES_HALF   2
+#define RES_NODE32 4
+#define RES_FLAGS  8
+#define RES_DEGRADED 1
+#define RES_BLOCK  65536
+
+//============================================== resultsWriter_t ====
+/// Writer of binary results files
+///
+/// Parameters:
+/// out    - output stream; not closed by the writer
+/// dt     - decision tree whose labels make up the taxon dictionary
+/// ids    - if false, read IDs are not stored
+/// half   - if true, errors are stored as float16
+/// append - if true, out is positioned after the blocks of an existing
+///          file written with the same parameters and the header is not
+///          written again
+///
+class resultsWriter_t
+{
+public:
+  resultsWriter_t( FILE *out, const decisionTree_t &dt, bool ids=true,
+		   bool half=false, bool append=false );
+  ~resultsWriter_t();
+
+  void add( const char *id, int node, double err, bool degraded=false );
+  void flush();                      /// writes the buffered reads as a block
+
+private:
+  void compressColumn( const void *data, size_t len, vector<unsigned char> &comp );
+
+  FILE *out_m;
+  uint32_t flags_m;
+  vector<uint32_t> nodes_m;          /// columns of the current block
+  vector<float> errs_m;
+  string ids_m;
+  vector<unsigned char> readFlags_m;
+  vector<unsigned char> col_m;       /// packed column
+  vector<unsigned char> comp_m[4];   /// compressed columns
+};
+
+//============================================== resultsReader_t ====
+/// Reader of binary results files
+class resultsReader_t
+{
+public:
+  resultsReader_t( const char *file ); /// exits if file cannot be read
+  ~resultsReader_t();
+
+  /// reads the next read's ID (or index if there are no IDs), node and
+  /// error; false at the end of the file
+  bool next( const char *&id, int &node, double &err );
+
+  const vector<string> & taxa() const { return taxa_m; }
+  const char *taxon( int node ) const { return taxa_m[node].c_str(); }
+  bool degraded() const { return readFlag_m & RES_DEGRADED; } /// true if the last read was scored by the degraded path
+  bool hasIds() const { return flags_m & RES_IDS; }
+  long headerSize() const { return headerSize_m; }
+
+private:
+  bool readBlock();
+  void readColumn( size_t rawLen, size_t compLen, vector<unsigned char> &col );
+
+  FILE *in_m;
+  string file_m;
+  uint32_t flags_m;
+  long headerSize_m;
+  vector<string> taxa_m;
+  vector<unsigned char> nodes_m;     /// columns of the current block
+  vector<unsigned char> errs_m;
+  vector<unsigned char> ids_m;
+  vector<unsigned char> readFlags_m;
+  vector<unsigned char> comp_m;
+  uint32_t nReads_m;                 /// number of reads of the current block
+  uint32_t next_m;                   /// index of the next read in the block
+  size_t idPos_m;                    /// position of the next read's ID in ids_m
+  long index_m;                      /// index of the last read in the file
+  unsigned char readFlag_m;          /// flags of the last read
+  char indexStr_m[32];
+};
+
+#endif
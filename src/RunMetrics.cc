@@ -0,0 +1,191 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "RunMetrics.hh"
+#include "IOCUtilities.h"
+
+//------------------------------------------------------ runMetrics_t ----
+runMetrics_t::runMetrics_t( const decisionTree_t &dt )
+  : modelLoad(0), treeLoad(0), errTables(0), classification(0), total(0),
+    sampleTime(0), scoring(0), output(0), reads(0), samples(0), threads(0),
+    flatEvals(0), iupacReads(0), iupacEvals(0), degradedReads(0), degradedEvals(0), dt_m(dt)
+{
+  orientation[0] = orientation[1] = 0;
+  primers[0] = primers[1] = primers[2] = 0;
+  stopDepth.assign( dt.depth() + 1, 0 );
+  nodeVisits.assign( dt.size(), 0 );
+  basesHist.assign( COST_BUCKETS, 0 );
+  ambCodesHist.assign( COST_BUCKETS, 0 );
+  pathsHist.assign( COST_BUCKETS, 0 );
+  usecHist.assign( COST_BUCKETS, 0 );
+}
+
+//------------------------------------------------------------- merge ----
+/// adds the per-read counters and times of m
+void runMetrics_t::merge( const runMetrics_t &m )
+{
+  sampleTime += m.sampleTime;
+  scoring    += m.scoring;
+  output     += m.output;
+  reads      += m.reads;
+  samples    += m.samples;
+  iupacReads += m.iupacReads;
+  iupacEvals += m.iupacEvals;
+  orientation[0] += m.orientation[0];
+  orientation[1] += m.orientation[1];
+  for ( int i = 0; i < 3; i++ )
+    primers[i] += m.primers[i];
+
+  for ( int i = 0; i < (int)stopDepth.size(); i++ )
+    stopDepth[i] += m.stopDepth[i];
+
+  for ( int i = 0; i < (int)nodeVisits.size(); i++ )
+    nodeVisits[i] += m.nodeVisits[i];
+  flatEvals += m.flatEvals;
+
+  degradedReads += m.degradedReads;
+  degradedEvals += m.degradedEvals;
+  for ( int i = 0; i < COST_BUCKETS; i++ )
+  {
+    basesHist[i]    += m.basesHist[i];
+    ambCodesHist[i] += m.ambCodesHist[i];
+    pathsHist[i]    += m.pathsHist[i];
+    usecHist[i]     += m.usecHist[i];
+  }
+}
+
+//--------------------------------------------------------- writeHist ----
+/// writes a cost histogram as a JSON array without its trailing empty buckets
+static void writeHist( FILE *out, const char *name, const vector<long> &h, bool last )
+{
+  int n = h.size();
+  while ( n > 1 && !h[n-1] )
+    n--;
+
+  fprintf(out, "    \"%s\": [", name);
+  for ( int i = 0; i < n; i++ )
+    fprintf(out, "%s%ld", i ? ", " : "", h[i]);
+  fprintf(out, "]%s\n", last ? "" : ",");
+}
+
+//--------------------------------------------------------- writeJson ----
+/// reads/s of a phase are the reads divided by the time spent in it;
+/// they are given for the phases that process reads
+void runMetrics_t::writeJson( const char *file ) const
+{
+  FILE *out = fOpen(file, "w");
+
+  double input = sampleTime - scoring - output;
+  if ( input < 0 )
+    input = 0;
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"reads\": %ld,\n", reads);
+  fprintf(out, "  \"samples\": %d,\n", samples);
+  fprintf(out, "  \"threads\": %d,\n", threads);
+
+  fprintf(out, "  \"seconds\": {\n");
+  fprintf(out, "    \"total\": %.6f,\n", total);
+  fprintf(out, "    \"modelLoad\": %.6f,\n", modelLoad);
+  fprintf(out, "    \"treeLoad\": %.6f,\n", treeLoad);
+  fprintf(out, "    \"errTables\": %.6f,\n", errTables);
+  fprintf(out, "    \"classification\": %.6f,\n", classification);
+  fprintf(out, "    \"input\": %.6f,\n", input);
+  fprintf(out, "    \"scoring\": %.6f,\n", scoring);
+  fprintf(out, "    \"output\": %.6f\n", output);
+  fprintf(out, "  },\n");
+
+  double t[] = { total, classification, input, scoring, output };
+  const char *name[] = { "overall", "classification", "input", "scoring", "output" };
+  int n = sizeof(t) / sizeof(double);
+
+  fprintf(out, "  \"readsPerSec\": {\n");
+  for ( int i = 0; i < n; i++ )
+    fprintf(out, "    \"%s\": %.1f%s\n", name[i], t[i] > 0 ? reads / t[i] : 0.0, i < n - 1 ? "," : "");
+  fprintf(out, "  },\n");
+
+  fprintf(out, "  \"stopDepth\": [");
+  for ( int i = 0; i < (int)stopDepth.size(); i++ )
+    fprintf(out, "%s%ld", i ? ", " : "", stopDepth[i]);
+  fprintf(out, "],\n");
+
+  // each child of a node is evaluated every time the node is visited
+  long evals = flatEvals;
+  int nNodes = dt_m.size();
+  for ( int i = 0; i < nNodes; i++ )
+    evals += nodeVisits[i] * dt_m[i].numChildren;
+
+  fprintf(out, "  \"modelEvals\": {\n");
+  fprintf(out, "    \"total\": %ld,\n", evals);
+  fprintf(out, "    \"flat\": %ld,\n", flatEvals);
+  fprintf(out, "    \"perNode\": {");
+  bool first = true;
+  for ( int i = 0; i < nNodes; i++ )
+  {
+    if ( i == dt_m.root() || !nodeVisits[ dt_m[i].parent ] )
+      continue;
+
+    fprintf(out, "%s\n      ", first ? "" : ",");
+    jsonString( out, dt_m[i].label );
+    fprintf(out, ": %ld", nodeVisits[ dt_m[i].parent ]);
+    first = false;
+  }
+  fprintf(out, "%s}\n", first ? "" : "\n    ");
+  fprintf(out, "  },\n");
+
+  fprintf(out, "  \"iupac\": {\n");
+  fprintf(out, "    \"reads\": %ld,\n", iupacReads);
+  fprintf(out, "    \"evals\": %ld\n", iupacEvals);
+  fprintf(out, "  },\n");
+
+  fprintf(out, "  \"orientation\": {\n");
+  fprintf(out, "    \"forward\": %ld,\n", orientation[0]);
+  fprintf(out, "    \"reverse\": %ld\n", orientation[1]);
+  fprintf(out, "  },\n");
+
+  fprintf(out, "  \"primers\": {\n");
+  fprintf(out, "    \"trimmed\": %ld,\n", primers[0]);
+  fprintf(out, "    \"partial\": %ld,\n", primers[1]);
+  fprintf(out, "    \"untrimmable\": %ld\n", primers[2]);
+  fprintf(out, "  },\n");
+
+  fprintf(out, "  \"readCost\": {\n");
+  fprintf(out, "    \"degradedReads\": %ld,\n", degradedReads);
+  fprintf(out, "    \"degradedEvals\": %ld,\n", degradedEvals);
+  writeHist( out, "bases", basesHist, false );
+  writeHist( out, "ambCodes", ambCodesHist, false );
+  writeHist( out, "paths", pathsHist, false );
+  writeHist( out, "microseconds", usecHist, true );
+  fprintf(out, "  },\n");
+
+  fprintf(out, "  \"peakRssKb\": %ld\n", ru.ru_maxrss);
+  fprintf(out, "}\n");
+
+  fclose(out);
+}
@@ -0,0 +1,116 @@
+#ifndef RUNMETRICS_HH
+#define RUNMETRICS_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <time.h>
+#include <math.h>
+#include <vector>
+
+#include "DecisionTree.hh"
+
+using namespace std;
+
+//============================================== runMetrics_t ====
+/// Throughput and walk statistics of a classify run written as JSON by
+/// --metrics
+///
+/// The times of the start-up phases are set by main(); the per-read
+/// counters and the scoring and output times are collected by
+/// classifySample() into one runMetrics_t per thread, which are then
+/// merged, as the count tables are.
+///
+class runMetrics_t
+{
+public:
+  runMetrics_t( const decisionTree_t &dt );
+
+  void merge( const runMetrics_t &m );
+  void writeJson( const char *file ) const;
+
+  // wall-clock seconds of the phases of the run
+  double modelLoad;           /// reading the MC models
+  double treeLoad;            /// reading and compiling the reference tree
+  double errTables;           /// reading the error tables and thresholds and building their grids
+  double classification;      /// classifying all samples
+  double total;               /// whole run
+
+  // summed over the samples; a sample's time outside of scoring and
+  // output is spent reading its input
+  double sampleTime;          /// classifySample() time
+  double scoring;             /// model evaluations and the walk
+  double output;              /// writing results, count tables and other per-read output
+
+  long reads;
+  int samples;
+  int threads;
+  vector<long> stopDepth;     /// stopDepth[d] - number of reads whose walk ended at depth d
+  vector<long> nodeVisits;    /// nodeVisits[i] - number of times the children of node i were scored
+  long flatEvals;             /// leaf model evaluations of --flat, which does not visit the nodes
+  long iupacReads;            /// reads with a non-ACGT base; their scores take the IUPAC path
+  long iupacEvals;            /// model evaluations of these reads
+  long orientation[2];        /// number of reads classified on the forward (0) and reverse (1) strand
+  long primers[3];            /// number of reads with all (0), some (1) and none (2) of the primers removed
+
+  // per-read cost; bucket b of a histogram counts the reads with a value
+  // in [2^(b-1), 2^b), bucket 0 those with a value < 1 (see costBucket())
+  long degradedReads;         /// reads over the --read-budget scored by log10probSkipAmb()
+  long degradedEvals;         /// model evaluations of these reads
+  vector<long> basesHist;     /// read length
+  vector<long> ambCodesHist;  /// number of ambiguity codes
+  vector<long> pathsHist;     /// paths log10probIUPAC() would follow; 1 for ACGT reads
+  vector<long> usecHist;      /// scoring time in microseconds
+
+private:
+  const decisionTree_t &dt_m;
+};
+
+//-------------------- inlines -------------------------------
+#define COST_BUCKETS 64
+
+/// histogram bucket of a per-read cost v: 0 if v < 1, otherwise b such
+/// that 2^(b-1) <= v < 2^b
+inline int costBucket( double v )
+{
+  if ( v < 1 )
+    return 0;
+
+  if ( isinf(v) )
+    return COST_BUCKETS - 1;
+
+  int e;
+  frexp(v, &e);
+
+  return e < COST_BUCKETS ? e : COST_BUCKETS - 1;
+}
+
+/// monotonic wall-clock time in seconds
+inline double monotonicTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,973 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "SeqReader.hh"
+#include "CUtilities.h"
+#include "IOCUtilities.h"
+#include "strings.hh"
+#include "DNAsequence.hh"
+
+// upper case of each character and the code of each upper case base
+static unsigned char upperTbl[256];
+static signed char codeTbl[256];
+static pthread_once_t tblOnce = PTHREAD_ONCE_INIT;
+
+static void initTbls()
+{
+  for ( int c = 0; c < 256; c++ )
+  {
+    upperTbl[c] = toupper(c);
+    codeTbl[c]  = ( c < 128 ) ? intACGTLookup[c] : -1;
+  }
+}
+
+//------------------------------------------------------- seqReader_t ----
+seqReader_t::seqReader_t( FILE *fp, const char *name, bool keepQual,
+			  size_t blockSize, int nBlocks )
+  : name_m(name)
+{
+  init( fp, keepQual, blockSize, nBlocks );
+}
+
+//------------------------------------------------------- seqReader_t ----
+seqReader_t::seqReader_t( const char *file, bool keepQual )
+  : name_m(file)
+{
+  init( fOpen(file, "r"), keepQual, 1024*1024, 4 );
+  ownFp_m = true;
+}
+
+//--------------------------------------------------------------- init ----
+void seqReader_t::init( FILE *fp, bool keepQual, size_t blockSize, int nBlocks )
+{
+  pthread_once(&tblOnce, initTbls);
+
+  fp_m          = fp;
+  ownFp_m       = false;
+  keepQual_m    = keepQual;
+  blockSize_m   = blockSize;
+  threaded_m    = false;
+  done_m        = false;
+  stop_m        = false;
+  gzip_m        = false;
+  formatKnown_m = false;
+  bytesRead_m   = 0;
+  inBuf_m       = NULL;
+  inBufSize_m   = 256*1024;
+  streamEnd_m   = false;
+  failed_m      = false;
+  map_m         = NULL;
+  mapLen_m      = 0;
+  cur_m         = -1;
+  pos_m         = NULL;
+  end_m         = NULL;
+  pending_m     = EOF;
+  blockBase_m   = 0;
+  started_m     = false;
+  fastq_m       = false;
+  copySeqs_m    = false;
+  encode_m      = false;
+  idAlloc_m     = 1024;
+  seqAlloc_m    = 64*1024;
+  qualAlloc_m   = 64*1024;
+  codesAlloc_m  = 64*1024;
+
+  MALLOC(id_m, char*, idAlloc_m * sizeof(char));
+  MALLOC(seq_m, char*, seqAlloc_m * sizeof(char));
+  MALLOC(qual_m, char*, qualAlloc_m * sizeof(char));
+  MALLOC(codes_m, signed char*, codesAlloc_m * sizeof(signed char));
+  qual_m[0] = '\0';
+
+  memset(&zs_m, 0, sizeof(zs_m));
+
+  pthread_mutex_init(&lock_m, NULL);
+  pthread_cond_init(&filledCond_m, NULL);
+  pthread_cond_init(&freeCond_m, NULL);
+
+  if ( mapFile() )
+    return;
+
+  if ( nBlocks < 2 )
+    nBlocks = 2;
+
+  blocks_m.resize(nBlocks);
+  for ( int i = 0; i < nBlocks; i++ )
+  {
+    MALLOC(blocks_m[i].data, char*, blockSize_m * sizeof(char));
+    blocks_m[i].len = 0;
+    free_m.push_back(i);
+  }
+
+  MALLOC(inBuf_m, char*, inBufSize_m * sizeof(char));
+
+  if ( pthread_create(&thread_m, NULL, run, this) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot create thread\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  threaded_m = true;
+}
+
+//------------------------------------------------------------ mapFile ----
+/// maps the input if it is an uncompressed regular file; parsing starts
+/// at the current position of fp_m
+bool seqReader_t::mapFile()
+{
+  int fd = fileno(fp_m);
+  off_t offset = ftello(fp_m);
+  struct stat st;
+
+  if ( fd < 0 || offset < 0 || fstat(fd, &st) != 0 ||
+       !S_ISREG(st.st_mode) || st.st_size <= offset )
+    return false;
+
+  unsigned char magic[2];
+  if ( pread(fd, magic, 2, offset) == 2 && magic[0] == 0x1f && magic[1] == 0x8b )
+    return false;
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if ( map == MAP_FAILED )
+    return false;
+
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  map_m    = (char *)map;
+  mapLen_m = st.st_size;
+  pos_m    = map_m + offset;
+  end_m    = map_m + mapLen_m;
+
+  done_m        = true;
+  formatKnown_m = true;
+
+  return true;
+}
+
+//------------------------------------------------------ ~seqReader_t ----
+seqReader_t::~seqReader_t()
+{
+  if ( threaded_m )
+  {
+    pthread_mutex_lock(&lock_m);
+    stop_m = true;
+    pthread_cond_broadcast(&freeCond_m);
+    pthread_mutex_unlock(&lock_m);
+
+    pthread_join(thread_m, NULL);
+  }
+
+  if ( map_m )
+    munmap(map_m, mapLen_m);
+
+  if ( gzip_m )
+    inflateEnd(&zs_m);
+
+  pthread_mutex_destroy(&lock_m);
+  pthread_cond_destroy(&filledCond_m);
+  pthread_cond_destroy(&freeCond_m);
+
+  int n = blocks_m.size();
+  for ( int i = 0; i < n; i++ )
+    free(blocks_m[i].data);
+
+  if ( inBuf_m )
+    free(inBuf_m);
+  free(id_m);
+  free(seq_m);
+  free(qual_m);
+  free(codes_m);
+
+  if ( ownFp_m )
+    fclose(fp_m);
+}
+
+//---------------------------------------------------------------- run ----
+void *seqReader_t::run( void *arg )
+{
+  ((seqReader_t *)arg)->produce();
+  return NULL;
+}
+
+//------------------------------------------------------------ produce ----
+/// body of the reading thread: fills free blocks with (inflated) input
+/// until the end of the input, an error or stop_m
+void seqReader_t::produce()
+{
+  // the first bytes tell if the input is gzip compressed; they are kept in
+  // inBuf_m and passed either to inflate() or, as they are, to the first block
+  size_t n = fread(inBuf_m, 1, inBufSize_m, fp_m);
+  bool gzip = ( n >= 2 && (unsigned char)inBuf_m[0] == 0x1f && (unsigned char)inBuf_m[1] == 0x8b );
+
+  zs_m.next_in  = (Bytef *)inBuf_m;
+  zs_m.avail_in = n;
+
+  if ( gzip && inflateInit2(&zs_m, 15 + 32) != Z_OK )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: inflateInit2() failed\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  pthread_mutex_lock(&lock_m);
+  gzip_m = gzip;
+  formatKnown_m = true;
+  bytesRead_m += n;
+  pthread_cond_broadcast(&filledCond_m);
+  pthread_mutex_unlock(&lock_m);
+
+  while ( 1 )
+  {
+    pthread_mutex_lock(&lock_m);
+    while ( free_m.empty() && !stop_m )
+      pthread_cond_wait(&freeCond_m, &lock_m);
+
+    if ( stop_m )
+    {
+      pthread_mutex_unlock(&lock_m);
+      break;
+    }
+
+    int i = free_m.front();
+    free_m.pop_front();
+    pthread_mutex_unlock(&lock_m);
+
+    size_t len = fill( blocks_m[i].data, blockSize_m );
+
+    pthread_mutex_lock(&lock_m);
+    blocks_m[i].len = len;
+    if ( len )
+      filled_m.push_back(i);
+    else
+    {
+      free_m.push_back(i);
+      done_m = true;
+    }
+    pthread_cond_signal(&filledCond_m);
+    pthread_mutex_unlock(&lock_m);
+
+    if ( !len )
+      break;
+  }
+}
+
+//--------------------------------------------------------------- fill ----
+/// writes to buf up to size bytes of the (inflated) input; returns the
+/// number of bytes written, 0 at the end of the input or after an error
+size_t seqReader_t::fill( char *buf, size_t size )
+{
+  if ( failed_m )
+    return 0;
+
+  size_t n = 0;
+
+  if ( !gzip_m )
+  {
+    if ( zs_m.avail_in ) // bytes read while checking for gzip
+    {
+      n = zs_m.avail_in < size ? zs_m.avail_in : size;
+      memcpy(buf, zs_m.next_in, n);
+      zs_m.next_in  += n;
+      zs_m.avail_in -= n;
+    }
+
+    if ( n < size )
+    {
+      size_t m = fread(buf + n, 1, size - n, fp_m);
+      n += m;
+
+      pthread_mutex_lock(&lock_m);
+      bytesRead_m += m;
+      pthread_mutex_unlock(&lock_m);
+    }
+
+    if ( !n && ferror(fp_m) )
+    {
+      setError( string("cannot read ") + name_m + string(": ") + string(strerror(errno)) );
+      failed_m = true;
+    }
+
+    return n;
+  }
+
+  zs_m.next_out  = (Bytef *)buf;
+  zs_m.avail_out = size;
+
+  while ( zs_m.avail_out )
+  {
+    if ( !zs_m.avail_in )
+    {
+      size_t m = fread(inBuf_m, 1, inBufSize_m, fp_m);
+
+      pthread_mutex_lock(&lock_m);
+      bytesRead_m += m;
+      pthread_mutex_unlock(&lock_m);
+
+      if ( !m )
+      {
+	if ( ferror(fp_m) )
+	  setError( string("cannot read ") + name_m + string(": ") + string(strerror(errno)) );
+	else if ( !streamEnd_m )
+	  setError( string("unexpected end of gzip data in ") + name_m );
+	failed_m = true;
+	break;
+      }
+
+      zs_m.next_in  = (Bytef *)inBuf_m;
+      zs_m.avail_in = m;
+    }
+
+    if ( streamEnd_m ) // another gzip member follows
+    {
+      inflateReset(&zs_m);
+      streamEnd_m = false;
+    }
+
+    int ret = inflate(&zs_m, Z_NO_FLUSH);
+    if ( ret == Z_STREAM_END )
+    {
+      streamEnd_m = true;
+    }
+    else if ( ret != Z_OK && ret != Z_BUF_ERROR )
+    {
+      setError( string("corrupt gzip data in ") + name_m +
+		( zs_m.msg ? string(": ") + string(zs_m.msg) : string("") ) );
+      failed_m = true;
+      break;
+    }
+  }
+
+  return size - zs_m.avail_out;
+}
+
+//----------------------------------------------------------- setError ----
+void seqReader_t::setError( const string &msg )
+{
+  pthread_mutex_lock(&lock_m);
+  if ( !error_m.size() )
+    error_m = msg;
+  pthread_mutex_unlock(&lock_m);
+}
+
+//-------------------------------------------------------------- error ----
+const char * seqReader_t::error()
+{
+  pthread_mutex_lock(&lock_m);
+  const char *e = error_m.size() ? error_m.c_str() : NULL;
+  pthread_mutex_unlock(&lock_m);
+
+  return e;
+}
+
+//------------------------------------------------------------- isGzip ----
+bool seqReader_t::isGzip()
+{
+  pthread_mutex_lock(&lock_m);
+  while ( !formatKnown_m )
+    pthread_cond_wait(&filledCond_m, &lock_m);
+  bool gzip = gzip_m;
+  pthread_mutex_unlock(&lock_m);
+
+  return gzip;
+}
+
+//---------------------------------------------------------- bytesRead ----
+long long seqReader_t::bytesRead()
+{
+  if ( map_m )
+    return pos_m - map_m;
+
+  pthread_mutex_lock(&lock_m);
+  long long n = bytesRead_m;
+  pthread_mutex_unlock(&lock_m);
+
+  return n;
+}
+
+//------------------------------------------------------------- offset ----
+/// returns the offset of the next record, or of the end of the input,
+/// in the decompressed input; of a mapped file, it is the offset in the
+/// file
+long long seqReader_t::offset() const
+{
+  long long off = blockBase_m;
+
+  if ( map_m )
+    off = pos_m - map_m;
+  else if ( cur_m >= 0 )
+    off += pos_m - blocks_m[cur_m].data;
+
+  if ( pending_m != EOF ) // the first character of the next record has been read
+    off--;
+
+  return off;
+}
+
+//--------------------------------------------------------------- seek ----
+/// moves the parsing position of a mapped input to the given offset in
+/// the file, which has to be the offset() of a record of a previous
+/// reader of the same file; returns false if the input is not mapped or
+/// the offset is past its end
+bool seqReader_t::seek( long long offset )
+{
+  if ( !map_m || offset < 0 || offset > (long long)mapLen_m )
+    return false;
+
+  pos_m     = map_m + offset;
+  pending_m = EOF;
+
+  return true;
+}
+
+//-------------------------------------------------------------- shard ----
+/// Splits a mapped input into n byte ranges of equal size and restricts
+/// the reader to the records starting in the i-th of them. Each range is
+/// moved forward to the next record boundary - a line starting with
+/// '>' or, in a FASTQ file, a line starting with '@' followed two lines
+/// later by a line starting with '+' - so the shards of the n readers
+/// tile the input and every record is read by exactly one of them.
+/// Returns false if the input is not mapped.
+bool seqReader_t::shard( int i, int n )
+{
+  if ( !map_m )
+    return false;
+
+  const char *p = map_m;
+  while ( p < map_m + mapLen_m && isspace(*p) )
+    p++;
+  bool fastq = ( p < map_m + mapLen_m && *p == '@' );
+
+  long long len = mapLen_m;
+  pos_m = recordStart( len * i / n, fastq );
+  end_m = recordStart( len * (i + 1) / n, fastq );
+
+  return true;
+}
+
+//-------------------------------------------------------- recordStart ----
+/// returns the first record boundary at or after offset of the mapping;
+/// its end if there is none
+const char *seqReader_t::recordStart( long long offset, bool fastq ) const
+{
+  const char *e = map_m + mapLen_m;
+
+  if ( offset == 0 )
+    return map_m;
+
+  if ( offset >= (long long)mapLen_m )
+    return e;
+
+  // a record starting at offset is preceded by the new line at offset-1
+  const char *p = map_m + offset - 1;
+  while ( (p = (const char *)memchr(p, '\n', e - p)) && ++p < e )
+  {
+    if ( !fastq )
+    {
+      if ( *p == '>' )
+	return p;
+      continue;
+    }
+
+    if ( *p != '@' )
+      continue;
+
+    const char *l2 = (const char *)memchr(p, '\n', e - p);
+    const char *l3 = l2 ? (const char *)memchr(l2 + 1, '\n', e - l2 - 1) : NULL;
+    if ( l3 && l3 + 1 < e && l3[1] == '+' )
+      return p;
+  }
+
+  return e;
+}
+
+//---------------------------------------------------------- nextBlock ----
+/// returns the current block to the reading thread and waits for the
+/// next filled one; false at the end of the input
+bool seqReader_t::nextBlock()
+{
+  if ( map_m )
+    return false;
+
+  pthread_mutex_lock(&lock_m);
+
+  if ( cur_m >= 0 )
+  {
+    blockBase_m += blocks_m[cur_m].len;
+    free_m.push_back(cur_m);
+    cur_m = -1;
+    pthread_cond_signal(&freeCond_m);
+  }
+
+  while ( filled_m.empty() && !done_m )
+    pthread_cond_wait(&filledCond_m, &lock_m);
+
+  if ( filled_m.empty() )
+  {
+    pthread_mutex_unlock(&lock_m);
+    pos_m = end_m = NULL;
+    return false;
+  }
+
+  cur_m = filled_m.front();
+  filled_m.pop_front();
+  pthread_mutex_unlock(&lock_m);
+
+  pos_m = blocks_m[cur_m].data;
+  end_m = pos_m + blocks_m[cur_m].len;
+
+  return true;
+}
+
+//------------------------------------------------------------ reserve ----
+/// makes buf at least len + 1 bytes long
+/// grows buf, of alloc bytes, so that it has room for len + 1 bytes
+static void *growBuf( void *buf, size_t &alloc, size_t len )
+{
+  if ( len < alloc )
+    return buf;
+
+  while ( alloc <= len )
+    alloc *= 2;
+
+  buf = realloc(buf, alloc);
+  if ( !buf )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Out of memory\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  return buf;
+}
+
+void seqReader_t::reserve( char *&buf, size_t &alloc, size_t len )
+{
+  buf = (char *)growBuf( buf, alloc, len );
+}
+
+void seqReader_t::reserve( signed char *&buf, size_t &alloc, size_t len )
+{
+  buf = (signed char *)growBuf( buf, alloc, len );
+}
+
+//-------------------------------------------------------------- setId ----
+/// id is the header line [s, e) up to the first white space
+void seqReader_t::setId( const char *s, const char *e, char *&id )
+{
+  size_t len = e - s;
+  reserve( id_m, idAlloc_m, len );
+  memcpy(id_m, s, len);
+  id_m[len] = '\0';
+
+  id = strlopspace(id_m);
+}
+
+//------------------------------------------------------------ isClean ----
+/// true if all len characters of s are upper case letters
+static inline bool isClean( const char *s, size_t len )
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i lo = _mm_set1_epi8('A' - 1);
+  const __m128i hi = _mm_set1_epi8('Z' + 1);
+  for ( ; i + 16 <= len; i += 16 )
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    // bytes >= 0x80 are negative and fail the first comparison
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+    if ( _mm_movemask_epi8(ok) != 0xFFFF )
+      return false;
+  }
+#endif
+
+  for ( ; i < len; i++ )
+    if ( s[i] < 'A' || s[i] > 'Z' )
+      return false;
+
+  return true;
+}
+
+#ifdef __SSE2__
+//----------------------------------------------------------- encode16 ----
+/// codes of 16 upper case characters: 0,1,2,3 for A,C,G,T, -1 otherwise
+static inline __m128i encode16( __m128i v )
+{
+  __m128i a = _mm_cmpeq_epi8(v, _mm_set1_epi8('A'));
+  __m128i c = _mm_cmpeq_epi8(v, _mm_set1_epi8('C'));
+  __m128i g = _mm_cmpeq_epi8(v, _mm_set1_epi8('G'));
+  __m128i t = _mm_cmpeq_epi8(v, _mm_set1_epi8('T'));
+
+  __m128i code = _mm_or_si128(_mm_and_si128(c, _mm_set1_epi8(1)),
+			      _mm_or_si128(_mm_and_si128(g, _mm_set1_epi8(2)),
+					   _mm_and_si128(t, _mm_set1_epi8(3))));
+  __m128i base = _mm_or_si128(_mm_or_si128(a, c), _mm_or_si128(g, t));
+
+  // all bits set, i.e. -1, for the other characters
+  return _mm_or_si128(code, _mm_andnot_si128(base, _mm_set1_epi8(-1)));
+}
+#endif
+
+//-------------------------------------------------------- encodeBases ----
+/// writes to codes the codes of the len upper case characters of s
+static void encodeBases( const char *s, size_t len, signed char *codes )
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  for ( ; i + 16 <= len; i += 16 )
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    _mm_storeu_si128((__m128i *)(codes + i), encode16(v));
+  }
+#endif
+
+  for ( ; i < len; i++ )
+    codes[i] = codeTbl[(unsigned char)s[i]];
+}
+
+//-------------------------------------------------------- upperEncode ----
+/// copies the line [s, s + len) to out, upper-cased and without white
+/// space, and if codes is not NULL writes the codes of the copied
+/// characters to it in the same pass; returns the number of characters
+/// copied. Runs of 16 letters are handled 16 at a time.
+static size_t upperEncode( const char *s, size_t len, char *out, signed char *codes )
+{
+  size_t i = 0, n = 0;
+
+#ifdef __SSE2__
+  const __m128i lo = _mm_set1_epi8('a' - 1);
+  const __m128i hi = _mm_set1_epi8('z' + 1);
+  const __m128i caseBit = _mm_set1_epi8(0x20);
+  for ( ; i + 16 <= len; i += 16 )
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    // letters of either case are lower case with the case bit set;
+    // bytes >= 0x80 are negative and fail the first comparison
+    __m128i l = _mm_or_si128(v, caseBit);
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(l, lo), _mm_cmplt_epi8(l, hi));
+
+    if ( _mm_movemask_epi8(letter) == 0xFFFF )
+    {
+      __m128i u = _mm_andnot_si128(caseBit, v);
+      _mm_storeu_si128((__m128i *)(out + n), u);
+      if ( codes )
+	_mm_storeu_si128((__m128i *)(codes + n), encode16(u));
+      n += 16;
+      continue;
+    }
+
+    for ( size_t j = i; j < i + 16; j++ )
+    {
+      unsigned char ch = s[j];
+      if ( isspace(ch) ) continue;
+      out[n] = upperTbl[ch];
+      if ( codes )
+	codes[n] = codeTbl[ upperTbl[ch] ];
+      n++;
+    }
+  }
+#endif
+
+  for ( ; i < len; i++ )
+  {
+    unsigned char ch = s[i];
+    if ( isspace(ch) ) continue;
+    out[n] = upperTbl[ch];
+    if ( codes )
+      codes[n] = codeTbl[ upperTbl[ch] ];
+    n++;
+  }
+
+  return n;
+}
+
+//------------------------------------------------------------- setSeq ----
+/// seq is the sequence data [s, e) of a record that lies entirely in the
+/// mapping or the current block; it is a view of [s, e) if that is a
+/// single line of upper case letters followed by a character of the
+/// input, otherwise it is copied to seq_m skipping white space and
+/// upper-casing on the way; with encode_m the codes of the bases are
+/// written to codes_m in the same pass. Scoring functions such as
+/// MarkovChains2_t::log10prob() read the character after a short read
+/// and stop at it, as they do at the '\0' of a copy, so the last record
+/// of an input without a trailing newline is always copied
+void seqReader_t::setSeq( const char *s, const char *e, char *&seq, int &seqLen )
+{
+  while ( e > s && isspace((unsigned char)e[-1]) )
+    e--;
+
+  size_t len = e - s;
+
+  if ( !copySeqs_m && e < end_m && isClean(s, len) )
+  {
+    seq    = (char *)s;
+    seqLen = (int)len;
+
+    if ( encode_m )
+    {
+      reserve( codes_m, codesAlloc_m, len );
+      encodeBases( s, len, codes_m );
+    }
+    return;
+  }
+
+  reserve( seq_m, seqAlloc_m, len );
+  if ( encode_m )
+    reserve( codes_m, codesAlloc_m, len );
+
+  // line by line, so that the 16 byte chunks do not straddle line breaks
+  size_t n = 0;
+  const char *p = s;
+  while ( p < e )
+  {
+    const char *nl = (const char *)memchr(p, '\n', e - p);
+    const char *le = nl ? nl : e;
+
+    n += upperEncode( p, le - p, seq_m + n, encode_m ? codes_m + n : NULL );
+
+    p = le + 1;
+  }
+
+  seq_m[n] = '\0';
+
+  seq    = seq_m;
+  seqLen = (int)n;
+}
+
+//------------------------------------------------------ nextFastaView ----
+/// parses the FASTA record starting at pos_m (just after '>') if it lies
+/// entirely in the mapping or the current block; returns false, without
+/// consuming any input, otherwise
+bool seqReader_t::nextFastaView( char *&id, char *&seq, int &seqLen )
+{
+  const char *nl = (const char *)memchr(pos_m, '\n', end_m - pos_m);
+  if ( !nl )
+    return false;
+
+  const char *s = nl + 1;
+  const char *e = (const char *)memchr(s, '>', end_m - s);
+  if ( !e )
+  {
+    if ( !map_m ) // the record may continue in the next block
+      return false;
+    e = end_m;
+  }
+
+  setId( pos_m, nl, id );
+  setSeq( s, e, seq, seqLen );
+  pos_m = e;
+
+  return true;
+}
+
+//------------------------------------------------------ nextFastqView ----
+/// parses the four-line FASTQ record starting at pos_m (just after '@')
+/// if it lies entirely in the mapping or the current block; returns
+/// false, without consuming any input, otherwise
+bool seqReader_t::nextFastqView( char *&id, char *&seq, int &seqLen )
+{
+  const char *h  = pos_m;
+  const char *l1 = (const char *)memchr(h, '\n', end_m - h);
+  if ( !l1 )
+    return false;
+
+  const char *s  = l1 + 1;
+  const char *l2 = (const char *)memchr(s, '\n', end_m - s);
+  if ( !l2 || l2 + 1 >= end_m || l2[1] != '+' )
+    return false;
+
+  const char *l3 = (const char *)memchr(l2 + 1, '\n', end_m - l2 - 1);
+  if ( !l3 )
+    return false;
+
+  const char *q  = l3 + 1;
+  const char *l4 = (const char *)memchr(q, '\n', end_m - q);
+  if ( !l4 && !map_m )
+    return false;
+
+  const char *qe = l4 ? l4 : end_m;
+  const char *se = l2;
+  while ( se > s && isspace((unsigned char)se[-1]) )
+    se--;
+  while ( qe > q && isspace((unsigned char)qe[-1]) )
+    qe--;
+
+  if ( se - s != qe - q ) // multi-line record or white space inside; parsed by the caller
+    return false;
+
+  setId( h, l1, id );
+  setSeq( s, se, seq, seqLen );
+
+  if ( keepQual_m )
+  {
+    size_t len = qe - q;
+    reserve( qual_m, qualAlloc_m, len );
+    memcpy(qual_m, q, len);
+    qual_m[len] = '\0';
+  }
+
+  pos_m = l4 ? l4 + 1 : end_m;
+
+  return true;
+}
+
+//----------------------------------------------------------- readLine ----
+/// reads the rest of the current line into buf; false if the input ended
+/// before any character was read
+bool seqReader_t::readLine( char *&buf, size_t &alloc, size_t &len )
+{
+  int ch;
+  len = 0;
+
+  while ( (ch = getChar()) != '\n' )
+  {
+    if ( ch == EOF )
+    {
+      if ( !len )
+	return false;
+      break;
+    }
+    append( buf, alloc, len, ch );
+  }
+  buf[len] = '\0';
+
+  return true;
+}
+
+//--------------------------------------------------------------- next ----
+/// id, seq and seqLen are set to the id, sequence and length of the next
+/// record; id and seq are owned by the reader and are valid until the
+/// next call
+bool seqReader_t::next( char *&id, char *&seq, int &seqLen )
+{
+  int ch;
+  if ( pending_m != EOF )
+  {
+    ch = pending_m;
+    pending_m = EOF;
+  }
+  else
+  {
+    ch = getChar();
+  }
+
+  if ( !started_m )
+  {
+    while ( ch != EOF && isspace(ch) )
+      ch = getChar();
+    fastq_m   = ( ch == '@' );
+    started_m = true;
+  }
+
+  //-- Find the beginning of the record
+  int start = fastq_m ? '@' : '>';
+  while ( ch != start )
+  {
+    if ( ch == EOF )
+      return false;
+    ch = getChar();
+  }
+
+  if ( fastq_m ? nextFastqView( id, seq, seqLen ) : nextFastaView( id, seq, seqLen ) )
+    return true;
+
+  //-- Get the header
+  size_t len;
+  if ( !readLine(id_m, idAlloc_m, len) )
+    return false;
+  id = strlopspace(id_m);
+
+  //-- Get the sequence data
+  size_t n = 0;
+  if ( !fastq_m )
+  {
+    while ( (ch = getChar()) != '>' && ch != EOF )
+    {
+      if ( isspace(ch) ) continue;
+      append( seq_m, seqAlloc_m, n, toupper(ch) );
+    }
+    pending_m = ch;
+  }
+  else
+  {
+    // the sequence ends with a line starting with '+'
+    bool lineStart = true;
+    while ( (ch = getChar()) != EOF )
+    {
+      if ( lineStart && ch == '+' )
+	break;
+
+      lineStart = ( ch == '\n' );
+      if ( isspace(ch) ) continue;
+      append( seq_m, seqAlloc_m, n, toupper(ch) );
+    }
+
+    if ( ch == EOF )
+    {
+      setError( string("truncated FASTQ record ") + string(id) + string(" in ") + name_m );
+      return false;
+    }
+
+    while ( ch != '\n' && ch != EOF )
+      ch = getChar();
+
+    // the quality string has as many characters as the sequence; it may
+    // span several lines, which may start with '@'
+    size_t q = 0, nq = 0;
+    while ( nq < n && (ch = getChar()) != EOF )
+    {
+      if ( isspace(ch) ) continue;
+      if ( keepQual_m )
+	append( qual_m, qualAlloc_m, q, ch );
+      nq++;
+    }
+    qual_m[q] = '\0';
+
+    if ( nq < n )
+    {
+      setError( string("truncated FASTQ record ") + string(id) + string(" in ") + name_m );
+      return false;
+    }
+  }
+
+  seq_m[n] = '\0';
+  seq    = seq_m;
+  seqLen = (int)n;
+
+  if ( encode_m )
+  {
+    reserve( codes_m, codesAlloc_m, n );
+    encodeBases( seq_m, n, codes_m );
+  }
+
+  return true;
+}
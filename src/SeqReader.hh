@@ -0,0 +1,192 @@
+#ifndef SEQREADER_HH
+#define SEQREADER_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+using namespace std;
+
+//================================================ seqReader_t ====
+/// Reader of plain or gzip compressed FASTA and FASTQ files
+///
+/// An uncompressed regular file is memory-mapped and parsed in place.
+/// Any other input is read, and inflated if it starts with the gzip magic
+/// bytes, by a separate thread into a small pool of fixed size blocks;
+/// the caller's thread only parses records out of the filled blocks, so
+/// that decompression overlaps with classification.
+///
+/// Records lying entirely in the mapping or in the current block are
+/// split with memchr(). If the sequence of such a record is a single line
+/// of upper case letters, which is checked 16 bytes at a time, next()
+/// returns a view into the mapping or block instead of a copy. Other
+/// records are copied line by line. The format is
+/// recognized from the first record: '>' - FASTA, '@' - FASTQ. Multi-line
+/// sequences and quality strings, and concatenated gzip members, as
+/// produced by bgzip and cat, are supported.
+///
+/// Sequences are upper-cased and stripped of white space as done by
+/// getNextFastaRecord(); the record's id is its header up to the first
+/// white space. A view is not '\0' terminated, though it is always followed
+/// by a non-base character, and must not be modified; callers that need
+/// either call copySeqs(true) before the first next(). With encode(true)
+/// the bases are also 2-bit encoded as intACGTLookup[] does (A,C,G,T -
+/// 0,1,2,3; anything else -1) in the same pass that upper-cases and
+/// copies them; see codes().
+///
+/// Parameters:
+/// fp        - input stream; not closed by the reader
+/// name      - name of the input used in error messages
+/// keepQual  - if true, quality strings of FASTQ records are kept and
+///             can be retrieved with qual(); otherwise they are skipped
+/// blockSize - size of each block of (decompressed) input
+/// nBlocks   - number of blocks; at most nBlocks - 1 of them are read ahead
+///
+class seqReader_t
+{
+public:
+  seqReader_t( FILE *fp, const char *name, bool keepQual=false,
+	       size_t blockSize=1024*1024, int nBlocks=4 );
+  seqReader_t( const char *file, bool keepQual=false ); /// opens file; exits if it cannot be opened
+  ~seqReader_t();
+
+  void copySeqs( bool x ) { copySeqs_m = x; }      /// if true, seq is always a '\0' terminated copy owned by the reader
+  void encode( bool x ) { encode_m = x; }          /// if true, codes() of each record are computed
+
+  bool next( char *&id, char *&seq, int &seqLen ); /// reads the next record; false at the end of input or on error
+  const char *qual() const { return keepQual_m && fastq_m ? qual_m : NULL; } /// quality string of the last record
+  const signed char *codes() const { return encode_m ? codes_m : NULL; }    /// seqLen base codes of the last record
+  bool isFastq() const { return fastq_m; }
+  bool isMapped() const { return map_m != NULL; }  /// true if the input is memory-mapped
+  bool isGzip();
+  long long bytesRead();                           /// number of bytes of the (compressed) input read so far
+  long long offset() const;                        /// offset of the next record in the (decompressed) input
+  bool seek( long long offset );                   /// continues at offset of a mapped input; false if not possible
+  bool shard( int i, int n );                      /// restricts a mapped input to the records of its i-th of n byte ranges
+  const char *error();                             /// NULL if there was no error
+
+private:
+  void init( FILE *fp, bool keepQual, size_t blockSize, int nBlocks );
+  bool mapFile();
+  const char *recordStart( long long offset, bool fastq ) const;
+  static void *run( void *arg );
+  void produce();
+  size_t fill( char *buf, size_t size );
+  void setError( const string &msg );
+  bool nextBlock();
+  inline int getChar();
+  bool readLine( char *&buf, size_t &alloc, size_t &len );
+  bool nextFastaView( char *&id, char *&seq, int &seqLen );
+  bool nextFastqView( char *&id, char *&seq, int &seqLen );
+  void setId( const char *s, const char *e, char *&id );
+  void setSeq( const char *s, const char *e, char *&seq, int &seqLen );
+  void reserve( char *&buf, size_t &alloc, size_t len );
+  void reserve( signed char *&buf, size_t &alloc, size_t len );
+  inline void append( char *&buf, size_t &alloc, size_t &len, char c );
+
+  struct block_t
+  {
+    char *data;
+    size_t len;
+  };
+
+  FILE *fp_m;
+  bool ownFp_m;                /// true if fp_m was opened by the reader
+  string name_m;
+  bool keepQual_m;
+  size_t blockSize_m;
+
+  // shared by the reading thread and the caller; guarded by lock_m
+  vector<block_t> blocks_m;
+  deque<int> filled_m;         /// indices of blocks ready to be parsed, in input order
+  deque<int> free_m;           /// indices of blocks that can be filled
+  bool threaded_m;             /// true if the reading thread has been started
+  bool done_m;                 /// true when the reading thread has filled its last block
+  bool stop_m;                 /// true if the reading thread has to stop early
+  bool gzip_m;
+  bool formatKnown_m;          /// true once gzip_m is set
+  long long bytesRead_m;
+  string error_m;
+  pthread_mutex_t lock_m;
+  pthread_cond_t filledCond_m;
+  pthread_cond_t freeCond_m;
+  pthread_t thread_m;
+
+  // used only by the reading thread
+  z_stream zs_m;
+  char *inBuf_m;               /// raw input
+  size_t inBufSize_m;
+  bool streamEnd_m;            /// true at the end of a gzip member
+  bool failed_m;               /// true when no more input can be inflated: end of input or an error
+
+  // used only by the caller
+  char *map_m;                 /// mapping of the whole input file; NULL if the input is not mapped
+  size_t mapLen_m;
+  int cur_m;                   /// block being parsed; -1 if none
+  long long blockBase_m;       /// offset of the current block in the decompressed input
+  const char *pos_m;           /// next character of the current block
+  const char *end_m;
+  int pending_m;               /// first character of the next record if already read; EOF otherwise
+  bool started_m;
+  bool fastq_m;
+  bool copySeqs_m;
+  bool encode_m;
+  char *id_m;
+  char *seq_m;
+  char *qual_m;
+  signed char *codes_m;
+  size_t idAlloc_m, seqAlloc_m, qualAlloc_m, codesAlloc_m;
+};
+
+//-------------------- inlines -------------------------------
+inline int seqReader_t::getChar()
+{
+  if ( pos_m == end_m && !nextBlock() )
+    return EOF;
+
+  return (unsigned char)*pos_m++;
+}
+
+inline void seqReader_t::append( char *&buf, size_t &alloc, size_t &len, char c )
+{
+  if ( len + 1 >= alloc )
+  {
+    alloc *= 2;
+    buf = (char *)realloc(buf, alloc);
+    if ( !buf )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: Out of memory\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+
+  buf[len++] = c;
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "UnixSocket.hh"
+
+//------------------------------------------------------- socketAddress ----
+static void socketAddress( const char *path, struct sockaddr_un *addr )
+{
+  if ( strlen(path) >= sizeof(addr->sun_path) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: socket path %s is longer than %d characters\n",
+	    __FILE__, __LINE__, path, (int)sizeof(addr->sun_path) - 1);
+    exit(1);
+  }
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path);
+}
+
+//---------------------------------------------------------- unixListen ----
+/// A socket file left behind by a server that was killed is removed; if
+/// another server still accepts connections on it, the call fails.
+int unixListen( const char *path, int backlog )
+{
+  struct sockaddr_un addr;
+  socketAddress( path, &addr );
+
+  struct stat st;
+  if ( stat(path, &st) == 0 )
+  {
+    if ( !S_ISSOCK(st.st_mode) )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %s exists and is not a socket\n", __FILE__, __LINE__, path);
+      exit(1);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: a server is already listening on %s\n", __FILE__, __LINE__, path);
+      exit(1);
+    }
+    if ( fd >= 0 )
+      close(fd);
+
+    unlink(path);
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ( fd < 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot create socket: %s\n", __FILE__, __LINE__, strerror(errno));
+    exit(1);
+  }
+
+  if ( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+       listen(fd, backlog) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot listen on %s: %s\n", __FILE__, __LINE__, path, strerror(errno));
+    exit(1);
+  }
+
+  return fd;
+}
+
+//--------------------------------------------------------- unixConnect ----
+int unixConnect( const char *path )
+{
+  struct sockaddr_un addr;
+  socketAddress( path, &addr );
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ( fd < 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot create socket: %s\n", __FILE__, __LINE__, strerror(errno));
+    exit(1);
+  }
+
+  if ( connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot connect to %s: %s\n", __FILE__, __LINE__, path, strerror(errno));
+    exit(1);
+  }
+
+  return fd;
+}
+
+//------------------------------------------------------------ writeAll ----
+bool writeAll( int fd, const char *buf, size_t len )
+{
+  while ( len )
+  {
+    ssize_t n = write(fd, buf, len);
+    if ( n < 0 )
+    {
+      if ( errno == EINTR )
+	continue;
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+
+  return true;
+}
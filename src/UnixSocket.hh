@@ -0,0 +1,43 @@
+#ifndef UNIXSOCKET_HH
+#define UNIXSOCKET_HH
+
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <stddef.h>
+
+// Helpers of classify --serve and of its client classifyClient. Both ends
+// exchange plain text over a local (AF_UNIX) stream socket:
+//
+//   request:  "FASTA\n" followed by fasta records up to the end of the
+//             client's half of the connection, or
+//             "FILE <path>\n" naming a fasta file readable by the server
+//   response: result lines <seqId>\t<taxon>\t<err>, as in MC_order<k>_results.txt,
+//             terminated by "# END <number of reads>\n" or by a single
+//             "# ERROR <message>\n" line
+
+int unixListen( const char *path, int backlog );        /// creates a listening socket bound to path; exits on failure
+int unixConnect( const char *path );                    /// connects to the socket at path; exits on failure
+bool writeAll( int fd, const char *buf, size_t len );   /// writes all of buf; false on failure
+
+#endif
@@ -24,6 +24,7 @@ OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 #include <string>
 #include <vector>
+#include <sys/stat.h>
 #include "CUtilities.h"
 #include "CStatUtilities.h"
 #include "IOCUtilities.h"
@@ -31,6 +32,7 @@ OR PERFORMANCE OF THIS SOFTWARE.
 #include "CppUtilities.hh"
 #include "MarkovChains2.hh"
 #include "StatUtilities.hh"
+#include "SeqReader.hh"
 
 using namespace std;
 
@@ -454,29 +456,24 @@ int main(int argc, char **argv)
     fclose(out2);
     out2 = fOpen(outFile2.c_str(), "a");
 
-    FILE *in = fOpen(inPar->inFile, "r");
-
-    int nRecs = numRecordsInFasta( inPar->inFile );
-    int q01 = 0;
+    seqReader_t reader( inPar->inFile );
     int count = 0;
 
-    if ( nRecs > 1000 )
-      q01 = int(0.01 * nRecs);
-
-    //cerr << "nRecs=" << nRecs << "\tq01=" << q01 << endl;
-    cerr << "--- Number of sequences in " << inPar->inFile << " = " << nRecs << endl;
+    // progress is the fraction of the input file consumed
+    struct stat st;
+    off_t inSize = 0;
+    if ( stat(inPar->inFile, &st) == 0 && S_ISREG(st.st_mode) )
+      inSize = st.st_size;
 
     size_t alloc = 1024*1024;
-    char *data, *rcseq;
-    MALLOC(data, char*, alloc * sizeof(char));
-    MALLOC(seq, char*, alloc * sizeof(char));
+    char *rcseq;
     MALLOC(rcseq, char*, alloc * sizeof(char));
 
-    while ( getNextFastaRecord( in, id, data, alloc, seq, seqLen) )
+    while ( reader.next( id, seq, seqLen ) )
     {
-      if ( q01 && (count % q01) == 0 )
+      if ( inSize && (count % 1000) == 0 )
       {
-	int q = int( (100.0*count) / nRecs);
+	int q = int( (100.0*reader.bytesRead()) / inSize );
 	cerr << "\r" << "Number of sequences processed = " << count << "\t" << q << "%";
       }
 
@@ -516,14 +513,12 @@ int main(int argc, char **argv)
       //writeProbs(out, id, probs, nModels);
     }
 
-    free(seq);
     free(rcseq);
-    free(data);
 
-    fclose(in);
     fclose(out);
     fclose(out2);
 
+    cerr << "\r--- Number of sequences in " << inPar->inFile << " = " << count << endl;
     cerr << "\r\nOutput written to " << outFile.c_str() << endl;
     cerr << "Low quality read ids written to " << outFile2.c_str() << endl << endl;
   }
@@ -21,11 +21,17 @@ OR PERFORMANCE OF THIS SOFTWARE.
 */
 
 #include <getopt.h>
+#include <errno.h>
 #include <string.h>
 #include <string>
 #include <vector>
 #include <queue>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
 
 #include "CUtilities.h"
 #include "IOCUtilities.h"
@@ -33,11 +39,32 @@ OR PERFORMANCE OF THIS SOFTWARE.
 #include "CppUtilities.hh"
 #include "MarkovChains2.hh"
 #include "StatUtilities.hh"
+#include "CppStatUtilities.hh"
 #include "Newick.hh"
 #include "CStatUtilities.h"
+#include "FileWriters.hh"
+#include "GzStream.hh"
+#include "DecisionTree.hh"
+#include "ReadTrace.hh"
+#include "ReadMargins.hh"
+#include "NpyWriter.hh"
+#include "RunMetrics.hh"
+#include "PrimerTrim.hh"
+#include "RegionRouter.hh"
+#include "FlatScorer.hh"
+#include "ModelBundle.hh"
+#include "CountTable.hh"
+#include "UnixSocket.hh"
+#include "SeqReader.hh"
+#include "Checkpoint.hh"
+#include "ResultsFile.hh"
 
 using namespace std;
 
+#define ORIENT_ORDER 3 // default order of the models deciding the strand of a read with --orient auto
+#define READ_BUDGET 1000000 // default --read-budget; a 500 base read with 5 Ns costs 512000
+#define ORIENT_WINDOW 100 // number of bases at the start of a read whose strands are compared
+
 //----------------------------------------------------------- printUsage ----
 void printUsage( const char *s )
 {
@@ -50,9 +77,11 @@ void printUsage( const char *s )
        << s << " -d < MC models directory> -r <ref tree> -i <input fasta file> -o <output directory> [Options]" << endl
        << endl
        << "\tOptions:\n"
-       << "\t-d <dir>      - directory containing MC model files\n"
+       << "\t-d <dir>      - directory containing MC model files, or a model bundle file made from it by mcBundle\n"
        << "\t-o <dir>      - output directory for MC taxonomy files\n"
-       << "\t-i <inFile>   - input fasta file with sequences for which -log10(prob(seq | model_i)) are to be computed\n"
+       << "\t-i <inFile>   - input fasta or fastq file, plain or gzip compressed, with sequences for which\n"
+       << "\t                -log10(prob(seq | model_i)) are to be computed\n"
+       << "\t                can be given more than once; see --manifest. With -i - the sequences are read from the standard input\n"
        << "\t-r <ref tree> - reference tree with node labels corresponding to the names of the model files\n"
        << "\t-t <trgFile>  - file containing paths to training fasta files\n"
        << "\t-f <fullTx>   - fullTx file. Its optional parameter for printing classification output in a long format like in RDP classifier\n"
@@ -60,18 +89,98 @@ void printUsage( const char *s )
        << "\t-e <seqID>    - sequence ID of a sequence from the training fasta files that is to be excluded\n"
        << "                  from model building and needs to be used for cross validation\n"
        << "\t--rev-comp, -c          - reverse complement query sequences before computing classification posterior probabilities\n"
+       << "\t--orient <fwd|rc|auto>  - strand of the query sequences; rc is the same as --rev-comp. With auto the strand of\n"
+       << "\t                          each read is the one scoring higher with the order --orient-order models of the\n"
+       << "\t                          children of the root, and only that strand is classified. Default value: fwd\n"
+       << "\t--orient-order <k>      - order of the models used by --orient auto. Default value: " << ORIENT_ORDER << "\n"
+       << "\t--mate2 <R2 file>       - classify the reads of the -i file together with their mates in <R2 file>, one result\n"
+       << "\t                          per pair. Both mates are scored at each node of the walk (R2 reverse complemented)\n"
+       << "\t                          and their log10 probabilities are added and divided by the total length of the pair\n"
+       << "\t--fwd-primer <seq>      - forward primer (5'->3', IUPAC codes allowed) removed with all bases before it from\n"
+       << "\t                          the start of each read (or its reverse complement from the end of reverse reads)\n"
+       << "\t--rev-primer <seq>      - reverse primer (5'->3') removed likewise from the other end of each read\n"
+       << "\t--primer-errors <k>     - max number of mismatches and indels of a primer match.\n"
+       << "\t                          Default value: a tenth of the primer's length\n"
+       << "\t--primer-offset <n>     - max number of bases before a primer. Default value: 30\n"
+       << "\t--regions <file>        - classify the reads of several amplicon regions in one pass; each line of <file> is\n"
+       << "\t                          <region name><TAB><MC models directory>. Each read is classified with the models of\n"
+       << "\t                          the region whose order " << ROUTE_ORDER << " model pooled from all its models scores the read highest;\n"
+       << "\t                          the models of a region are loaded when its first read is seen and the region is\n"
+       << "\t                          the fourth column of the results. -d and -r are then not used\n"
        << "\t--skip-err-thld         - classify all sequences to the species level\n"
+       << "\t--flat                  - score each read with all species (leaf) models in one pass instead of walking\n"
+       << "\t                          the tree and report the best one, the classification error of its score (1 if\n"
+       << "\t                          the score is below the species' threshold) and its lineage as a fourth column.\n"
+       << "\t                          Needs a table of 8 bytes per k-mer and species (512 MB for order 7 and 1000\n"
+       << "\t                          species); tables above " << FLAT_MAX_MB << " MB are refused\n"
        << "\t--max-num-amb-codes <n> - maximal acceptable number of ambiguity codes for a sequence\n"
        << "\t                          above this number sequence's log10prob() is not computed and\n"
        << "\t                          the sequence's id it appended to <genus>_more_than_<n>_amb_codes_reads.txt file.\n"
-       << "\t                          Default value: 5\n\n"
+       << "\t                          Default value: 5\n"
+       << "\t--read-budget <n>       - max cost of scoring a read with one model: bases times the number of expansions of\n"
+       << "\t                          its ambiguity codes. Reads over it, or with more than --max-num-amb-codes codes, are\n"
+       << "\t                          scored on their ACGT k-mers only and marked 'degraded' in the last column of the\n"
+       << "\t                          results. Default value: " << READ_BUDGET << "\n\n"
        << "\t--pseudo-count-type, -p <f>  - f=0 for add 1 to all k-mer counts zero-offset\n"
        << "\t                               f=1 for add 1/4^k to k-mer counts zero-offset\n"
        << "\t                               f=2 the pseudocounts for a order k+1 model be alpha*probabilities from\n"
        << "\t                                   an order k model, recursively down to pseudocounts of alpha/num_letters\n"
        << "\t                                   for an order 0 model.\n"
-       << "\t--print-nc-probs, -s - print to files <tx>_true_ncProbs.txt, <tx>_false_ncProbs.txt, where <tx> are all taxons present in reference data,\n"
-       << "\t                       normalized conditional probabilities for tuning threshold values of taxon assignment\n"
+       << "\t--print-nc-probs, -s - print to files <tx>_true_ncProbQs.txt, <tx>_false_ncProbQs.txt, where <tx> are all taxons present in reference data,\n"
+       << "\t                       quantiles of normalized conditional probabilities for tuning threshold values of taxon assignment\n"
+       << "\t--dump-nc-probs      - same as --print-nc-probs, but also print all normalized conditional probabilities\n"
+       << "\t                       to files <tx>_true_ncProbs.txt, <tx>_false_ncProbs.txt\n"
+       << "\t-a <dim>             - write the conditional probabilities of the positions of each read given the model of\n"
+       << "\t                       its last assignment as rows of the float32 NumPy matrix <outDir>/condProbs.npy of\n"
+       << "\t                       dim - (order + 1) columns, padded with 0s; the read IDs are in condProbs_ids.txt\n"
+       << "\t--err-grid-res <n>   - number of cells of the lookup grid of each classification error curve;\n"
+       << "\t                       0 turns the grid off. Default value: 1024\n"
+       << "\t--err-grid-tol <t>   - max deviation of a grid lookup from the error curve. Default value: 0 (exact lookup)\n"
+       << "\t--check-err-grid     - compare each grid lookup with binary search over the error table\n"
+       << "\t--trace <file>       - write to <file> the scores, thresholds and decisions of the classification\n"
+       << "\t                       walk of each read\n"
+       << "\t--trace-taxa <list>  - comma separated list of taxa; with --trace only reads for which one of them\n"
+       << "\t                       was evaluated or assigned are traced\n"
+       << "\t--margins <file>     - write to <file> the best and second best child, their scores and the margin\n"
+       << "\t                       between them at each node of the classification walk of each read\n"
+       << "\t--metrics <file>     - write to <file> JSON with reads/s overall and of each phase of the run, the number\n"
+       << "\t                       of reads stopped at each depth, model evaluations per node, reads taking the IUPAC\n"
+       << "\t                       path and the peak RSS\n"
+       << "\t--manifest <file>    - file with the fasta files of many samples, one per line, either as <file>,\n"
+       << "\t                       <sample name><TAB><file> or <sample name><TAB><R1 file><TAB><R2 file> for paired-end\n"
+       << "\t                       samples (see --mate2). With more than one input file the models are loaded once,\n"
+       << "\t                       the output of each sample is written to <outDir>/<sample name> and per-sample read\n"
+       << "\t                       counts to <outDir>/summary.txt. The default sample name is the file name without\n"
+       << "\t                       the directory and the fasta/fastq and .gz extensions\n"
+       << "\t--threads <n>        - number of samples classified in parallel. Default value: number of CPUs\n"
+       << "\t--count-tbl          - write sample x phylotype count tables (as count_tbl.pl would from the results file)\n"
+       << "\t                       to <outDir>/spp_count_tbl.txt, spp_count_tbl_triplets.txt and spp_count_tbl.biom\n"
+       << "\t--sample-id-rule <r> - how sample IDs are obtained for --count-tbl:\n"
+       << "\t                       default    - read ID of the form <sampleID>_<index>[:...]\n"
+       << "\t                       file       - the sample name of the input file (see --manifest)\n"
+       << "\t                       regex:<re> - the first subexpression of the extended regular expression <re>\n"
+       << "\t--stdout            - write the classification results to the standard output instead of\n"
+       << "\t                       <outDir>/MC_order<k>_results.txt; -o is then only needed by -s, -a and --count-tbl\n"
+       << "\t--serve <socket>     - load the models once and classify fasta records or files sent to the Unix domain\n"
+       << "\t                       socket <socket> (see classifyClient) until the process is terminated;\n"
+       << "\t                       --threads sets the number of clients served at the same time\n"
+       << "\t--checkpoint <n>     - every <n> reads flush and fsync the results file and record the progress\n"
+       << "\t                       in <outDir>/MC_order<k>_results.txt.ckpt\n"
+       << "\t--resume             - continue an interrupted run from its last checkpoint, appending to the same\n"
+       << "\t                       results file; the models and options have to be the same. Without --checkpoint\n"
+       << "\t                       the interval of the interrupted run is used\n"
+       << "\t--shard <i>/<N>      - classify only the reads starting in the i-th (0-based) of N equal byte ranges of\n"
+       << "\t                       each (uncompressed) input file, so that N processes can share one input;\n"
+       << "\t                       the outputs of the N shards are combined with mergeResults; cannot be combined\n"
+       << "\t                       with -s, -a, --trace or --margins\n"
+       << "\t--bin-results        - write the results to <outDir>/MC_order<k>_results.mcr in a compact binary format\n"
+       << "\t                       (see ResultsFile.hh); resultsToText converts it to the text format\n"
+       << "\t--bin-no-ids         - do not store read IDs in the binary results; reads are identified by their index\n"
+       << "\t--bin-half           - store errors of the binary results as float16 (about 3 significant digits)\n"
+       << "\t--gzip               - gzip compress the results file, condProbs_ids.txt, the --trace and --margins\n"
+       << "\t                       files and the per-taxon seq.ids and --dump-nc-probs files of -s; .gz is\n"
+       << "\t                       appended to their names. With --stdout the results are written uncompressed\n"
+       << "\t--gzip-level <n>     - zlib compression level of --gzip, from 1 (fastest; default) to 9; implies --gzip\n"
        << "\t-v                   - verbose mode\n\n"
        << "\t-h|--help            - this message\n\n"
 
@@ -105,17 +214,6 @@ void printHelp( const char *s )
     printUsage(s);
 }
 
-//----------------------------------------------- errTbl_t ----
-/// holds errTbl and log10cProb.thld
-typedef struct
-{
-  double **errTbl; ///
-  int nrow;
-  double thld;  /// the first element of x
-  double *x;    /// the first column of errTbl
-  double xmax;  /// the max of x
-} errTbl_t;
-
 //================================================= inPar2_t ====
 //! holds input parameters
 class inPar2_t
@@ -130,8 +228,13 @@ public:
   char *coreErrRFile;       /// core clError R file
   char *trgFile;            /// file containing paths to fasta training files
   char *fullTxFile;         /// fullTx file for printing classification ouput in a long format as in RDP classifier's fixrank
-  char *inFile;             /// input file with path(s) to fasta file(s) containing sequences
+  vector<char *> inFiles;   /// input fasta file(s) containing sequences
+  char *mate2File;          /// R2 file of a paired-end library whose R1 file is the only -i file; NULL for single reads
                             /// for which -log10(prob(seq | model_i)) are to be computed
+  char *manifestFile;       /// file with input fasta files of many samples
+  int nThreads;             /// number of samples classified in parallel; 0 - number of CPUs
+  int countTbl;             /// if 1, sample x taxon count tables are written to outDir
+  char *sampleIdRule;       /// rule extracting sample IDs from read IDs; see CountTable.hh
   char *seqID;              /// sequence ID of a sequence from the training fasta files that is to be excluded
                             /// from model building and needs to be used for cross validation
   char *treeFile;           /// reference tree file
@@ -141,12 +244,42 @@ public:
   int printCounts;          /// flag initiating print out of word counts
   int skipErrThld;          /// ignore classification error condition - with this option on each sequence is classified to the species with the highest p(x|M)
   int maxNumAmbCodes;       /// maximal acceptable number of ambiguity codes for a sequence; above this number log10probIUPAC() returns 1;
+  double readBudget;        /// max k-mer lookups (expanded paths x bases) of one model evaluation of a read; reads above it
+                            /// or with more than maxNumAmbCodes ambiguity codes are scored by log10probSkipAmb()
   int randSampleSize;       /// number of random sequences of each model (seq length = mean ref seq). If 0, no random samples will be generated.
   int pseudoCountType;      /// pseudo-count type; see MarkovChains2.hh for possible values
   bool verbose;
-  bool printNCprobs;        /// if true, the program prints to files normalized conditional probabilities for tuning threshold values of taxon assignment
+  bool printNCprobs;        /// if true, the program prints to files quantiles of normalized conditional probabilities for tuning threshold values of taxon assignment
+  int dumpNCprobs;          /// if 1, all normalized conditional probabilities are also printed to files; implies printNCprobs
   int dimProbs;             /// max dimension of probs
   bool revComp;             /// reverse-complement query sequences before processing
+  int orientAuto;           /// if 1, the strand of each read is chosen by reverseStrand()
+  int orientOrder;          /// order of the models used by reverseStrand()
+  char *fwdPrimer;          /// forward primer trimmed from the reads; NULL if none
+  char *revPrimer;          /// reverse primer trimmed from the reads; NULL if none
+  int primerErrors;         /// max edit distance of a primer match; -1 for a tenth of the primer's length
+  int primerOffset;         /// max number of bases preceding a primer
+  char *regionsFile;        /// file of <region name><TAB><model directory> lines of --regions
+  int errGridRes;           /// number of cells of the lookup grid of each error curve; 0 - no grid, binary search only
+  double errGridTol;        /// max deviation of the grid lookup from the error curve; 0 - exact lookup
+  int checkErrGrid;         /// if 1, each grid lookup is compared with the binary search lookup
+  char *traceFile;          /// file to which the decisions of the classification walk are written
+  char *traceTaxa;          /// comma separated list of taxa; if set only reads touching them are traced
+  char *marginsFile;        /// file to which the best and second best child at each node of the walk are written
+  char *metricsFile;        /// JSON file to which the throughput and walk statistics of the run are written
+  char *serveSocket;        /// Unix domain socket of the --serve mode
+  int toStdout;             /// if 1, the classification results are written to stdout
+  long ckptInterval;        /// number of reads between checkpoints; 0 - no checkpoints unless resume is set
+  int resume;               /// if 1, the classification continues from the last checkpoint
+  unsigned long long fingerprint; /// fingerprint of the models and options recorded in checkpoints
+  int shardIdx;             /// with nShards > 0 only the reads of the shardIdx-th of nShards byte ranges
+  int nShards;              /// of each input file are classified; see seqReader_t::shard()
+  int binResults;           /// if 1, the results are written in the binary format of ResultsFile.hh
+  int binNoIds;             /// if 1, the binary results have no read ID column; implies binResults
+  int binHalf;              /// if 1, the binary results have float16 errors; implies binResults
+  int gzip;                 /// if 1, the results and side outputs are gzip compressed
+  int gzipLevel;            /// zlib compression level of --gzip
+  int flat;                 /// if 1, all leaves are scored at once by flatScorer_t instead of walking the tree
 
   void print();
 };
@@ -158,19 +291,52 @@ inPar2_t::inPar2_t()
   mcDir           = NULL;
   trgFile         = NULL;
   fullTxFile      = NULL;
-  inFile          = NULL;
+  manifestFile    = NULL;
+  nThreads        = 0;
+  countTbl        = 0;
+  sampleIdRule    = NULL;
   treeFile        = NULL;
   seqID           = NULL;
   thld            = 0.0;
   printCounts     = 0;
   skipErrThld     = 0;
   maxNumAmbCodes  = 5;
+  readBudget      = READ_BUDGET;
   randSampleSize  = 0;
   pseudoCountType = recPdoCount;
   dimProbs        = 0;
   printNCprobs    = false;
+  dumpNCprobs     = 0;
   verbose         = false;
   revComp         = false;
+  orientAuto      = 0;
+  orientOrder     = ORIENT_ORDER;
+  fwdPrimer       = NULL;
+  revPrimer       = NULL;
+  primerErrors    = -1;
+  primerOffset    = 30;
+  regionsFile     = NULL;
+  mate2File       = NULL;
+  errGridRes      = 1024;
+  errGridTol      = 0.0;
+  checkErrGrid    = 0;
+  traceFile       = NULL;
+  traceTaxa       = NULL;
+  marginsFile     = NULL;
+  metricsFile     = NULL;
+  serveSocket     = NULL;
+  toStdout        = 0;
+  ckptInterval    = 0;
+  resume          = 0;
+  fingerprint     = 0;
+  shardIdx        = 0;
+  nShards         = 0;
+  binResults      = 0;
+  binNoIds        = 0;
+  binHalf         = 0;
+  gzip            = 0;
+  gzipLevel       = 1;
+  flat            = 0;
 }
 
 //------------------------------------------------- constructor ----
@@ -185,8 +351,11 @@ inPar2_t::~inPar2_t()
   if ( trgFile )
     free(trgFile);
 
-  if ( inFile )
-    free(inFile);
+  if ( manifestFile )
+    free(manifestFile);
+
+  if ( sampleIdRule )
+    free(sampleIdRule);
 
   if ( fullTxFile )
     free(fullTxFile);
@@ -197,9 +366,40 @@ inPar2_t::~inPar2_t()
   if ( treeFile )
     free(treeFile);
 
+  if ( traceFile )
+    free(traceFile);
+
+  if ( traceTaxa )
+    free(traceTaxa);
+
+  if ( marginsFile )
+    free(marginsFile);
+
+  if ( metricsFile )
+    free(metricsFile);
+
+  if ( regionsFile )
+    free(regionsFile);
+
+  if ( mate2File )
+    free(mate2File);
+
+  if ( fwdPrimer )
+    free(fwdPrimer);
+
+  if ( revPrimer )
+    free(revPrimer);
+
+  if ( serveSocket )
+    free(serveSocket);
+
   int n = trgFiles.size();
   for ( int i = 0; i < n; ++i )
     free(trgFiles[i]);
+
+  n = inFiles.size();
+  for ( int i = 0; i < n; ++i )
+    free(inFiles[i]);
 }
 
 //------------------------------------------------------- print ----
@@ -225,9 +425,17 @@ void inPar2_t::print()
   else
     cerr << "MISSING" << endl;
 
-  cerr << "inFile=\t\t";
-  if ( inFile )
-    cerr << inFile << endl;
+  cerr << "inFiles=\t";
+  int n = inFiles.size();
+  for ( int i = 0; i < n; ++i )
+    cerr << inFiles[i] << "\t";
+  if ( !n )
+    cerr << "MISSING";
+  cerr << endl;
+
+  cerr << "manifestFile=\t";
+  if ( manifestFile )
+    cerr << manifestFile << endl;
   else
     cerr << "MISSING" << endl;
 
@@ -250,7 +458,7 @@ void inPar2_t::print()
     cerr << "MISSING" << endl;
 
   cerr << "trgFiles:\t";
-  int n = trgFiles.size();
+  n = trgFiles.size();
   for ( int i = 0; i < n; ++i )
     cerr << trgFiles[i] << "\t";
   cerr << endl;
@@ -264,19 +472,187 @@ void inPar2_t::print()
   cerr << "skipErrThld: " << skipErrThld << endl;
 }
 
+//================================================= sample_t ====
+//! input fasta file of a sample and its classification statistics
+typedef struct
+{
+  char *name;       /// sample name
+  char *inFile;     /// fasta file of the sample
+  char *mate2File;  /// R2 file of a paired-end sample whose R1 file is inFile; NULL for single reads
+  char *outDir;     /// directory of the sample's output files
+  char *traceFile;  /// trace file of the sample; NULL if there is no trace
+  char *marginsFile;/// margins file of the sample; NULL if there is none
+  char *error;      /// description of an input error; NULL if there was none
+  FILE *inFp;       /// if not NULL, the sequences are read from it instead of inFile
+  FILE *outFp;      /// if not NULL, the results are written to it instead of outDir
+  int nReads;       /// number of classified reads
+  int nLeaves;      /// number of reads classified to a leaf of the reference tree
+  int nTrimmed;     /// number of reads from which all given primers were removed
+  int nPartial;     /// number of reads from which only one of the two primers was removed
+  int nUntrimmed;   /// number of reads in which no primer was found; mates of a pair count as two reads
+  int nDegraded;    /// number of reads over the --read-budget scored by the degraded path
+  vector<int> regionReads; /// number of reads routed to each region of --regions
+  double runTime;   /// classification time in seconds
+} sample_t;
+
+//================================================= region_t ====
+//! models of one amplicon region of --regions
+typedef struct
+{
+  char *name;
+  char *mcDir;
+  MarkovChains2_t *probModel; /// NULL until loadRegion() is called for the first read of the region
+  decisionTree_t *dt;
+} region_t;
+
+//================================================= regions_t ====
+//! model sets of --regions and the router assigning reads to them
+typedef struct
+{
+  vector<region_t> sets;
+  regionRouter_t *router;
+  int wordLen;               /// max word length of the models of the regions
+  pthread_mutex_t lock;      /// guards loading of the models
+} regions_t;
+
+//================================================= mate_t ====
+//! one read of a pair as scored by the walk of a paired-end sample
+typedef struct
+{
+  const char *seq;  /// strand of the read that is scored
+  int len;
+  int *kmers;       /// k-mer indices of an ACGT read from kmerIndices(); NULL for other reads
+  int nKmers;       /// number of kmers
+  bool degraded;    /// if true, the read is scored by log10probSkipAmb()
+  bool skip;        /// if true, the read has no k-mer that can be scored and is left out
+} mate_t;
+
+//------------------------------------------------------- pairLog10prob ----
+/// normalized log10 probability of a read pair given the modelIdx-th
+/// model: the log10 probabilities of the mates are added and divided by
+/// the total length of the mates, which keeps the score on the per-base
+/// scale of a single read that the thresholds and error curves are for
+inline double pairLog10prob( MarkovChains2_t *probModel, const mate_t *mates, int modelIdx )
+{
+  double lp = 0;
+  int len = 0;
+
+  for ( int m = 0; m < 2; m++ )
+  {
+    const mate_t &mate = mates[m];
+    if ( mate.skip )
+      continue;
+
+    if ( mate.kmers )
+      lp += probModel->log10probKmers( mate.kmers, mate.nKmers, modelIdx );
+    else if ( mate.degraded )
+      lp += probModel->log10probSkipAmb( mate.seq, mate.len, modelIdx );
+    else
+      lp += probModel->log10prob( mate.seq, mate.len, modelIdx );
+    len += mate.len;
+  }
+
+  return lp / len;
+}
+
+//-------------------------------------------------------- countTrimmed ----
+/// adds a read from which found of nPrimers primers were removed to the
+/// trimming statistics of sample
+inline void countTrimmed( sample_t *sample, int found, int nPrimers )
+{
+  if ( found >= nPrimers )
+    sample->nTrimmed++;
+  else if ( found )
+    sample->nPartial++;
+  else
+    sample->nUntrimmed++;
+}
+
+//================================================= batch_t ====
+//! samples shared by the threads of the batch mode
+typedef struct
+{
+  const inPar2_t *inPar;
+  MarkovChains2_t *probModel;
+  const decisionTree_t *dt;
+  regions_t *regions;        /// model sets of --regions; NULL if not given
+  const flatScorer_t *flat;  /// leaf table of --flat; NULL if not given
+  vector<sample_t> *samples;
+  int next;                  /// index of the next sample to classify
+  int maxOpenFiles;          /// max number of open files of each writer set
+  bool showProgress;
+  const sampleIdRule_t *sampleIdRule;
+  countTable_t *counts;      /// sample x taxon counts; NULL if not requested
+  runMetrics_t *metrics;     /// run statistics; NULL if not requested
+  pthread_mutex_t lock;      /// guards next, counts, metrics and stderr
+} batch_t;
+
+//================================================= server_t ====
+//! state shared by the threads of the --serve mode
+typedef struct
+{
+  const inPar2_t *inPar;
+  MarkovChains2_t *probModel;
+  const decisionTree_t *dt;
+  int listenFd;              /// listening socket
+  int maxOpenFiles;
+  int nRequests;             /// number of requests received so far
+  pthread_mutex_t lock;      /// guards nRequests and stderr
+} server_t;
+
 //============================== local sub-routines =========================
 void parseArgs( int argc, char ** argv, inPar2_t *p );
+void classifySample( const inPar2_t *inPar, MarkovChains2_t *probModel,
+		     const decisionTree_t &dt, sample_t *sample,
+		     int maxOpenFiles, bool showProgress, countTable_t *counts,
+		     runMetrics_t *metrics, regions_t *regions, const flatScorer_t *flat );
+void *batchWorker( void *arg );
+void serve( const inPar2_t *inPar, MarkovChains2_t *probModel, const decisionTree_t &dt );
+void *serveWorker( void *arg );
+void serveClient( server_t *srv, int fd );
+void serveExit( int sig );
+void addSample( vector<sample_t> &samples, const char *file, const char *name, const char *mate2=NULL );
+void readManifest( const char *file, vector<sample_t> &samples );
+void checkSampleNames( vector<sample_t> &samples );
+void freeSample( sample_t &sample );
+char *sampleFile( const char *file, const sample_t &sample, bool batch, bool gz );
+bool reverseStrand( MarkovChains2_t *probModel, const decisionTree_t &dt,
+		    const char *seq, const char *rcseq, int seqLen, int order );
+bool sameMate( const char *id1, const char *id2 );
+void prepareMate( MarkovChains2_t *probModel, mate_t &mate, const char *seq, int len,
+		  bool degraded, int nKmers, int *kmers );
+void printSummary( const char *file, vector<sample_t> &samples );
+string resultsFile( const char *outDir, int order, bool bin, bool gz=false );
+unsigned long long runFingerprint( const inPar2_t *inPar, MarkovChains2_t *probModel,
+				   const decisionTree_t &dt );
+bool loadCheckpoint( const inPar2_t *inPar, sample_t *sample, FILE *in,
+		     const string &file, checkpoint_t &ckpt );
+void saveCheckpoint( const string &file, checkpoint_t &ckpt, FILE *out, resultsWriter_t *resWriter,
+		     seqReader_t *reader, long records, long leaves, int complete );
+int taxonWriter( fileWriters_t &writers, vector<int> &writerIdx,
+		 const char *outDir, const decisionTree_t &dt, int node,
+		 const char *suffix, const char *mode );
+void printNCprobQuantiles( vector<kllSketch_t> &sketches, const decisionTree_t &dt,
+			   const char *outDir, const char *suffix );
+MarkovChains2_t *loadModels( const inPar2_t *inPar, char *mcDir, vector<char *> &trgFiles,
+			     char *&treeFile, vector<int> &kMerLens, decisionTree_t &dt,
+			     double *times );
+int mcWordLen( const char *mcDir );
+regions_t *readRegions( const char *file );
+void loadRegion( const inPar2_t *inPar, regions_t *regions, int r );
+void printRegionReads( const regions_t *regions, const sample_t &sample, const char *prefix );
 bool dComp (double i, double j) { return (i>j); }
 
 //============================== main ======================================
 int main(int argc, char **argv)
 {
-  #define DEBUGMAIN 0
-  #define DEBUGMAIN1 0
-
   struct timeval  tvStart, tvCurrent;
   gettimeofday(&tvStart, NULL);
 
+  // wall-clock times of the start-up phases reported by --metrics
+  double tRun = monotonicTime();
+  double tPhase, errTablesTime = 0, modelLoadTime, treeLoadTime;
+
   //-- setting up init parameters
   inPar2_t *inPar = new inPar2_t();
 
@@ -292,7 +668,7 @@ int main(int argc, char **argv)
     free( inPar->trgFile );
   }
 
-  if ( !inPar->inFile && !inPar->seqID )
+  if ( !inPar->inFiles.size() && !inPar->manifestFile && !inPar->seqID && !inPar->serveSocket )
   {
     cout << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__ << ": Input fasta file is missing. Please specify it with the -i flag." << endl;
     printHelp(argv[0]);
@@ -301,11 +677,21 @@ int main(int argc, char **argv)
 
   if ( inPar->outDir )
   {
-    string cmd("mkdir -p ");
-    cmd += string(inPar->outDir);
-    system(cmd.c_str());
+    mkDir( inPar->outDir );
+
+    if ( inPar->nShards ) // read by mergeResults
+    {
+      string file = string(inPar->outDir) + string("/shard.txt");
+      FILE *out = fOpen(file.c_str(), "w");
+      fprintf(out, "shard\t%d\nshards\t%d\n", inPar->shardIdx, inPar->nShards);
+      if ( inPar->manifestFile )
+	fprintf(out, "manifest\t%s\n", inPar->manifestFile);
+      for ( int i = 0; i < (int)inPar->inFiles.size(); i++ )
+	fprintf(out, "input\t%s\n", inPar->inFiles[i]);
+      fclose(out);
+    }
   }
-  else
+  else if ( !inPar->serveSocket && !inPar->toStdout )
   {
     cout << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__ << ": Output directory is missing. Please specify it with the -o flag." << endl;
     printHelp(argv[0]);
@@ -334,19 +720,356 @@ int main(int argc, char **argv)
   }
 
 
+  if ( !inPar->mcDir && !inPar->trgFile && !inPar->regionsFile )
+  {
+    cout << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__ << ": Please specify a directory with MC model files using -d flag." << endl;
+    printHelp(argv[0]);
+    exit(1);
+  }
+
+  decisionTree_t dt;
+  MarkovChains2_t *probModel = NULL;
+  regions_t *regions = NULL; // NULL unless --regions is given
+  int wordLen;
+
+  if ( inPar->regionsFile )
+  {
+    // only the signatures of the regions are read here; their models are
+    // loaded by the worker that sees the first read of the region
+    regions = readRegions( inPar->regionsFile );
+    wordLen = regions->wordLen;
+    modelLoadTime = treeLoadTime = 0;
+  }
+  else
+  {
+    double loadTimes[3] = { 0, 0, 0 };
+    probModel = loadModels( inPar, inPar->mcDir, inPar->trgFiles, inPar->treeFile,
+			    inPar->kMerLens, dt, loadTimes );
+    errTablesTime = loadTimes[0];
+    modelLoadTime = loadTimes[1];
+    treeLoadTime  = loadTimes[2];
+    wordLen = inPar->kMerLens[0];
+  }
+
+  if ( inPar->ckptInterval || inPar->resume )
+    inPar->fingerprint = runFingerprint( inPar, probModel, dt );
+
+  if ( inPar->serveSocket )
+    serve( inPar, probModel, dt ); // does not return
+
+  //-- samples to classify
+  vector<sample_t> samples;
+  if ( inPar->manifestFile )
+    readManifest( inPar->manifestFile, samples );
+
+  int nInFiles = inPar->inFiles.size();
+  for ( int i = 0; i < nInFiles; i++ )
+    addSample( samples, inPar->inFiles[i], NULL, inPar->mate2File );
+
+  int nSamples = samples.size();
+  bool batch = ( nSamples > 1 || inPar->manifestFile );
+
+  checkSampleNames( samples );
+
+  bool paired = false;
+  for ( int i = 0; i < nSamples; i++ )
+    if ( samples[i].mate2File )
+      paired = true;
+
+  if ( paired && ( inPar->orientAuto || inPar->regionsFile || inPar->dimProbs || inPar->nShards ||
+		   inPar->ckptInterval || inPar->resume || inPar->flat ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": paired-end samples cannot be combined with --orient auto, --regions, -a, --shard, --checkpoint,\n"
+	 << "--resume or --flat" << endl;
+    exit(1);
+  }
+
+  // one table of the leaf models shared by all samples
+  flatScorer_t *flat = NULL;
+  if ( inPar->flat )
+  {
+    flat = new flatScorer_t( probModel, dt );
+    cerr << "--- Flat scoring of " << flat->size() << " species models with a "
+	 << ( flat->bytes() + (1 << 20) - 1 ) / (1 << 20) << " MB table" << endl;
+  }
+
+  // a single input file is processed as before: all output goes to
+  // outDir; in the batch mode each sample gets its own subdirectory
+  for ( int i = 0; i < nSamples; i++ )
+  {
+    sample_t &sample = samples[i];
+
+    if ( batch )
+    {
+      string dir = string(inPar->outDir) + string("/") + string(sample.name);
+      STRDUP(sample.outDir, dir.c_str());
+      mkDir( sample.outDir );
+    }
+    else if ( inPar->outDir )
+    {
+      STRDUP(sample.outDir, inPar->outDir);
+    }
+
+    if ( inPar->toStdout )
+      sample.outFp = stdout;
+
+    if ( inPar->traceFile )
+      sample.traceFile = sampleFile( inPar->traceFile, sample, batch, inPar->gzip );
+
+    if ( inPar->marginsFile )
+      sample.marginsFile = sampleFile( inPar->marginsFile, sample, batch, inPar->gzip );
+  }
+
+  int nThreads = inPar->nThreads;
+  if ( nThreads <= 0 )
+    nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if ( nThreads > nSamples )
+    nThreads = nSamples;
+  if ( nThreads < 1 )
+    nThreads = 1;
+
+  // the limit on open files is shared by the threads, each of which has
+  // two sets of writers
+  int maxOpenFiles;
+  {
+    fileWriters_t probe;
+    maxOpenFiles = probe.maxOpen() / ( 2 * nThreads );
+    if ( maxOpenFiles < 1 )
+      maxOpenFiles = 1;
+  }
+
+  if ( batch )
+    cerr << "--- Classifying " << nSamples << " samples using " << nThreads
+	 << ( nThreads > 1 ? " threads" : " thread" ) << endl;
+
+  char *stdoutBuf = NULL; // results are passed on in blocks of this size
+  if ( inPar->toStdout )
+  {
+    MALLOC(stdoutBuf, char*, 64*1024 * sizeof(char));
+    setvbuf(stdout, stdoutBuf, _IOFBF, 64*1024);
+  }
+
+  sampleIdRule_t sampleIdRule( inPar->sampleIdRule );
+  countTable_t *counts = NULL;
+  if ( inPar->countTbl )
+    counts = new countTable_t( dt, sampleIdRule );
+
+  runMetrics_t *metrics = NULL;
+  if ( inPar->metricsFile )
+  {
+    metrics = new runMetrics_t( dt );
+    metrics->modelLoad = modelLoadTime;
+    metrics->treeLoad  = treeLoadTime;
+    metrics->errTables = errTablesTime;
+    metrics->threads   = nThreads;
+  }
+
+  batch_t bt;
+  bt.inPar        = inPar;
+  bt.probModel    = probModel;
+  bt.dt           = &dt;
+  bt.regions      = regions;
+  bt.flat         = flat;
+  bt.samples      = &samples;
+  bt.next         = 0;
+  bt.maxOpenFiles = maxOpenFiles;
+  bt.showProgress = !batch;
+  bt.sampleIdRule = &sampleIdRule;
+  bt.counts       = counts;
+  bt.metrics      = metrics;
+  pthread_mutex_init(&bt.lock, NULL);
+
+  tPhase = monotonicTime();
+  if ( nThreads == 1 )
+  {
+    batchWorker( &bt );
+  }
+  else
+  {
+    pthread_t *threads;
+    MALLOC(threads, pthread_t*, nThreads * sizeof(pthread_t));
+
+    for ( int i = 0; i < nThreads; i++ )
+      if ( pthread_create(&threads[i], NULL, batchWorker, &bt) )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: cannot create thread\n", __FILE__, __LINE__);
+	exit(1);
+      }
+
+    for ( int i = 0; i < nThreads; i++ )
+      pthread_join(threads[i], NULL);
+
+    free(threads);
+  }
+
+  pthread_mutex_destroy(&bt.lock);
+
+  if ( metrics )
+    metrics->classification = monotonicTime() - tPhase;
+
+  if ( inPar->toStdout )
+  {
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IONBF, 0);
+    free(stdoutBuf);
+  }
+
+  string outFile = inPar->toStdout ? string("the standard output") : resultsFile( inPar->outDir, wordLen - 1, inPar->binResults, inPar->gzip );
+  if ( batch )
+  {
+    outFile = string(inPar->outDir) + string("/summary.txt");
+    printSummary( outFile.c_str(), samples );
+  }
+
+  if ( counts )
+  {
+    string file = string(inPar->outDir) + string("/spp_count_tbl.txt");
+    counts->printTbl( file.c_str() );
+
+    file = string(inPar->outDir) + string("/spp_count_tbl_triplets.txt");
+    counts->printTriplets( file.c_str() );
+
+    file = string(inPar->outDir) + string("/spp_count_tbl.biom");
+    counts->printBiom( file.c_str() );
+
+    if ( counts->nUnmatched() )
+      fprintf(stderr, "\nWARNING: %ld of %ld read IDs do not match the sample ID rule; they are not counted\n",
+	      counts->nUnmatched(), counts->nReads());
+
+    delete counts;
+  }
+
+  for ( int i = 0; i < nSamples; i++ )
+    freeSample( samples[i] );
+
+  if ( flat )
+    delete flat;
+
+  if ( metrics )
+  {
+    metrics->total = monotonicTime() - tRun;
+    metrics->writeJson( inPar->metricsFile );
+    delete metrics;
+  }
+
+  int runTime;
+  int timeMin = 0;
+  int timeSec = 0;
+
+  // It may be a nice idea to report the number of species found
+
+  gettimeofday(&tvCurrent, NULL);
+  runTime = tvCurrent.tv_sec  - tvStart.tv_sec;
+
+  if ( runTime > 60 )
+  {
+    timeMin = runTime / 60;
+    timeSec = runTime % 60;
+  }
+  else
+  {
+    timeSec = runTime;
+  }
+  fprintf(stderr,"\r                                                                       \n");
+  fprintf(stderr,"    Elapsed time: %d:%02d                                              \n", timeMin, timeSec);
+
+  // fprintf(stderr,"\r--- Number of processed sequences: %d                                  \n", count);
+  // fprintf(stderr,"    Number of times rcseq had higher probabitity than seq: %d\n", rcseqCount);
+  // fprintf(stderr,"    Number of times rcseq had lower probabitity than seq: %d\n", seqCount);
+  //fprintf(stderr,"Output written to %s\n", outFile.c_str());
+  fprintf(stderr,"    Output written to %s\n", inPar->toStdout ? outFile.c_str() : inPar->outDir);
+
+  if ( batch )
+    fprintf(stderr,"    Summary written to %s\n", outFile.c_str());
+
+  if ( inPar->metricsFile )
+    fprintf(stderr,"    Metrics written to %s\n", inPar->metricsFile);
+
+  if ( inPar->countTbl )
+    fprintf(stderr,"    Sample x phylotype count tables written to %s/spp_count_tbl.*\n\n", inPar->outDir);
+  else if ( batch )
+    fprintf(stderr,"\n");
+  else if ( inPar->toStdout )
+    fprintf(stderr,"\n");
+  else if ( inPar->binResults )
+  {
+    fprintf(stderr,"\n    To create sample x phylotype count tables, run\n");
+    fprintf(stderr,"\n        resultsToText -i %s --count-tbl %s\n\n", outFile.c_str(), inPar->outDir);
+  }
+  else
+  {
+    fprintf(stderr,"\n    To create a sample x phylotype count table, run\n");
+    fprintf(stderr,"\n        count_tbl.pl -i %s -o %s/spp_count_tbl.txt\n\n", outFile.c_str(), inPar->outDir);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
+
+//--------------------------------------------------------- loadModels ----
+/// loads the models of mcDir (or builds them from trgFiles), their error
+/// tables and the reference tree, treeFile or <mcDir>/refTx.tree, which
+/// is compiled into dt. mcDir can also be a model bundle (see
+/// ModelBundle.hh), whose tables are used in place. kMerLens[0] is set to
+/// the word length of the models unless it is shorter. The times of
+/// loading the error tables, the models and the tree are added to
+/// times[0], times[1] and times[2].
+MarkovChains2_t *loadModels( const inPar2_t *inPar, char *mcDir, vector<char *> &trgFiles,
+			     char *&treeFile, vector<int> &kMerLens, decisionTree_t &dt,
+			     double *times )
+{
+  double tPhase;
   int nModels = 0;
 
-  if ( inPar->trgFiles.size() )
+  if ( trgFiles.size() )
   {
-    nModels = inPar->trgFiles.size();
+    nModels = trgFiles.size();
   }
 
+  // mapped for the life of the process; the models and the error tables
+  // point into it
+  modelBundle_t *bundle = NULL;
+  if ( mcDir && !trgFiles.size() && modelBundle_t::isBundle( mcDir ) )
+  {
+    tPhase = monotonicTime();
+    bundle = new modelBundle_t( mcDir );
+    times[1] += monotonicTime() - tPhase;
+  }
 
   map<string, errTbl_t *> modelErrTbl;
   map<string, double> thldTbl;
-  if ( inPar->mcDir ) // extracting number of models and k-mer size
+  if ( bundle )
+  {
+    nModels = bundle->nModels();
+
+    tPhase = monotonicTime();
+    if ( !inPar->skipErrThld )
+    {
+      for ( int i = 0; i < bundle->nThlds(); i++ )
+	thldTbl[string(bundle->thldId(i))] = bundle->thld(i);
+
+      for ( int i = 0; i < nModels; ++i )
+      {
+	errTbl_t *errObj = bundle->errTbl( i );
+	if ( !errObj )
+	  continue;
+	buildErrGrid( errObj, inPar->errGridRes, inPar->errGridTol );
+	modelErrTbl[ bundle->modelIds()[i] ] = errObj;
+      }
+    }
+    times[0] += monotonicTime() - tPhase;
+
+    int k = bundle->order() + 1;
+    if ( (kMerLens.size() && kMerLens[0] > k) )
+      kMerLens[0] = k;
+    else if ( !kMerLens.size() )
+      kMerLens.push_back(k);
+  }
+  else if ( mcDir ) // extracting number of models and k-mer size
   {
-    string inFile(inPar->mcDir);
+    string inFile(mcDir);
     inFile += "/modelIds.txt";
     FILE *in = fopen(inFile.c_str(), "r");
     // if ( !in )
@@ -362,10 +1085,11 @@ int main(int argc, char **argv)
       readLines(inFile.c_str(), modelIds);
       nModels = modelIds.size();
 
+      tPhase = monotonicTime();
       if ( !inPar->skipErrThld )
       {
 	// reading ncProbThlds.txt file
-	string file = string(inPar->mcDir) + string("/ncProbThlds.txt");
+	string file = string(mcDir) + string("/ncProbThlds.txt");
 	double **thlds;
 	int nrow, ncol;
 	char **rowNames;
@@ -386,33 +1110,9 @@ int main(int argc, char **argv)
 	// reading _error.txt files
 	for ( int i = 0; i < nModels; ++i )
 	{
-	  string file = string(inPar->mcDir) + string("/") + string(modelIds[i]) + string("_error.txt");
-	  double **errTbl;
-	  int nrow, ncol;
-	  int header = 0;
-	  readMatrix( file.c_str(), &errTbl, &nrow, &ncol, header );
-
-	  errTbl_t *errObj = new errTbl_t;
-	  errObj->errTbl = errTbl;
-	  errObj->nrow = nrow;
-
-	  if ( ncol != 2 )
-	  {
-	    fprintf(stderr, "ERROR in %s at line %d: errTbl should have two columns and ncol=%d", __FILE__, __LINE__, ncol);
-	    fprintf(stderr, "%s: \n", modelIds[i]);
-	    printDblTbl(errTbl, nrow, ncol);
-	    exit(1);
-	  }
-
-	  errObj->thld = errTbl[0][0];
-
-	  MALLOC(errObj->x, double*, nrow * sizeof(double));
-	  for ( int j = 0; j < nrow; ++j )
-	    errObj->x[j] = errTbl[j][0];
-
-	  errObj->xmax = errTbl[nrow-1][0];
-
-	  modelErrTbl[ modelIds[i] ] = errObj;
+	  string file = string(mcDir) + string("/") + string(modelIds[i]) + string("_error.txt");
+	  modelErrTbl[ modelIds[i] ] = readErrTbl( file.c_str() );
+	  buildErrGrid( modelErrTbl[ modelIds[i] ], inPar->errGridRes, inPar->errGridTol );
 
 	  // fprintf(stderr, "%s: \n", modelIds[i]);
 	  // printDblTbl(errTbl, nrow, ncol);
@@ -420,99 +1120,105 @@ int main(int argc, char **argv)
 	  // exit(1);
 	}
       }
+      times[0] += monotonicTime() - tPhase;
 
 
       for ( int i = 0; i < nModels; ++i )
 	free(modelIds[i]);
 
-      int k = 0;
-      char countStr[5];
-      sprintf(countStr,"%d",k);
-      string file = string(inPar->mcDir) + string("/MC") + string(countStr) + string(".log10cProb");
-
-      while ( exists( file.c_str() ) )
-      {
-	k++;
-	sprintf(countStr,"%d",k);
-	file = string(inPar->mcDir) + string("/MC") + string(countStr) + string(".log10cProb");
-      }
+      int k = mcWordLen( mcDir );
 
-      if ( (inPar->kMerLens.size() && inPar->kMerLens[0] > k) )
+      if ( (kMerLens.size() && kMerLens[0] > k) )
       {
-	inPar->kMerLens[0] = k;
+	kMerLens[0] = k;
       }
-      else if ( !inPar->kMerLens.size() )
+      else if ( !kMerLens.size() )
       {
-	//inPar->kMerLens.clear();
-	inPar->kMerLens.push_back(k);
+	//kMerLens.clear();
+	kMerLens.push_back(k);
       }
     } // end of if ( in )
     fclose(in);
   }
-  else if ( !inPar->mcDir && !inPar->trgFile )
-  {
-    cout << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__ << ": Please specify a directory with MC model files using -d flag." << endl;
-    printHelp(argv[0]);
-    exit(1);
-  }
 
+  tPhase = monotonicTime();
   NewickTree_t nt;
-  if ( inPar->treeFile ) // load ref tree
+  if ( treeFile ) // load ref tree
+  {
+    if ( !nt.loadTree(treeFile) )
+    {
+      fprintf(stderr,"Could not load Newick tree from %s\n", treeFile);
+      exit(EXIT_FAILURE);
+    }
+  }
+  else if ( bundle )
   {
-    if ( !nt.loadTree(inPar->treeFile) )
+    FILE *fp = fmemopen( (void *)bundle->tree(), strlen(bundle->tree()), "r" );
+    if ( !fp || !nt.loadTree(fp, mcDir) )
     {
-      fprintf(stderr,"Could not load Newick tree from %s\n", inPar->treeFile);
+      fprintf(stderr,"Could not load the Newick tree of %s\n", mcDir);
       exit(EXIT_FAILURE);
     }
+    fclose(fp);
   }
   else
   {
     // lets see if we can find ref tree in mcDir
     // refTx.tree
-    string trFile = string(inPar->mcDir) + "/refTx.tree";
-    STRDUP(inPar->treeFile, trFile.c_str());
+    string trFile = string(mcDir) + "/refTx.tree";
+    STRDUP(treeFile, trFile.c_str());
 
-    if ( !nt.loadTree(inPar->treeFile) )
+    if ( !nt.loadTree(treeFile) )
     {
       cout << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__ << ": reference tree Newick format file is missing. Please specify it with the -r flag." << endl;
-      printHelp(argv[0]);
       exit(1);
     }
   }
 
 
+  times[2] += monotonicTime() - tPhase;
+
   int depth = nt.getDepth();
   cerr << "--- Depth of the reference tree: " << depth << endl;
 
 
-  if ( inPar->kMerLens.size() == 0 )
+  if ( kMerLens.size() == 0 )
   {
     int kMers[] = {3};
     cerr << endl << "WARNING: Setting k-mer size to " << kMers[0] << endl;
     int n = sizeof(kMers) / sizeof(int);
     for ( int i = 0; i < n; ++i )
-      inPar->kMerLens.push_back(kMers[i]);
+      kMerLens.push_back(kMers[i]);
   }
 
   cerr << "--- Number of Models: " << nModels << endl;
 
-  int wordLen = inPar->kMerLens[0];
+  int wordLen = kMerLens[0];
 
   if ( inPar->verbose )
     cerr << "\rk=" << wordLen << "\n";
 
-  if ( inPar->mcDir && !inPar->trgFiles.size() )
-    cerr << "\r--- Reading conditional probabilities tables from " << inPar->mcDir << " ... ";
+  if ( mcDir && !trgFiles.size() )
+    cerr << "\r--- Reading conditional probabilities tables from " << mcDir << " ... ";
   else
     cerr << "\r--- Generating k-mer frequency tables for k=1:" << wordLen << " ... ";
 
 
+  tPhase = monotonicTime();
   MarkovChains2_t *probModel;
-  probModel = new MarkovChains2_t( wordLen-1,
-				   inPar->trgFiles,
-				   inPar->mcDir,
-				   inPar->maxNumAmbCodes,
-				   inPar->pseudoCountType );
+  if ( bundle )
+    probModel = new MarkovChains2_t( wordLen-1,
+				     bundle->modelIds(),
+				     bundle->log10cProbs(),
+				     bundle->nWords(),
+				     inPar->maxNumAmbCodes );
+  else
+    probModel = new MarkovChains2_t( wordLen-1,
+				     trgFiles,
+				     mcDir,
+				     inPar->maxNumAmbCodes,
+				     inPar->pseudoCountType );
+  times[1] += monotonicTime() - tPhase;
   cerr << "done" << endl;
 
   vector<char *> modelIds = probModel->modelIds();
@@ -532,112 +1238,521 @@ int main(int argc, char **argv)
 
   nt.modelIdx( modelStrIds );
 
-  char str[10];
-  sprintf(str,"%d",(wordLen-1));
+  // flat copy of the reference tree used by the classification walk
+  tPhase = monotonicTime();
+  dt.compile( nt, modelErrTbl );
+  times[2] += monotonicTime() - tPhase;
 
-  // ==== computing probabilities of each sequence of inFile to come from each of the MC models ====
-  string outFile = string(inPar->outDir) + string("/") + string("MC_order") + string(str) + string("_results.txt");
+  return probModel;
+}
 
-  #if DEBUGMAIN
-  string debugFile = string(inPar->outDir) + string("/") + string("debug_log.txt");
-  FILE *debugout = fOpen(debugFile.c_str(), "w");
-  #endif
+//---------------------------------------------------------- mcWordLen ----
+/// word length of the models of mcDir, that is the number of its
+/// MC<k>.log10cProb files
+int mcWordLen( const char *mcDir )
+{
+  int k = 0;
+  char countStr[5];
+  sprintf(countStr,"%d",k);
+  string file = string(mcDir) + string("/MC") + string(countStr) + string(".log10cProb");
 
-  #if DEBUGMAIN1
-  FILE *debugout = stderr;
-  #endif
+  while ( exists( file.c_str() ) )
+  {
+    k++;
+    sprintf(countStr,"%d",k);
+    file = string(mcDir) + string("/MC") + string(countStr) + string(".log10cProb");
+  }
 
-  // double *aLogOdds;
-  // MALLOC(aLogOdds, double*, depth * sizeof(double));
+  return k;
+}
 
-  vector<string> path; // decision path tranced from the root to the final node for each query sequence
-  char *id;
-  int count = 0;
-  //int depthCount;
-  string currentLabel;
-  double x[nModels]; // stores conditional probabilities p(x | M) for children of each node. the root node has 3 children
+//-------------------------------------------------------- readRegions ----
+/// reads the file of --regions; each non-empty line, that does not start
+/// with #, is either <region name><TAB><model directory> or <model
+/// directory>, in which case the region name is the directory's base
+/// name. Only the signatures of the regions are read; see loadRegion()
+regions_t *readRegions( const char *file )
+{
+  regions_t *regions = new regions_t;
+  regions->router  = new regionRouter_t();
+  regions->wordLen = 0;
+  pthread_mutex_init(&regions->lock, NULL);
 
-  FILE *out = fOpen(outFile.c_str(), "w");
-  FILE *in = fOpen(inPar->inFile, "r");
+  FILE *in = fOpen(file, "r");
 
-  int nRecs = numRecordsInFasta( inPar->inFile );
-  int q01 = 0;
+  char *line = NULL;
+  size_t lineAlloc = 0;
+  ssize_t len;
 
-  if ( nRecs > 1000 )
-    q01 = int(0.01 * nRecs);
+  while ( (len = getline(&line, &lineAlloc, in)) != -1 )
+  {
+    while ( len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '/') )
+      line[--len] = '\0';
 
-  pair<string, double> tx2score;
-  // vector< pair<string, double> > score; // quality score table taxonomy => score, where
-  //                                       // the score is a measure of uncertainty about
-  //                                       // classification of a given sequence to 'taxonomy'
+    if ( !len || line[0] == '#' )
+      continue;
 
-  int seqLen;
-  size_t alloc = 1024*1024;
-  char *data, *seq, *rcseq;
-  MALLOC(data, char*, alloc * sizeof(char));
-  MALLOC(seq, char*, alloc * sizeof(char));
-  MALLOC(rcseq, char*, alloc * sizeof(char));
-  //double x1, x2;
+    region_t region;
+    char *tab = strchr(line, '\t');
+    if ( tab )
+    {
+      *tab = '\0';
+      STRDUP(region.name, line);
+      STRDUP(region.mcDir, tab + 1);
+    }
+    else
+    {
+      const char *base = strrchr(line, '/');
+      STRDUP(region.name, base ? base + 1 : line);
+      STRDUP(region.mcDir, line);
+    }
+    region.probModel = NULL;
+    region.dt        = NULL;
 
-  double *probs;
-  MALLOC(probs, double*, alloc * sizeof(double));
+    for ( int i = 0; i < (int)regions->sets.size(); i++ )
+      if ( strcmp(regions->sets[i].name, region.name) == 0 )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: region %s appears twice in %s\n",
+		__FILE__, __LINE__, region.name, file);
+	exit(1);
+      }
 
-  map<string, vector<double> > txTrueNCProb;  // hash table assigning to each
-                                              // taxon a vector of normalized
-                                              // conditional probabilities that
-                                              // quary sequences achieve using
-                                              // max p(x|M) algorithm =
-                                              // classification to the taxon with
-                                              // the highest posterior
-                                              // probability
+    if ( modelBundle_t::isBundle( region.mcDir ) )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: the region signatures are read from model directories; %s is a model bundle\n",
+	      __FILE__, __LINE__, region.mcDir);
+      exit(1);
+    }
 
-  map<string, vector<double> > txFalseNCProb; // normalized conditional
-                                              // probabilities in cases when
-                                              // the taxon does not have the
-                                              // highest normalized conditional
-                                              // probability
+    int wordLen = mcWordLen( region.mcDir );
+    if ( wordLen <= ROUTE_ORDER )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %s has no models of order %d or higher\n",
+	      __FILE__, __LINE__, region.mcDir, ROUTE_ORDER);
+      exit(1);
+    }
+    if ( wordLen > regions->wordLen )
+      regions->wordLen = wordLen;
+
+    regions->router->add( region.name, region.mcDir );
+    regions->sets.push_back( region );
+  }
 
-  map<string, vector<char *> > txTrueID;      // hash table assigning to each
-                                              // taxon a vector of sequence IDs
-                                              // for sequnces with p(x|M) max
-                                              // for M the model associated
-                                              // with the given taxon
-  map<string, vector<char *> > txFalseID;     // same as above but for other sequences
+  free(line);
+  fclose(in);
 
+  if ( !regions->sets.size() )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s lists no regions\n", __FILE__, __LINE__, file);
+    exit(1);
+  }
 
-  //cerr << "nRecs=" << nRecs << "\tq01=" << q01 << endl;
-  cerr << "--- Number of sequences in " << inPar->inFile << ": " << nRecs << endl;
+  cerr << "--- Routing reads to " << regions->sets.size() << " regions:";
+  for ( int i = 0; i < (int)regions->sets.size(); i++ )
+    cerr << " " << regions->sets[i].name;
+  cerr << endl;
 
-  //int rcseqCount = 0; // number of times rcseq had higher probabitity than seq
-  //int seqCount = 0;   // number of times seq had higher probabitity than rcseq
+  return regions;
+}
 
-  int currentModelIdx = 0; // model index of the model, M, with the highest p( x | M )
-  int rank = probModel->order() + 1;
+//--------------------------------------------------------- loadRegion ----
+/// loads the models and the reference tree of the r-th region unless
+/// another thread has already done so
+void loadRegion( const inPar2_t *inPar, regions_t *regions, int r )
+{
+  pthread_mutex_lock(&regions->lock);
 
-  FILE *probsOut = NULL;
-  if ( inPar->dimProbs )
+  region_t &region = regions->sets[r];
+  if ( !region.probModel )
   {
-    string probsFile = string(inPar->outDir) + string("/") + string("condProbs.csv");
-    probsOut = fOpen(probsFile.c_str(), "w");
-    inPar->dimProbs = inPar->dimProbs - rank;
+    cerr << "\r--- Loading the models of region " << region.name << endl;
+
+    vector<char *> trgFiles;
+    vector<int> kMerLens;
+    char *treeFile = NULL; // <mcDir>/refTx.tree
+    double times[3] = { 0, 0, 0 };
+
+    region.dt = new decisionTree_t();
+    region.probModel = loadModels( inPar, region.mcDir, trgFiles, treeFile, kMerLens,
+				   *region.dt, times );
+    free(treeFile);
+  }
+
+  pthread_mutex_unlock(&regions->lock);
+}
+
+//--------------------------------------------------- printRegionReads ----
+/// prints to stderr the numbers of reads of sample routed to each region
+void printRegionReads( const regions_t *regions, const sample_t &sample, const char *prefix )
+{
+  fprintf(stderr, "%s", prefix);
+  for ( int i = 0; i < (int)regions->sets.size(); i++ )
+    fprintf(stderr, " %s %d", regions->sets[i].name, sample.regionReads[i]);
+  fprintf(stderr, "\n");
+}
+
+//-------------------------------------------------------- taxonWriter ----
+/// returns the index of <outDir>/<label><suffix> in writers, where
+/// label is the label of the given node of dt, registering the file
+/// when it is seen for the first time
+int taxonWriter( fileWriters_t &writers, vector<int> &writerIdx,
+		 const char *outDir, const decisionTree_t &dt, int node,
+		 const char *suffix, const char *mode )
+{
+  if ( writerIdx[node] >= 0 )
+    return writerIdx[node];
+
+  string file = string(outDir) + string("/") + string(dt[node].label) + string(suffix);
+  writerIdx[node] = writers.add( file.c_str(), mode );
+
+  return writerIdx[node];
+}
+
+//----------------------------------------------- printNCprobQuantiles ----
+/// writes to <outDir>/<tx><suffix> a table of quantiles of normalized
+/// conditional probabilities of taxon tx
+void printNCprobQuantiles( vector<kllSketch_t> &sketches, const decisionTree_t &dt,
+			   const char *outDir, const char *suffix )
+{
+  static const double prob[] = { 0, 0.001, 0.005, 0.01, 0.025, 0.05,
+				 0.1, 0.15, 0.2, 0.25, 0.3, 0.35, 0.4, 0.45, 0.5,
+				 0.55, 0.6, 0.65, 0.7, 0.75, 0.8, 0.85, 0.9,
+				 0.95, 0.975, 0.99, 0.995, 0.999, 1 };
+  const int probLen = sizeof(prob) / sizeof(prob[0]);
+  double q[probLen];
+
+  int n = sketches.size();
+  for ( int i = 0; i < n; i++ )
+  {
+    if ( !sketches[i].n() )
+      continue;
+
+    string file = string(outDir) + string("/") + string(dt[i].label) + string(suffix);
+    FILE *out = fOpen(file.c_str(), "w");
+
+    sketches[i].quantiles( prob, probLen, q );
+
+    fprintf(out, "# n=%ld\n", sketches[i].n());
+    fprintf(out, "p\tncProb\n");
+    for ( int j = 0; j < probLen; j++ )
+      fprintf(out, "%g\t%f\n", prob[j], q[j]);
+
+    fclose(out);
+  }
+}
+
+
+// codes of long options without a short equivalent
+enum {
+  ERR_GRID_RES = 256,
+  ERR_GRID_TOL,
+  TRACE,
+  TRACE_TAXA,
+  MARGINS,
+  METRICS,
+  ORIENT,
+  ORIENT_ORDER_OPT,
+  FWD_PRIMER,
+  REV_PRIMER,
+  PRIMER_ERRORS,
+  PRIMER_OFFSET,
+  MANIFEST,
+  THREADS,
+  SAMPLE_ID_RULE,
+  SERVE,
+  CHECKPOINT,
+  SHARD,
+  REGIONS,
+  GZIP_LEVEL,
+  READ_BUDGET_OPT,
+  MATE2
+};
+
+#define CKPT_INTERVAL 1000000 // reads between checkpoints of --resume without --checkpoint
+
+//----------------------------------------------------- classifySample ----
+/// classifies all sequences of sample->inFile (or sample->inFp) writing
+/// the results to sample->outDir (or sample->outFp); sampleModel and
+/// sampleDt are only read, so that several samples can be classified at
+/// the same time. If regions is not NULL, each read is classified with the
+/// models and tree of its region instead. If flat is not NULL, each read is
+/// assigned to the best of all leaves of sampleDt without walking the tree.
+void classifySample( const inPar2_t *inPar, MarkovChains2_t *sampleModel,
+		     const decisionTree_t &sampleDt, sample_t *sample,
+		     int maxOpenFiles, bool showProgress, countTable_t *counts,
+		     runMetrics_t *metrics, regions_t *regions, const flatScorer_t *flat )
+{
+  struct timeval  tvStart, tvCurrent;
+  gettimeofday(&tvStart, NULL);
+
+  int nNodes = sampleDt.size();
+
+  // ==== computing probabilities of each sequence of inFile to come from each of the MC models ====
+  char *id;
+  int count = 0;
+  double *x; // stores conditional probabilities p(x | M) for children of each node
+  int xAlloc = nNodes > 1 ? nNodes : 1;
+  if ( flat && flat->stride() > xAlloc )
+    xAlloc = flat->stride();
+  MALLOC(x, double*, xAlloc * sizeof(double));
+
+  // regions of --regions whose models have been seen loaded by this sample
+  vector<bool> regionLoaded;
+  if ( regions )
+  {
+    regionLoaded.assign( regions->sets.size(), false );
+    sample->regionReads.assign( regions->sets.size(), 0 );
+  }
+
+  FILE *in = sample->inFp ? sample->inFp : fOpen(sample->inFile, "r");
+
+  // with --checkpoint or --resume the results file is fsynced every
+  // ckptInterval reads and the progress is recorded in <results>.ckpt
+  int order = regions ? regions->wordLen - 1 : sampleModel->order();
+  string outFile = sample->outFp ? string("") : resultsFile( sample->outDir, order, inPar->binResults, inPar->gzip );
+  string ckptFile;
+  checkpoint_t ckpt;
+  bool resumed = false;
+  long ckptInterval = 0;
+  if ( inPar->ckptInterval || inPar->resume )
+  {
+    ckptFile = outFile + string(".ckpt");
+    resumed  = loadCheckpoint( inPar, sample, in, ckptFile, ckpt );
+
+    ckptInterval = inPar->ckptInterval;
+    if ( !ckptInterval )
+      ckptInterval = resumed ? ckpt.interval : CKPT_INTERVAL;
+    ckpt.interval = ckptInterval;
+
+    if ( resumed && ckpt.complete )
+    {
+      if ( !sample->inFp )
+	fclose(in);
+      free(x);
+
+      sample->nReads  = ckpt.records;
+      sample->nLeaves = ckpt.leaves;
+      sample->runTime = 0;
+
+      if ( showProgress )
+	fprintf(stderr, "\r--- All %ld sequences of %s were classified before\n", ckpt.records, sample->inFile);
+      return;
+    }
+  }
+
+  FILE *out = sample->outFp;
+  if ( !out && resumed )
+  {
+    // the results written after the checkpoint are dropped
+    out = fOpen(outFile.c_str(), "r+");
+    if ( ftruncate(fileno(out), ckpt.outBytes) != 0 || fseeko(out, 0, SEEK_END) != 0 )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: Cannot truncate %s: %s\n",
+	      __FILE__, __LINE__, outFile.c_str(), strerror(errno));
+      exit(1);
+    }
+  }
+  else if ( !out && inPar->gzip )
+  {
+    // compressed by a thread of the stream in 1MB blocks
+    out = gzWriteOpen(outFile.c_str(), "w", inPar->gzipLevel);
+  }
+  else if ( !out )
+  {
+    out = fOpen(outFile.c_str(), "w");
+  }
+
+  resultsWriter_t *resWriter = NULL; // NULL unless --bin-results is given
+  if ( inPar->binResults )
+    resWriter = new resultsWriter_t( out, sampleDt, !inPar->binNoIds, inPar->binHalf, resumed );
+
+  // progress is reported as the fraction of the input file consumed, so
+  // that the input does not have to be read twice and can be a pipe
+  off_t inSize = 0; // size of a regular input file; 0 if unknown
+  if ( showProgress )
+  {
+    struct stat st;
+    if ( fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) )
+      inSize = st.st_size;
+  }
+
+  pair<string, double> tx2score;
+  // vector< pair<string, double> > score; // quality score table taxonomy => score, where
+  //                                       // the score is a measure of uncertainty about
+  //                                       // classification of a given sequence to 'taxonomy'
+
+  // plain or gzip compressed FASTA or FASTQ; read in its own thread
+  seqReader_t *reader = new seqReader_t( in, sample->inFile );
+
+  // R2 of a paired-end sample, read in step with R1
+  seqReader_t *reader2 = sample->mate2File ? new seqReader_t( sample->mate2File ) : NULL;
+
+  // single-end reads are scored from the base codes the reader writes
+  // while parsing them
+  reader->encode( reader2 == NULL );
+
+  off_t inBase = 0; // offset of the first read of the shard
+  if ( inPar->nShards )
+  {
+    if ( !reader->shard( inPar->shardIdx, inPar->nShards ) )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: --shard requires an uncompressed input file; %s is not one\n",
+	      __FILE__, __LINE__, sample->inFile);
+      exit(1);
+    }
+    inBase = reader->offset();
+    inSize /= inPar->nShards;
+  }
+
+  int seqLen;
+  char *seq;
+  size_t alloc = 1024*1024;
+  size_t rcAlloc = 1024;
+  char *rcseq;
+  MALLOC(rcseq, char*, rcAlloc * sizeof(char));
+  signed char *rcCodes = NULL; // base codes of rcseq
+  size_t rcCodesAlloc = 0;
+
+  char *id2;
+  int seqLen2 = 0;
+  char *seq2 = NULL;
+  char *rcseq2 = NULL;       // reverse complement of R2
+  size_t rc2Alloc = 0;
+  int *kmers[2] = { NULL, NULL }; // k-mer indices of the mates
+  size_t kmerAlloc = 0;
+  mate_t mates[2];
+  //double x1, x2;
+
+  double *probs = NULL; // log10 conditional probabilities at each position of a read; only with -a
+
+  vector<kllSketch_t> txTrueNCProb;           // node index => quantile sketch
+  if ( inPar->printNCprobs )                  // of normalized conditional
+    txTrueNCProb.resize(nNodes);              // probabilities that quary
+                                              // sequences achieve using max
+                                              // p(x|M) algorithm =
+                                              // classification to the taxon
+                                              // with the highest posterior
+                                              // probability
+
+  vector<kllSketch_t> txFalseNCProb;          // normalized conditional
+  if ( inPar->printNCprobs )                  // probabilities in cases when
+    txFalseNCProb.resize(nNodes);             // the taxon does not have the
+                                              // highest normalized conditional
+                                              // probability
+
+  int gzLevel = inPar->gzip ? inPar->gzipLevel : 0;
+  fileWriters_t seqIdsWriters(maxOpenFiles, 64*1024, gzLevel);  // buffered handles of <tx>_true_seq.ids files
+  vector<int> seqIdsWriterIdx(nNodes, -1);    // node index => index of its file in seqIdsWriters
+
+  fileWriters_t ncProbsWriters(maxOpenFiles, 64*1024, gzLevel); // buffered handles of raw <tx>_(true|false)_ncProbs.txt
+  vector<int> txTrueNCProbIdx(nNodes, -1);    // files; written only with --dump-nc-probs
+  vector<int> txFalseNCProbIdx(nNodes, -1);
+
+
+  int currentModelIdx = 0; // model index of the model, M, with the highest p( x | M )
+
+  // with -a the conditional probabilities of the positions of each read
+  // are written as a row of the float32 matrix condProbs.npy, truncated or
+  // padded with 0s to dimProbs - rank columns; its read IDs go to condProbs_ids.txt
+  int dimProbs = 0;
+  npyWriter_t *probsOut = NULL;
+  FILE *probsIds = NULL;
+  float *probsRow = NULL;
+  if ( inPar->dimProbs )
+  {
+    int rank = sampleModel->order() + 1;
+    dimProbs = inPar->dimProbs - rank;
+    if ( dimProbs < 1 )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: -a %d leaves no positions after the first %d of each read\n",
+	      __FILE__, __LINE__, inPar->dimProbs, rank);
+      exit(1);
+    }
+
+    string probsFile = string(sample->outDir) + string("/") + string("condProbs.npy");
+    probsOut = new npyWriter_t( probsFile.c_str(), dimProbs );
+
+    probsFile = string(sample->outDir) + string("/") + string("condProbs_ids.txt");
+    if ( gzLevel )
+      probsIds = gzWriteOpen((probsFile + string(".gz")).c_str(), "w", gzLevel);
+    else
+      probsIds = fOpen(probsFile.c_str(), "w");
+
+    MALLOC(probs, double*, alloc * sizeof(double));
+    MALLOC(probsRow, float*, dimProbs * sizeof(float));
   }
 
+  long errGridChecks = 0;     // number of grid lookups checked with --check-err-grid
+  long errGridMismatches = 0; // number of them that deviated by more than errGridTol
+
   int runTime;
   int timeMin = 0;
   int timeSec = 0;
   int perc;
 
-  #define SPPDEBUG 1
-  #if SPPDEBUG
-  FILE *liout = fOpen("spp_pprob.csv", "w");
-  #endif
+  sample->nLeaves = 0;
+
+  primerTrimmer_t *trimmer = NULL; // NULL unless a primer is given
+  if ( inPar->fwdPrimer || inPar->revPrimer )
+    trimmer = new primerTrimmer_t( inPar->fwdPrimer, inPar->revPrimer,
+				   inPar->primerErrors, inPar->primerOffset );
+
+  readTrace_t *trace = NULL; // NULL unless --trace is given
+  if ( sample->traceFile )
+    trace = new readTrace_t( sample->traceFile, sampleDt, inPar->traceTaxa, gzLevel );
+
+  readMargins_t *margins = NULL; // NULL unless --margins is given
+  if ( sample->marginsFile )
+    margins = new readMargins_t( sample->marginsFile, sampleDt, gzLevel );
 
-  while ( getNextFastaRecord( in, id, data, alloc, seq, seqLen) )
+  if ( resumed )
   {
-    if ( q01 && (count % q01) == 0 )
+    // a mapped input is continued at the checkpoint's offset; any other
+    // input is read up to it
+    if ( !reader->seek( ckpt.offset ) )
     {
-      perc = (int)( (100.0*count) / nRecs);
+      while ( count < ckpt.records && reader->next( id, seq, seqLen ) )
+	count++;
 
+      if ( count < ckpt.records || reader->offset() != ckpt.offset )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: %s does not match the input of %s\n",
+		__FILE__, __LINE__, sample->inFile, ckptFile.c_str());
+	exit(1);
+      }
+    }
+
+    count           = ckpt.records;
+    sample->nLeaves = ckpt.leaves;
+
+    if ( showProgress )
+      fprintf(stderr, "--- Resuming after %ld sequences\n", ckpt.records);
+  }
+
+  while ( reader->next( id, seq, seqLen ) )
+  {
+    if ( sample->outFp && ferror(out) ) // the client of --serve has gone away
+      break;
+
+    if ( reader2 )
+    {
+      string err;
+      if ( !reader2->next( id2, seq2, seqLen2 ) )
+	err = reader2->error() ? string(reader2->error()) :
+	  string(sample->mate2File) + string(" has fewer reads than ") + string(sample->inFile);
+      else if ( !sameMate( id, id2 ) )
+	err = string("mates ") + string(id) + string(" and ") + string(id2) + string(" of ") +
+	  string(sample->inFile) + string(" and ") + string(sample->mate2File) + string(" do not match");
+
+      if ( err.size() )
+      {
+	STRDUP(sample->error, err.c_str());
+	break;
+      }
+    }
+
+    if ( showProgress && (count % 1000) == 0 )
+    {
       gettimeofday(&tvCurrent, NULL);
       runTime = tvCurrent.tv_sec  - tvStart.tv_sec;
 
@@ -650,312 +1765,1132 @@ int main(int argc, char **argv)
       {
 	timeSec = runTime;
       }
-      fprintf(stderr,"\r%d:%02d  %d [%02d%%]", timeMin, timeSec, count, perc);
+      if ( inSize )
+      {
+	perc = (int)( (100.0*(reader->bytesRead() - inBase)) / inSize );
+	fprintf(stderr,"\r%d:%02d  %d [%02d%%]", timeMin, timeSec, count, perc);
+      }
+      else
+      {
+	fprintf(stderr,"\r%d:%02d  %d", timeMin, timeSec, count);
+      }
     }
     count++;
 
-    if ( inPar->revComp )
+    double tScore = metrics ? monotonicTime() : 0;
+
+    const signed char *codes = reader->codes(); // NULL for paired-end reads
+    const char *seqStart = seq;
+
+    // the mates of a pair are trimmed, and counted, as two reads
+    if ( trimmer )
     {
+      countTrimmed( sample, trimmer->trim( seq, seqLen ), trimmer->nPrimers() ); // moves seq past the primer
+      if ( reader2 )
+	countTrimmed( sample, trimmer->trim( seq2, seqLen2 ), trimmer->nPrimers() );
+
+      if ( codes )
+	codes += seq - seqStart;
+    }
+
+    if ( inPar->revComp || inPar->orientAuto )
+    {
+      if ( (size_t)seqLen >= rcAlloc )
+      {
+	rcAlloc = 2 * seqLen;
+	free(rcseq);
+	MALLOC(rcseq, char*, rcAlloc * sizeof(char));
+      }
+
       for ( int j = 0; j < seqLen; ++j )
 	rcseq[j] = Complement(seq[seqLen-1-j]);
       rcseq[seqLen] = '\0';
     }
 
-    // traverse the reference tree at each node making a choice of a model
-    // and checking log odds of the best model, M, against 'not-M' model
+    // R2 is read from the other strand; it is reverse complemented unless R1 is
+    const char *walkSeq2 = seq2;
+    if ( reader2 && !inPar->revComp )
+    {
+      if ( (size_t)seqLen2 >= rc2Alloc )
+      {
+	rc2Alloc = 2 * seqLen2 + 1;
+	free(rcseq2);
+	MALLOC(rcseq2, char*, rc2Alloc * sizeof(char));
+      }
 
-    NewickNode_t *node = nt.root();
-    int numChildren = node->children_m.size();
-    //path.clear();
-    //path.push_back( node->label );
-    double err = 0;
-    int breakLoop = 0;
+      for ( int j = 0; j < seqLen2; ++j )
+	rcseq2[j] = Complement(seq2[seqLen2-1-j]);
+      rcseq2[seqLen2] = '\0';
+      walkSeq2 = rcseq2;
+    }
 
+    // with --regions the read is scored with the models of its region
+    int region = -1;
+    if ( regions )
+    {
+      region = regions->router->route( inPar->revComp ? rcseq : seq,
+				       inPar->orientAuto ? rcseq : NULL, seqLen );
+      sample->regionReads[region]++;
 
-#if DEBUGMAIN
-    fprintf(debugout,"---- depth %d\n",depthCount++) ;
-    for ( int i = 0; i < numChildren; i++ )
-      fprintf(debugout,"\t%s\t%f\t%f\n", node->children_m[i]->label.c_str(), x[i], x2[i]) ;
-      ##fprintf(debugout,"\t%s\t%f\n", node->children_m[i]->label.c_str(), x[i]) ;
-#endif
+      if ( !regionLoaded[region] )
+      {
+	loadRegion( inPar, regions, region );
+	regionLoaded[region] = true;
 
-#if DEBUGMAIN1
-    fprintf(debugout,"\n---- Processing %s\n",id) ;
-    fprintf(debugout,"---- Current node %s\n", node->label.c_str()) ;
-    fprintf(debugout,"---- Number of children: %d\n", numChildren) ;
-    fprintf(debugout,"---- Children:\n") ;
-    for ( int i = 0; i < numChildren; i++ )
-	fprintf(debugout,"\t%s\n", node->children_m[i]->label.c_str()) ;
-#endif
+	int n = regions->sets[region].dt->size();
+	if ( n > xAlloc )
+	{
+	  xAlloc = n;
+	  free(x);
+	  MALLOC(x, double*, xAlloc * sizeof(double));
+	}
+      }
+    }
 
-    double y[2];
-    y[0] = 0;
-    y[1] = 0;
+    MarkovChains2_t *probModel = region < 0 ? sampleModel : regions->sets[region].probModel;
+    const decisionTree_t &dt = region < 0 ? sampleDt : *regions->sets[region].dt;
 
-    //score.clear();
-    //int depthCount = 1;
-    while ( numChildren && !breakLoop )
+    // strand of the read scored by the walk
+    bool reverse = inPar->revComp ||
+      ( inPar->orientAuto && reverseStrand( probModel, dt, seq, rcseq, seqLen, inPar->orientOrder ) );
+    const char *walkSeq = reverse ? rcseq : seq;
+
+    if ( metrics )
+      metrics->orientation[ reverse ]++;
+
+    // the complement of code c is 3 - c
+    const signed char *walkCodes = codes;
+    if ( codes && reverse )
     {
-      // compute model probabilities for seq and rcseq
-      // NOTE: after a few iterations only seq or rcseq should be processed !!!
-      for ( int i = 0; i < numChildren; i++ )
+      if ( (size_t)seqLen >= rcCodesAlloc )
       {
-	#if 0
-	double x1 = probModel->normLog10prob(seq, seqLen, (node->children_m[i])->model_idx );
-	double x2 = probModel->normLog10prob(rcseq, seqLen, (node->children_m[i])->model_idx );
-	x[i] = ( x1 > x2 ) ? x1 : x2;
-	if ( x2 > x1 ) rcseqCount++; else seqCount++;
-	#endif
-
-	if ( inPar->revComp )
-	{
-	  x[i] = probModel->normLog10prob(rcseq, seqLen, (node->children_m[i])->model_idx );
-	}
-	else
-	{
-	  x[i] = probModel->normLog10prob(seq, seqLen, (node->children_m[i])->model_idx );
-	}
+	rcCodesAlloc = 2 * seqLen + 1;
+	free(rcCodes);
+	MALLOC(rcCodes, signed char*, rcCodesAlloc * sizeof(signed char));
+      }
 
-	if ( (node->children_m[i])->label=="g_Lactobacillus" )
-	{
-	  y[0] = x[i];
-	}
+      for ( int j = 0; j < seqLen; ++j )
+      {
+	signed char c = codes[seqLen-1-j];
+	rcCodes[j] = c < 0 ? c : 3 - c;
+      }
+      walkCodes = rcCodes;
+    }
 
-	if ( (node->children_m[i])->label=="g_Pediococcus" )
+    // cost of the read: log10prob() follows every expansion of its
+    // ambiguity codes. Reads over the budget, or with more codes than
+    // log10probIUPAC() accepts, are scored on their ACGT k-mers only and
+    // flagged; a read without any such k-mer stays at the root
+    int nAmbCodes, nKmers;
+    double paths = probModel->expandedPaths( walkSeq, seqLen, &nAmbCodes, &nKmers );
+    bool degraded = nAmbCodes > probModel->maxNumAmbCodes() || paths * seqLen > inPar->readBudget;
+    bool scorable = !degraded || nKmers;
+    int bases = seqLen;
+
+    // both mates of a pair are scored at each node; the k-mer indices of
+    // an ACGT mate are computed here once for all model evaluations
+    if ( reader2 )
+    {
+      size_t maxLen = seqLen > seqLen2 ? seqLen : seqLen2;
+      if ( maxLen > kmerAlloc )
+      {
+	kmerAlloc = 2 * maxLen;
+	for ( int m = 0; m < 2; m++ )
 	{
-	  y[1] = x[i];
+	  free(kmers[m]);
+	  MALLOC(kmers[m], int*, kmerAlloc * sizeof(int));
 	}
+      }
 
-	#if 0
-	if ( (node->children_m[i])->label=="g_Lactobacillus" )
-	{
-	  //errTbl_t *errObj = modelErrTbl[ (node->children_m[i])->label ];
-	  //fprintf(liout,"---- Evaluating MC model of %s\tLogPostProb: %f\terrThld: %f\n", (node->children_m[i])->label.c_str(), x[i], errObj->thld);
-	  fprintf(liout,"%s,%f\n", id, x[i]);
-	}
-	#endif
+      int nAmbCodes2, nKmers2;
+      double paths2 = probModel->expandedPaths( walkSeq2, seqLen2, &nAmbCodes2, &nKmers2 );
+      bool degraded2 = nAmbCodes2 > probModel->maxNumAmbCodes() || paths2 * seqLen2 > inPar->readBudget;
 
-	#if DEBUGMAIN1
-	errTbl_t *errObj = modelErrTbl[ (node->children_m[i])->label ];
-	fprintf(debugout,"---- Evaluating MC model of %s\tLogPostProb: %f\terrThld: %f\n", (node->children_m[i])->label.c_str(), x[i], errObj->thld);
-	//fprintf(debugout,"---- Evaluating MC model of %s\tclErr: %f\tOrientation used: %s\n", (node->children_m[i])->label.c_str(), x[i], ( x1 > x2 ) ? "seq" : "rcSeq") ;
-	#endif
+      prepareMate( probModel, mates[0], walkSeq, seqLen, degraded, nKmers, kmers[0] );
+      prepareMate( probModel, mates[1], walkSeq2, seqLen2, degraded2, nKmers2, kmers[1] );
+
+      degraded  = degraded || degraded2;
+      scorable  = !mates[0].skip || !mates[1].skip;
+      nAmbCodes += nAmbCodes2;
+      if ( paths2 > paths )
+	paths = paths2;
+      bases += seqLen2;
+    }
+
+    if ( degraded )
+      sample->nDegraded++;
+
+    // the k-mer indices of a single-end ACGT read are computed once from
+    // its base codes for all model evaluations; they give the values of
+    // log10prob(), which scores reads shorter than the model order, and
+    // reads with ambiguity codes, by log10probIUPAC()
+    int nWalkKmers = -1;
+    if ( walkCodes && !degraded && seqLen >= probModel->order() + 1 )
+    {
+      if ( (size_t)seqLen > kmerAlloc )
+      {
+	kmerAlloc = 2 * seqLen;
+	free(kmers[0]);
+	MALLOC(kmers[0], int*, kmerAlloc * sizeof(int));
       }
 
+      nWalkKmers = probModel->kmerIndices( walkCodes, seqLen, kmers[0] );
+    }
+
+    // traverse the reference tree at each node making a choice of a model
+    // and checking log odds of the best model, M, against 'not-M' model
+
+    int node = dt.root();
+    int numChildren = scorable ? dt[node].numChildren : 0;
+    double err = 0;
+    int breakLoop = 0;
+    long evals = 0; // number of models evaluated for the read
+    const char *lineage = NULL; // with --flat, the lineage of the best leaf
+
+    // with --flat all leaves are scored from one pass over the k-mers of
+    // the read and the walk below is skipped
+    if ( flat && numChildren )
+    {
+      int nLeaves = flat->size();
+      evals = nLeaves;
+      if ( metrics )
+	metrics->flatEvals += nLeaves;
+
+      if ( (size_t)seqLen > kmerAlloc )
+      {
+	kmerAlloc = 2 * seqLen;
+	free(kmers[0]);
+	MALLOC(kmers[0], int*, kmerAlloc * sizeof(int));
+      }
+
+      int n = nWalkKmers;
+      if ( n < 0 && !degraded )
+	n = probModel->kmerIndices( walkSeq, seqLen, kmers[0] );
+      if ( n >= 0 )
+      {
+	flat->score( kmers[0], n, x );
+	for ( int j = 0; j < nLeaves; j++ )
+	  x[j] /= seqLen;
+      }
+      else if ( degraded )
+	for ( int j = 0; j < nLeaves; j++ )
+	  x[j] = probModel->normLog10probSkipAmb( walkSeq, seqLen, dt[flat->leaf(j)].model_idx );
+      else
+	for ( int j = 0; j < nLeaves; j++ )
+	  x[j] = probModel->normLog10prob( walkSeq, seqLen, dt[flat->leaf(j)].model_idx );
+
+      int jmax = which_max( x, nLeaves );
+      node = flat->leaf(jmax);
+      lineage = flat->lineage(jmax);
+      currentModelIdx = dt[node].model_idx;
+
+      if ( !inPar->skipErrThld )
+	err = x[jmax] > dt[node].thld ? dt.error( node, x[jmax] ) : 1;
+
+      numChildren = 0;
+    }
+
+    if ( trace )
+      trace->begin( id );
+
+    while ( numChildren && !breakLoop )
+    {
+      int firstChild = dt[node].firstChild;
+
+      if ( metrics )
+	metrics->nodeVisits[node]++;
+      evals += numChildren;
+
+      if ( reader2 )
+	for ( int i = 0; i < numChildren; i++ )
+	  x[i] = pairLog10prob( probModel, mates, dt[firstChild + i].model_idx );
+      else if ( degraded )
+	for ( int i = 0; i < numChildren; i++ )
+	  x[i] = probModel->normLog10probSkipAmb(walkSeq, seqLen, dt[firstChild + i].model_idx );
+      else if ( nWalkKmers >= 0 )
+	for ( int i = 0; i < numChildren; i++ )
+	  x[i] = probModel->log10probKmers( kmers[0], nWalkKmers, dt[firstChild + i].model_idx ) / seqLen;
+      else
+	for ( int i = 0; i < numChildren; i++ )
+	  x[i] = probModel->normLog10prob(walkSeq, seqLen, dt[firstChild + i].model_idx );
+
       int imax = which_max( x, numChildren );
-      currentModelIdx = (node->children_m[imax])->model_idx;
+
+      if ( trace )
+	for ( int i = 0; i < numChildren; i++ )
+	  trace->step( firstChild + i, x[i], i == imax );
+      currentModelIdx = dt[firstChild + imax].model_idx;
 
       if ( inPar->printNCprobs )
       {
-	txTrueNCProb[node->children_m[imax]->label].push_back(x[imax]);
-	txTrueID[node->children_m[imax]->label].push_back(id);
+	txTrueNCProb[firstChild + imax].update(x[imax]);
 	for ( int i = 0; i < numChildren; i++ )
 	  if ( i != imax )
-	  {
-	    txFalseNCProb[node->children_m[i]->label].push_back(x[i]);
-	    txFalseID[node->children_m[i]->label].push_back(id);
-	  }
+	    txFalseNCProb[firstChild + i].update(x[i]);
+
+	if ( inPar->dumpNCprobs )
+	{
+	  int w = taxonWriter( ncProbsWriters, txTrueNCProbIdx, sample->outDir,
+			       dt, firstChild + imax, "_true_ncProbs.txt", "w" );
+	  fprintf(ncProbsWriters.fp(w), "%f\n", x[imax]);
+
+	  for ( int i = 0; i < numChildren; i++ )
+	    if ( i != imax )
+	    {
+	      w = taxonWriter( ncProbsWriters, txFalseNCProbIdx, sample->outDir,
+			       dt, firstChild + i, "_false_ncProbs.txt", "w" );
+	      fprintf(ncProbsWriters.fp(w), "%f\n", x[i]);
+	    }
+	}
 
-	string file1 = string(inPar->outDir) + string("/") + node->children_m[imax]->label + string("_true_seq.ids");
-	FILE *out1 = fOpen(file1.c_str(), "a");
-	fprintf(out1, "%s\n", id);
-	fclose(out1);
+	int w = taxonWriter( seqIdsWriters, seqIdsWriterIdx, sample->outDir,
+			     dt, firstChild + imax, "_true_seq.ids", "a" );
+	fprintf(seqIdsWriters.fp(w), "%s\n", id);
 
 	for ( int i = 0; i < numChildren; i++ )
 	  if ( i != imax )
 	  {
-	    string file2 = string(inPar->outDir) + string("/") + node->children_m[i]->label + string("_true_seq.ids");
-	    FILE *out2 = fOpen(file2.c_str(), "a");
-	    fprintf(out2, "%s\n", id);
-	    fclose(out2);
+	    w = taxonWriter( seqIdsWriters, seqIdsWriterIdx, sample->outDir,
+			     dt, firstChild + i, "_true_seq.ids", "a" );
+	    fprintf(seqIdsWriters.fp(w), "%s\n", id);
 	  }
       }
 
-      node = node->children_m[imax];
+      node = firstChild + imax;
 
       if ( !inPar->skipErrThld )
       {
-	errTbl_t *errObj = modelErrTbl[ node->label ];
-
-	if ( x[imax] > errObj->thld )
+	if ( x[imax] > dt[node].thld )
 	{
-	  if ( x[imax] > errObj->xmax )
-	  {
-	    err = 0;
-	  }
-	  else
+	  err = dt.error( node, x[imax] );
+
+	  if ( inPar->checkErrGrid )
 	  {
-	    int ierr = bsearchDbl( errObj->x, errObj->nrow, x[imax] );
-	    err = errObj->errTbl[ierr][1];
+	    double exactErr = dt.exactError( node, x[imax] );
+	    errGridChecks++;
+	    if ( fabs( err - exactErr ) > inPar->errGridTol )
+	    {
+	      if ( errGridMismatches < 10 )
+		fprintf(stderr, "\nWARNING: error grid lookup of %s at %.10f returned %f; bsearchDbl() returned %f\n",
+			dt[node].label, x[imax], err, exactErr);
+	      errGridMismatches++;
+	    }
 	  }
 	}
 	else
 	{
-	  node = node->parent_m;
+	  node = dt[node].parent;
 	  breakLoop = 1;
+	}
+      }
+
+      if ( margins )
+	margins->level( id, firstChild, x, numChildren, imax, !breakLoop );
+
+      numChildren = dt[node].numChildren;
+    }
+
+    double tOutput = 0;
+    if ( metrics )
+    {
+      tOutput = monotonicTime();
+      metrics->scoring += tOutput - tScore;
+      metrics->reads++;
+      metrics->stopDepth[ dt[node].depth ]++;
+
+      // log10prob() falls back to log10probIUPAC() on any non-ACGT base
+      if ( degraded )
+      {
+	metrics->degradedReads++;
+	metrics->degradedEvals += evals;
+      }
+      else if ( paths > 1 )
+      {
+	metrics->iupacReads++;
+	metrics->iupacEvals += evals;
+      }
+
+      metrics->basesHist[ costBucket( bases ) ]++;
+      metrics->ambCodesHist[ costBucket( nAmbCodes ) ]++;
+      metrics->pathsHist[ costBucket( paths ) ]++;
+      metrics->usecHist[ costBucket( 1e6 * (tOutput - tScore) ) ]++;
+    }
+
+    if ( resWriter )
+      resWriter->add( id, node, err, degraded );
+    else if ( region >= 0 )
+      fprintf(out,"%s\t%s\t%.4f\t%s%s\n", id, dt[node].label, err, regions->sets[region].name,
+	      degraded ? "\tdegraded" : "");
+    else if ( flat )
+      fprintf(out,"%s\t%s\t%.4f\t%s%s\n", id, dt[node].label, err, lineage ? lineage : "",
+	      degraded ? "\tdegraded" : "");
+    else
+      fprintf(out,"%s\t%s\t%.4f%s\n", id, dt[node].label, err, degraded ? "\tdegraded" : "");
+
+    if ( !dt[node].numChildren )
+      sample->nLeaves++;
+
+    if ( counts )
+    {
+      if ( counts->byFile() )
+	counts->addToSample( sample->name, node );
+      else
+	counts->add( id, node );
+    }
+
+    if ( trace )
+      trace->end( node, err );
+
+
+    // -----------------------------------------
+    // Printing conditional probabilities
+    // -----------------------------------------
+    if ( dimProbs )
+    {
+      if ( (size_t)seqLen > alloc )
+      {
+	alloc = 2 * seqLen;
+	free(probs);
+	MALLOC(probs, double*, alloc * sizeof(double));
+      }
+
+      // probs = vector of conditional probabilities at each position of the sequence given the modelIdx-th model
+      int k = probModel->log10probVect( walkSeq, seqLen, currentModelIdx, probs );
+
+      if ( k > dimProbs )
+	k = dimProbs;
+
+      // 10^x = e^(x ln 10) in single precision, which the compiler can
+      // unroll; the matrix is float32 anyway
+      const float ln10 = (float)M_LN10;
+      for ( int i = 0; i < k; i++ )
+	probsRow[i] = expf( (float)probs[i] * ln10 );
+
+      for ( int i = k; i < dimProbs; i++ )
+	probsRow[i] = 0;
+
+      probsOut->add( probsRow );
+      fprintf(probsIds, "%s\n", id);
+    }
+
+    if ( metrics )
+      metrics->output += monotonicTime() - tOutput;
+
+    if ( ckptInterval && (count % ckptInterval) == 0 )
+      saveCheckpoint( ckptFile, ckpt, out, resWriter, reader, count, sample->nLeaves, 0 );
+
+  } // end of   while ( reader->next( id, seq, seqLen ) )
+
+  if ( reader->error() && !sample->error ) // sample->error is set by mates that do not match
+    STRDUP(sample->error, reader->error());
+  else if ( ckptInterval )
+    saveCheckpoint( ckptFile, ckpt, out, resWriter, reader, count, sample->nLeaves, 1 );
+
+  if ( reader2 )
+  {
+    if ( !sample->error && reader2->next( id2, seq2, seqLen2 ) )
+    {
+      string err = string(sample->mate2File) + string(" has more reads than ") + string(sample->inFile);
+      STRDUP(sample->error, err.c_str());
+    }
+    delete reader2;
+  }
+
+  delete reader; // stops the reading thread before its stream is closed
+
+  if ( inPar->printNCprobs )
+  {
+    printNCprobQuantiles( txTrueNCProb, sampleDt, sample->outDir, "_true_ncProbQs.txt" );
+    printNCprobQuantiles( txFalseNCProb, sampleDt, sample->outDir, "_false_ncProbQs.txt" );
+  }
+
+  if ( inPar->checkErrGrid )
+    fprintf(stderr, "\r--- Error grid check (%s): %ld lookups, %ld mismatches\n",
+	    sample->name, errGridChecks, errGridMismatches);
+
+  seqIdsWriters.closeAll();
+  ncProbsWriters.closeAll();
+
+  if ( !sample->inFp )
+    fclose(in);
+
+  if ( resWriter )
+    delete resWriter; // writes the last block
+
+  if ( !sample->outFp )
+    fclose(out);
+
+  if ( trace )
+    delete trace;
+
+  if ( margins )
+    delete margins;
+
+  if ( probsOut )
+  {
+    delete probsOut; // writes the number of rows to the header
+    fclose(probsIds);
+    free(probsRow);
+  }
+
+  free(rcseq);
+  free(rcseq2);
+  free(rcCodes);
+  free(kmers[0]);
+  free(kmers[1]);
+  free(probs);
+  free(x);
+
+  sample->nReads = count;
+
+  if ( showProgress )
+    fprintf(stderr, "\r--- Number of sequences in %s: %d                    \n", sample->inFile, count);
+
+  if ( trimmer )
+  {
+    if ( showProgress )
+      fprintf(stderr, "--- Primers removed from %d reads, from %d partially; %d reads could not be trimmed\n",
+	      sample->nTrimmed, sample->nPartial, sample->nUntrimmed);
+    delete trimmer;
+  }
+
+  if ( regions && showProgress )
+    printRegionReads( regions, *sample, "--- Reads per region:" );
+
+  if ( sample->nDegraded && showProgress )
+    fprintf(stderr, "--- %d reads exceeded --read-budget or --max-num-amb-codes and were scored on their ACGT k-mers only\n",
+	    sample->nDegraded);
+
+  gettimeofday(&tvCurrent, NULL);
+  sample->runTime = ( tvCurrent.tv_sec - tvStart.tv_sec ) + 1e-6 * ( tvCurrent.tv_usec - tvStart.tv_usec );
+
+  if ( metrics )
+  {
+    metrics->samples++;
+    metrics->sampleTime += sample->runTime;
+    metrics->primers[0] += sample->nTrimmed;
+    metrics->primers[1] += sample->nPartial;
+    metrics->primers[2] += sample->nUntrimmed;
+  }
+}
+
+//----------------------------------------------------------- sameMate ----
+/// true if id1 and id2 are the IDs of the two mates of a pair: the same,
+/// or the same up to the /1 and /2 suffixes of the older Illumina headers
+bool sameMate( const char *id1, const char *id2 )
+{
+  if ( strcmp(id1, id2) == 0 )
+    return true;
+
+  int n = strlen(id1);
+  return n > 2 && (int)strlen(id2) == n && strncmp(id1, id2, n - 1) == 0 &&
+    id1[n-2] == '/' && id1[n-1] == '1' && id2[n-1] == '2';
+}
+
+//-------------------------------------------------------- prepareMate ----
+/// sets up mate for pairLog10prob(): an ACGT read that is not degraded
+/// gets its k-mer indices written to kmers, which has room for len of them
+void prepareMate( MarkovChains2_t *probModel, mate_t &mate, const char *seq, int len,
+		  bool degraded, int nKmers, int *kmers )
+{
+  mate.seq      = seq;
+  mate.len      = len;
+  mate.degraded = degraded;
+  mate.skip     = !len || ( degraded && !nKmers );
+  mate.kmers    = NULL;
+  mate.nKmers   = 0;
+
+  if ( !degraded )
+  {
+    int n = probModel->kmerIndices( seq, len, kmers );
+    if ( n >= 0 )
+    {
+      mate.kmers  = kmers;
+      mate.nKmers = n;
+    }
+  }
+}
+
+//------------------------------------------------------ reverseStrand ----
+/// true if rcseq, the reverse complement of seq, is the strand of the read
+/// matching the reference; the strand is the one with the higher
+/// log10prob of the best of the models of the children of the root,
+/// estimated with their order conditional probabilities over the first
+/// ORIENT_WINDOW bases of the read. Both strands of the window have the
+/// same k-mers, so their scores are comparable.
+bool reverseStrand( MarkovChains2_t *probModel, const decisionTree_t &dt,
+		    const char *seq, const char *rcseq, int seqLen, int order )
+{
+  const dtNode_t &root = dt[ dt.root() ];
+
+  // both strands of the same first bases of the read
+  int len = seqLen < ORIENT_WINDOW ? seqLen : ORIENT_WINDOW;
+  const char *rcWindow = rcseq + seqLen - len;
+
+  double fwdMax = -HUGE_VAL, rcMax = -HUGE_VAL;
+  for ( int i = 0; i < root.numChildren; i++ )
+  {
+    int model = dt[ root.firstChild + i ].model_idx;
+
+    double fwd = probModel->log10probLowOrder( seq, len, model, order );
+    if ( fwd > fwdMax )
+      fwdMax = fwd;
+
+    double rc = probModel->log10probLowOrder( rcWindow, len, model, order );
+    if ( rc > rcMax )
+      rcMax = rc;
+  }
+
+  return rcMax > fwdMax;
+}
+
+//-------------------------------------------------------- batchWorker ----
+/// classifies samples of a batch_t until there are none left
+void *batchWorker( void *arg )
+{
+  batch_t *bt = (batch_t *)arg;
+  int nSamples = bt->samples->size();
+
+  // counts of the thread's samples; merged into bt->counts at the end
+  countTable_t *counts = NULL;
+  if ( bt->counts )
+    counts = new countTable_t( *bt->dt, *bt->sampleIdRule );
+
+  runMetrics_t *metrics = NULL; // likewise merged into bt->metrics
+  if ( bt->metrics )
+    metrics = new runMetrics_t( *bt->dt );
+
+  while ( 1 )
+  {
+    pthread_mutex_lock(&bt->lock);
+    int i = bt->next++;
+    pthread_mutex_unlock(&bt->lock);
+
+    if ( i >= nSamples )
+      break;
+
+    sample_t *sample = &(*bt->samples)[i];
+    classifySample( bt->inPar, bt->probModel, *bt->dt, sample,
+		    bt->maxOpenFiles, bt->showProgress, counts, metrics, bt->regions, bt->flat );
+
+    if ( sample->error )
+    {
+      pthread_mutex_lock(&bt->lock);
+      fprintf(stderr, "\nERROR: %s\n", sample->error);
+      exit(1);
+    }
+
+    if ( !bt->showProgress )
+    {
+      pthread_mutex_lock(&bt->lock);
+      fprintf(stderr, "--- %s: %d reads classified in %.1f sec\n",
+	      sample->name, sample->nReads, sample->runTime);
+      if ( bt->inPar->fwdPrimer || bt->inPar->revPrimer )
+	fprintf(stderr, "    primers removed from %d reads, from %d partially; %d reads could not be trimmed\n",
+		sample->nTrimmed, sample->nPartial, sample->nUntrimmed);
+      if ( bt->regions )
+	printRegionReads( bt->regions, *sample, "    reads per region:" );
+      if ( sample->nDegraded )
+	fprintf(stderr, "    %d reads exceeded --read-budget or --max-num-amb-codes and were scored on their ACGT k-mers only\n",
+		sample->nDegraded);
+      pthread_mutex_unlock(&bt->lock);
+    }
+  }
 
-	  if ( node->label=="d_Bacteria" )
-	  break;
-	}
+  if ( counts )
+  {
+    pthread_mutex_lock(&bt->lock);
+    bt->counts->merge( *counts );
+    pthread_mutex_unlock(&bt->lock);
 
-        #if DEBUGMAIN1
-	fprintf(debugout,"xmax: %s\tLogPostProb=%f\tthld=%f\txmax=%f\terr=%f\n",
-		node->label.c_str(), x[imax], errObj->thld, errObj->xmax, err);
-        #endif
+    delete counts;
+  }
 
+  if ( metrics )
+  {
+    pthread_mutex_lock(&bt->lock);
+    bt->metrics->merge( *metrics );
+    pthread_mutex_unlock(&bt->lock);
 
-	//score.push_back( tx2score );
-      }
+    delete metrics;
+  }
 
-      // tx2score.first = node->label;
-      // tx2score.second = err;
+  return NULL;
+}
+
+static const char *serveSocketPath = NULL; // removed by serveExit()
 
-      //currentLabel = node->label;
-      //path.push_back( node->label );
-      numChildren = node->children_m.size();
+//-------------------------------------------------------------- serve ----
+/// classifies the requests sent to inPar->serveSocket (see UnixSocket.hh
+/// for the protocol) by inPar->nThreads threads, each serving one client
+/// at a time; the models and the decision tree are loaded only once, so
+/// that a request costs only the classification of its reads
+void serve( const inPar2_t *inPar, MarkovChains2_t *probModel, const decisionTree_t &dt )
+{
+  int nThreads = inPar->nThreads;
+  if ( nThreads <= 0 )
+    nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if ( nThreads < 1 )
+    nThreads = 1;
+
+  server_t srv;
+  srv.inPar     = inPar;
+  srv.probModel = probModel;
+  srv.dt        = &dt;
+  srv.nRequests = 0;
+  srv.listenFd  = unixListen( inPar->serveSocket, 64 );
+  pthread_mutex_init(&srv.lock, NULL);
+
+  serveSocketPath = inPar->serveSocket;
+  signal(SIGPIPE, SIG_IGN); // a client that disconnects must not kill the server
+  signal(SIGINT, serveExit);
+  signal(SIGTERM, serveExit);
+
+  fprintf(stderr, "--- Serving on %s using %d %s\n", inPar->serveSocket,
+	  nThreads, nThreads > 1 ? "threads" : "thread");
+
+  pthread_t *threads;
+  MALLOC(threads, pthread_t*, nThreads * sizeof(pthread_t));
+
+  for ( int i = 1; i < nThreads; i++ )
+    if ( pthread_create(&threads[i], NULL, serveWorker, &srv) )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: cannot create thread\n", __FILE__, __LINE__);
+      exit(1);
     }
 
-    fprintf(out,"%s\t%s\t%.4f\n", id, node->label.c_str(), err);
-    //fprintf(out,"%s\t%s\n", id, node->label.c_str());
-    //fprintf(out,"%s\t%s\t%.2f\n", id, tx2score.first.c_str(), tx2score.second);
+  serveWorker( &srv );
+}
+
+//--------------------------------------------------------- serveWorker ----
+/// accepts and serves clients of the --serve mode; never returns
+void *serveWorker( void *arg )
+{
+  server_t *srv = (server_t *)arg;
 
-    #if SPPDEBUG
-    if ( node->label=="f_Lactobacillaceae" )
+  while ( 1 )
+  {
+    int fd = accept(srv->listenFd, NULL, NULL);
+    if ( fd < 0 )
     {
-      fprintf(liout,"%s,%f,%f\n", id, y[0], y[1]);
+      if ( errno != EINTR && errno != ECONNABORTED )
+      {
+	pthread_mutex_lock(&srv->lock);
+	fprintf(stderr, "WARNING: accept() failed: %s\n", strerror(errno));
+	pthread_mutex_unlock(&srv->lock);
+      }
+      continue;
     }
-    #endif
 
+    serveClient( srv, fd );
+  }
 
-    // -----------------------------------------
-    // Printing conditional probabilities
-    // -----------------------------------------
-    if ( inPar->dimProbs )
-    {
-      // probs = vector of conditional probabilities at each position of the sequence, rcseq, given the modelIdx-th model
-      int k = probModel->log10probVect( rcseq, seqLen, currentModelIdx, probs );
+  return NULL;
+}
 
-      if ( k > inPar->dimProbs )
-	k = inPar->dimProbs;
+//--------------------------------------------------------- serveClient ----
+/// reads a request from the connected socket fd, writes the results back
+/// to it and closes it
+void serveClient( server_t *srv, int fd )
+{
+  FILE *in  = fdopen(fd, "r");
+  FILE *out = fdopen(dup(fd), "w");
+  if ( !in || !out )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: fdopen() failed\n", __FILE__, __LINE__);
+    exit(1);
+  }
 
-      int k1 = k-1;
-      fprintf(probsOut, "%s,", id);
-      for ( int i = 0; i < k1; i++ )
-	fprintf(probsOut, "%f,", pow(10, probs[i]));
-      fprintf(probsOut, "%.10f", pow(10, probs[k1]));
+  pthread_mutex_lock(&srv->lock);
+  int reqId = ++srv->nRequests;
+  pthread_mutex_unlock(&srv->lock);
 
-      if ( k < inPar->dimProbs )
-	for ( int i = k; i < inPar->dimProbs; i++ )
-	  fprintf(probsOut, ",0");
+  char *line = NULL;
+  size_t lineAlloc = 0;
+  ssize_t len = getline(&line, &lineAlloc, in);
 
-      fprintf(probsOut, "\n");
+  while ( len > 0 && (line[len-1] == '\n' || line[len-1] == '\r') )
+    line[--len] = '\0';
 
-      // fprintf(stderr, "\n\nk=%d\tdimProbs=%d\n", k, inPar->dimProbs);
-      // break;
-    }
+  FILE *fasta = NULL;
+  const char *file = NULL;
+  if ( len > 0 && strcmp(line, "FASTA") == 0 )
+  {
+    fasta = in;
+    file  = "-";
+  }
+  else if ( len > 5 && strncmp(line, "FILE ", 5) == 0 )
+  {
+    file  = line + 5;
+    fasta = fopen(file, "r");
+    if ( !fasta )
+      fprintf(out, "# ERROR cannot open %s: %s\n", file, strerror(errno));
+  }
+  else
+  {
+    fprintf(out, "# ERROR unknown request; expected FASTA or FILE <path>\n");
+  }
+
+  if ( fasta )
+  {
+    char name[32];
+    sprintf(name, "request_%d", reqId);
+
+    vector<sample_t> samples;
+    addSample( samples, file, name );
+    sample_t &sample = samples[0];
+    sample.inFp  = fasta;
+    sample.outFp = out;
+
+    classifySample( srv->inPar, srv->probModel, *srv->dt, &sample, 1, false, NULL, NULL, NULL, NULL );
+    if ( sample.error )
+      fprintf(out, "# ERROR %s\n", sample.error);
+    else
+      fprintf(out, "# END %d\n", sample.nReads);
+
+    pthread_mutex_lock(&srv->lock);
+    fprintf(stderr, "--- %s (%s): %d reads classified in %.3f sec\n",
+	    sample.name, file, sample.nReads, sample.runTime);
+    pthread_mutex_unlock(&srv->lock);
+
+    if ( fasta != in )
+      fclose(fasta);
+    freeSample( sample );
+  }
 
+  free(line);
+  fclose(out);
+  fclose(in);
+}
 
-  } // end of   while ( getNextFastaRecord( in, id, data, alloc, seq, seqLen) )
+//----------------------------------------------------------- serveExit ----
+/// SIGINT/SIGTERM handler of the --serve mode
+void serveExit( int sig )
+{
+  if ( serveSocketPath )
+    unlink(serveSocketPath);
+  _exit(0);
+}
 
-  if ( inPar->printNCprobs )
+//---------------------------------------------------------- addSample ----
+/// adds to samples the fasta file; if name is NULL, the sample name is
+/// the file's base name without the fasta/fastq and .gz extensions;
+/// file - is the standard input
+void addSample( vector<sample_t> &samples, const char *file, const char *name, const char *mate2 )
+{
+  sample_t sample;
+  sample.mate2File = mate2 ? strdup(mate2) : NULL;
+  sample.outDir    = NULL;
+  sample.traceFile = NULL;
+  sample.marginsFile = NULL;
+  sample.error     = NULL;
+  sample.inFp      = NULL;
+  sample.outFp     = NULL;
+  sample.nReads    = 0;
+  sample.nLeaves   = 0;
+  sample.nTrimmed  = 0;
+  sample.nPartial  = 0;
+  sample.nUntrimmed = 0;
+  sample.nDegraded = 0;
+  sample.runTime   = 0;
+  STRDUP(sample.inFile, file);
+
+  if ( strcmp(file, "-") == 0 )
+  {
+    sample.inFp = stdin;
+    if ( !name )
+      name = "stdin";
+  }
+
+  if ( name )
+  {
+    STRDUP(sample.name, name);
+  }
+  else
   {
-    map<string, vector<double> >::iterator it;
-    for ( it = txTrueNCProb.begin(); it != txTrueNCProb.end(); it++ )
+    const char *base = strrchr(file, '/');
+    base = base ? base + 1 : file;
+    STRDUP(sample.name, base);
+
+    int len = strlen(sample.name);
+    if ( len > 3 && strcmp(sample.name + len - 3, ".gz") == 0 )
+      sample.name[len -= 3] = '\0';
+
+    const char *exts[] = { ".fasta", ".fas", ".fna", ".fsa", ".fa", ".fastq", ".fq" };
+    int nExts = sizeof(exts) / sizeof(exts[0]);
+    for ( int i = 0; i < nExts; i++ )
     {
-      string file1 = string(inPar->outDir) + string("/") + it->first + string("_true_ncProbs.txt");
-      FILE *out1 = fOpen(file1.c_str(), "w");
-      int n = it->second.size();
-      for ( int i = 0; i < n; i++ )
-	fprintf(out1, "%f\n", it->second[i]);
-      fclose(out1);
+      int extLen = strlen(exts[i]);
+      if ( len > extLen && strcmp(sample.name + len - extLen, exts[i]) == 0 )
+      {
+	sample.name[len - extLen] = '\0';
+	break;
+      }
     }
+  }
+
+  samples.push_back(sample);
+}
+
+//------------------------------------------------------- readManifest ----
+/// reads a manifest file; each non-empty line, that does not start with
+/// '#', is either <fasta file>, <sample name><TAB><fasta file> or, for a
+/// paired-end sample, <sample name><TAB><R1 file><TAB><R2 file>
+void readManifest( const char *file, vector<sample_t> &samples )
+{
+  FILE *in = fOpen(file, "r");
+
+  char *line = NULL;
+  size_t lineAlloc = 0;
+  ssize_t len;
 
-    for ( it = txFalseNCProb.begin(); it != txFalseNCProb.end(); it++ )
+  while ( (len = getline(&line, &lineAlloc, in)) != -1 )
+  {
+    while ( len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ') )
+      line[--len] = '\0';
+
+    if ( !len || line[0] == '#' )
+      continue;
+
+    char *tab = strchr(line, '\t');
+    if ( tab )
     {
-      string file1 = string(inPar->outDir) + string("/") + it->first + string("_false_ncProbs.txt");
-      FILE *out1 = fOpen(file1.c_str(), "w");
-      int n = it->second.size();
-      for ( int i = 0; i < n; i++ )
-	fprintf(out1, "%f\n", it->second[i]);
-      fclose(out1);
+      *tab = '\0';
+      char *tab2 = strchr(tab + 1, '\t');
+      if ( tab2 )
+	*tab2 = '\0';
+      addSample( samples, tab + 1, line, tab2 ? tab2 + 1 : NULL );
     }
-
-    #if 0
-    map<string, vector<char *> >::iterator itr;
-    for ( itr = txTrueID.begin(); itr != txTrueID.end(); itr++ )
+    else
     {
-      string file1 = string(inPar->outDir) + string("/") + itr->first + string("_true_seq.ids");
-      FILE *out1 = fOpen(file1.c_str(), "w");
-      int n = itr->second.size();
-      for ( int i = 0; i < n; i++ )
-	fprintf(out1, "%s\n", itr->second[i]);
-      fclose(out1);
+      addSample( samples, line, NULL );
     }
+  }
+
+  free(line);
+  fclose(in);
+}
 
-    for ( itr = txFalseID.begin(); itr != txFalseID.end(); itr++ )
+//--------------------------------------------------- checkSampleNames ----
+/// exits if two samples have the same name
+void checkSampleNames( vector<sample_t> &samples )
+{
+  map<string, int> seen;
+  int n = samples.size();
+
+  for ( int i = 0; i < n; i++ )
+  {
+    string name(samples[i].name);
+    if ( seen.count(name) )
     {
-      string file1 = string(inPar->outDir) + string("/") + itr->first + string("_false_seq.ids");
-      FILE *out1 = fOpen(file1.c_str(), "w");
-      int n = itr->second.size();
-      for ( int i = 0; i < n; i++ )
-	fprintf(out1, "%s\n", itr->second[i]);
-      fclose(out1);
+      fprintf(stderr, "ERROR in %s at line %d: %s and %s have the same sample name %s\n",
+	      __FILE__, __LINE__, samples[seen[name]].inFile, samples[i].inFile, samples[i].name);
+      exit(1);
     }
-    #endif
+    seen[name] = i;
   }
+}
 
+//--------------------------------------------------------- sampleFile ----
+/// path of an optional per-sample output file given as file; in the
+/// batch mode it is the base name of file in the sample's output directory.
+/// If gz is true, .gz is appended unless file already ends with it
+char *sampleFile( const char *file, const sample_t &sample, bool batch, bool gz )
+{
+  string s(file);
 
-  fclose(in);
-  fclose(out);
+  if ( batch )
+  {
+    const char *base = strrchr(file, '/');
+    base = base ? base + 1 : file;
+    s = string(sample.outDir) + string("/") + string(base);
+  }
 
-#if DEBUGMAIN
-  fclose(debugout);
-#endif
+  if ( gz && ( s.size() < 3 || s.compare(s.size() - 3, 3, ".gz") != 0 ) )
+    s += string(".gz");
 
-  //fprintf(stderr,"\nNumber of errors: %d / %d (%.2f%%)\n\n", errorCount, nRecs, 100.0*errorCount / (double)nRecs );
+  char *path;
+  STRDUP(path, s.c_str());
 
+  return path;
+}
 
-  free(seq);
-  free(data);
+//--------------------------------------------------------- freeSample ----
+void freeSample( sample_t &sample )
+{
+  free(sample.name);
+  free(sample.inFile);
 
-  // It may be a nice idea to report the number of species found
+  if ( sample.mate2File )
+    free(sample.mate2File);
 
-  gettimeofday(&tvCurrent, NULL);
-  runTime = tvCurrent.tv_sec  - tvStart.tv_sec;
+  if ( sample.outDir )
+    free(sample.outDir);
 
-  if ( runTime > 60 )
+  if ( sample.traceFile )
+    free(sample.traceFile);
+
+  if ( sample.marginsFile )
+    free(sample.marginsFile);
+
+  if ( sample.error )
+    free(sample.error);
+}
+
+//------------------------------------------------------- printSummary ----
+/// writes a table of per-sample read counts and running times
+void printSummary( const char *file, vector<sample_t> &samples )
+{
+  FILE *out = fOpen(file, "w");
+
+  fprintf(out, "sample\tfile\treads\tleaf\tnonLeaf\tseconds\n");
+
+  int n = samples.size();
+  for ( int i = 0; i < n; i++ )
   {
-    timeMin = runTime / 60;
-    timeSec = runTime % 60;
+    sample_t &sample = samples[i];
+    fprintf(out, "%s\t%s\t%d\t%d\t%d\t%.2f\n", sample.name, sample.inFile,
+	    sample.nReads, sample.nLeaves, sample.nReads - sample.nLeaves, sample.runTime);
   }
-  else
+
+  fclose(out);
+}
+
+//-------------------------------------------------------- resultsFile ----
+/// path of the classification results file of the MC model of a given
+/// order; .mcr if the results are written in the binary format, .txt.gz
+/// if they are gzip compressed
+string resultsFile( const char *outDir, int order, bool bin, bool gz )
+{
+  char str[10];
+  sprintf(str, "%d", order);
+
+  return string(outDir) + string("/") + string("MC_order") + string(str) +
+    string(bin ? "_results.mcr" : gz ? "_results.txt.gz" : "_results.txt");
+}
+
+//----------------------------------------------------- runFingerprint ----
+/// fingerprint of everything that determines the classification of a
+/// read: the models, the reference tree with its error curves and the
+/// options changing the walk or the output; a run can only be resumed
+/// with the same fingerprint. The options are listed in the error message
+/// of loadCheckpoint()
+unsigned long long runFingerprint( const inPar2_t *inPar, MarkovChains2_t *probModel,
+				   const decisionTree_t &dt )
+{
+  unsigned long long h = probModel->fingerprint( FNV1A_INIT );
+  h = dt.fingerprint( h );
+
+  int opts[] = { inPar->revComp, inPar->orientAuto, inPar->orientOrder,
+		 inPar->skipErrThld, inPar->maxNumAmbCodes,
+		 inPar->shardIdx, inPar->nShards,
+		 inPar->binResults, inPar->binNoIds, inPar->binHalf,
+		 inPar->primerErrors, inPar->primerOffset };
+  h = fnv1a( opts, sizeof(opts), h );
+  h = fnv1a( &inPar->readBudget, sizeof(inPar->readBudget), h );
+  if ( inPar->flat )
+    h = fnv1a( "flat", 5, h );
+
+  const char *primers[] = { inPar->fwdPrimer, inPar->revPrimer };
+  for ( int i = 0; i < 2; i++ )
+    if ( primers[i] )
+      h = fnv1a( primers[i], strlen(primers[i]) + 1, h );
+    else
+      h = fnv1a( "", 1, h );
+
+  return h;
+}
+
+//----------------------------------------------------- loadCheckpoint ----
+/// sets ckpt to the state of a new classification of the sample; with
+/// --resume, replaces it with the checkpoint in file if there is one and
+/// it was written for the same input and models; returns true if it was
+/// loaded
+bool loadCheckpoint( const inPar2_t *inPar, sample_t *sample, FILE *in,
+		     const string &file, checkpoint_t &ckpt )
+{
+  ckpt.input      = string(sample->inFile);
+  ckpt.inputSize  = 0;
+  ckpt.inputMtime = 0;
+  ckpt.models     = inPar->fingerprint;
+  ckpt.interval   = 0;
+  ckpt.records    = 0;
+  ckpt.leaves     = 0;
+  ckpt.offset     = 0;
+  ckpt.outBytes   = 0;
+  ckpt.complete   = 0;
+
+  struct stat st;
+  if ( fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) )
   {
-    timeSec = runTime;
+    ckpt.inputSize  = st.st_size;
+    ckpt.inputMtime = st.st_mtime;
   }
-  fprintf(stderr,"\r                                                                       \n");
-  fprintf(stderr,"    Elapsed time: %d:%02d                                              \n", timeMin, timeSec);
 
-  // fprintf(stderr,"\r--- Number of processed sequences: %d                                  \n", count);
-  // fprintf(stderr,"    Number of times rcseq had higher probabitity than seq: %d\n", rcseqCount);
-  // fprintf(stderr,"    Number of times rcseq had lower probabitity than seq: %d\n", seqCount);
-  //fprintf(stderr,"Output written to %s\n", outFile.c_str());
-  fprintf(stderr,"    Output written to %s\n", inPar->outDir);
+  checkpoint_t saved;
+  if ( !inPar->resume || !readCheckpoint( file.c_str(), saved ) )
+  {
+    if ( inPar->resume )
+      fprintf(stderr, "--- No checkpoint of %s; starting from the beginning\n", sample->inFile);
+    return false;
+  }
 
-  fprintf(stderr,"\n    To create a sample x phylotype count table, run\n");
-  fprintf(stderr,"\n        count_tbl.pl -i %s -o %s/spp_count_tbl.txt\n\n", outFile.c_str(), inPar->outDir);
+  if ( saved.models != ckpt.models )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s was written with different models, reference tree or error curves,\n"
+	    "or with different values of one of --rev-comp, --orient, --orient-order, --skip-err-thld, --err-grid-res,\n"
+	    "--err-grid-tol, --max-num-amb-codes, --shard, --bin-results, --bin-no-ids, --bin-half, --fwd-primer,\n"
+	    "--rev-primer, --primer-errors, --primer-offset, --read-budget or --flat\n",
+	    __FILE__, __LINE__, file.c_str());
+    exit(1);
+  }
 
-  #if DEBUGMAIN
-  fprintf(stderr,"\n\nDEBUGING Output written to %s\n\n\n", debugFile.c_str());
-  #endif
+  if ( saved.inputSize != ckpt.inputSize || saved.inputMtime != ckpt.inputMtime )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s has changed since %s was written\n",
+	    __FILE__, __LINE__, sample->inFile, file.c_str());
+    exit(1);
+  }
 
-  #if SPPDEBUG
-  fprintf(stderr,"\n\nDEBUGING Output written to spp_pprob.csv\n\n");
-  #endif
+  struct stat outSt;
+  string outFile = file.substr(0, file.size() - 5); // without .ckpt
+  if ( stat(outFile.c_str(), &outSt) != 0 || outSt.st_size < saved.outBytes )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is missing or shorter than recorded in %s\n",
+	    __FILE__, __LINE__, outFile.c_str(), file.c_str());
+    exit(1);
+  }
 
-  return EXIT_SUCCESS;
+  ckpt = saved;
+
+  return true;
 }
 
+//----------------------------------------------------- saveCheckpoint ----
+/// flushes and fsyncs out and records in file that the first records
+/// reads, of which leaves were classified to a leaf, are in it; the
+/// buffered reads of resWriter, if any, are written as a block first
+void saveCheckpoint( const string &file, checkpoint_t &ckpt, FILE *out, resultsWriter_t *resWriter,
+		     seqReader_t *reader, long records, long leaves, int complete )
+{
+  if ( resWriter )
+    resWriter->flush();
+
+  if ( fflush(out) != 0 || fsync(fileno(out)) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write the results: %s\n",
+	    __FILE__, __LINE__, strerror(errno));
+    exit(1);
+  }
+
+  ckpt.records  = records;
+  ckpt.leaves   = leaves;
+  ckpt.offset   = reader->offset();
+  ckpt.outBytes = ftello(out);
+  ckpt.complete = complete;
 
+  writeCheckpoint( file.c_str(), ckpt );
+}
 
 //----------------------------------------------------------- parseArgs ----
 //! parse command line arguments
@@ -969,11 +2904,43 @@ void parseArgs( int argc, char ** argv, inPar2_t *p )
     //{"skip-err-thld"      ,no_argument, &p->skipErrThld,    1},
     {"skip-err-thld"      ,no_argument,       0,          'x'},
     {"max-num-amb-codes"  ,required_argument, 0,          'b'},
+    {"read-budget"        ,required_argument, 0, READ_BUDGET_OPT},
+    {"mate2"              ,required_argument, 0, MATE2},
     {"fullTx-file"        ,required_argument, 0,          'f'},
     {"out-dir"            ,required_argument, 0,          'o'},
     {"ref-tree"           ,required_argument, 0,          'r'},
     {"pseudo-count-type"  ,required_argument, 0,          'p'},
     {"print-nc-probs"     ,no_argument, 0,                's'},
+    {"dump-nc-probs"      ,no_argument, &p->dumpNCprobs,    1},
+    {"err-grid-res"       ,required_argument, 0, ERR_GRID_RES},
+    {"err-grid-tol"       ,required_argument, 0, ERR_GRID_TOL},
+    {"check-err-grid"     ,no_argument, &p->checkErrGrid,   1},
+    {"trace"              ,required_argument, 0, TRACE},
+    {"trace-taxa"         ,required_argument, 0, TRACE_TAXA},
+    {"margins"            ,required_argument, 0, MARGINS},
+    {"metrics"            ,required_argument, 0, METRICS},
+    {"orient"             ,required_argument, 0, ORIENT},
+    {"orient-order"       ,required_argument, 0, ORIENT_ORDER_OPT},
+    {"fwd-primer"         ,required_argument, 0, FWD_PRIMER},
+    {"rev-primer"         ,required_argument, 0, REV_PRIMER},
+    {"primer-errors"      ,required_argument, 0, PRIMER_ERRORS},
+    {"primer-offset"      ,required_argument, 0, PRIMER_OFFSET},
+    {"manifest"           ,required_argument, 0, MANIFEST},
+    {"threads"            ,required_argument, 0, THREADS},
+    {"count-tbl"          ,no_argument, &p->countTbl,       1},
+    {"sample-id-rule"     ,required_argument, 0, SAMPLE_ID_RULE},
+    {"serve"              ,required_argument, 0, SERVE},
+    {"stdout"             ,no_argument, &p->toStdout,       1},
+    {"checkpoint"         ,required_argument, 0, CHECKPOINT},
+    {"resume"             ,no_argument, &p->resume,         1},
+    {"shard"              ,required_argument, 0, SHARD},
+    {"regions"            ,required_argument, 0, REGIONS},
+    {"bin-results"        ,no_argument, &p->binResults,     1},
+    {"bin-no-ids"         ,no_argument, &p->binNoIds,       1},
+    {"bin-half"           ,no_argument, &p->binHalf,        1},
+    {"gzip"               ,no_argument, &p->gzip,           1},
+    {"flat"               ,no_argument, &p->flat,           1},
+    {"gzip-level"         ,required_argument, 0, GZIP_LEVEL},
     {"rev-comp"           ,no_argument, 0,                'c'},
     {"help"               ,no_argument, 0,                  0},
     {0, 0, 0, 0}
@@ -992,6 +2959,7 @@ void parseArgs( int argc, char ** argv, inPar2_t *p )
 
       case 'c':
 	p->revComp = true;
+	p->orientAuto = 0;
 	break;
 
       case 'x':
@@ -1059,7 +3027,7 @@ void parseArgs( int argc, char ** argv, inPar2_t *p )
 	break;
 
       case 'i':
-	p->inFile = strdup(optarg);
+	p->inFiles.push_back( strdup(optarg) );
 	break;
 
       case 'k':
@@ -1074,6 +3042,149 @@ void parseArgs( int argc, char ** argv, inPar2_t *p )
 	p->printNCprobs = true;
 	break;
 
+      case ERR_GRID_RES:
+	p->errGridRes = atoi(optarg);
+	break;
+
+      case ERR_GRID_TOL:
+	p->errGridTol = atof(optarg);
+	if ( p->errGridTol < 0 )
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --err-grid-tol has to be non-negative" << endl;
+	  exit(1);
+	}
+	break;
+
+      case TRACE:
+	p->traceFile = strdup(optarg);
+	break;
+
+      case TRACE_TAXA:
+	p->traceTaxa = strdup(optarg);
+	break;
+
+      case MARGINS:
+	p->marginsFile = strdup(optarg);
+	break;
+
+      case METRICS:
+	p->metricsFile = strdup(optarg);
+	break;
+
+      case ORIENT:
+	if ( strcmp(optarg, "fwd") == 0 )
+	{
+	  p->revComp = false;
+	  p->orientAuto = 0;
+	}
+	else if ( strcmp(optarg, "rc") == 0 )
+	{
+	  p->revComp = true;
+	  p->orientAuto = 0;
+	}
+	else if ( strcmp(optarg, "auto") == 0 )
+	{
+	  p->revComp = false;
+	  p->orientAuto = 1;
+	}
+	else
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --orient has to be fwd, rc or auto" << endl;
+	  exit(1);
+	}
+	break;
+
+      case FWD_PRIMER:
+	p->fwdPrimer = strdup(optarg);
+	break;
+
+      case REV_PRIMER:
+	p->revPrimer = strdup(optarg);
+	break;
+
+      case PRIMER_ERRORS:
+	p->primerErrors = atoi(optarg);
+	break;
+
+      case PRIMER_OFFSET:
+	p->primerOffset = atoi(optarg);
+	if ( p->primerOffset < 0 )
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --primer-offset has to be non-negative" << endl;
+	  exit(1);
+	}
+	break;
+
+      case ORIENT_ORDER_OPT:
+	p->orientOrder = atoi(optarg);
+	if ( p->orientOrder < 0 )
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --orient-order has to be non-negative" << endl;
+	  exit(1);
+	}
+	break;
+
+      case MANIFEST:
+	p->manifestFile = strdup(optarg);
+	break;
+
+      case REGIONS:
+	p->regionsFile = strdup(optarg);
+	break;
+
+      case MATE2:
+	p->mate2File = strdup(optarg);
+	break;
+
+      case READ_BUDGET_OPT:
+	p->readBudget = atof(optarg);
+	if ( p->readBudget <= 0 )
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --read-budget has to be positive" << endl;
+	  exit(1);
+	}
+	break;
+
+      case GZIP_LEVEL:
+	p->gzipLevel = atoi(optarg);
+	p->gzip = 1;
+	if ( p->gzipLevel < 1 || p->gzipLevel > 9 )
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --gzip-level has to be between 1 and 9" << endl;
+	  exit(1);
+	}
+	break;
+
+      case THREADS:
+	p->nThreads = atoi(optarg);
+	break;
+
+      case SAMPLE_ID_RULE:
+	p->sampleIdRule = strdup(optarg);
+	break;
+
+      case SERVE:
+	p->serveSocket = strdup(optarg);
+	break;
+
+      case SHARD:
+	if ( sscanf(optarg, "%d/%d", &p->shardIdx, &p->nShards) != 2 ||
+	     p->nShards < 1 || p->shardIdx < 0 || p->shardIdx >= p->nShards )
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --shard has to be of the form i/N with 0 <= i < N" << endl;
+	  exit(1);
+	}
+	break;
+
+      case CHECKPOINT:
+	p->ckptInterval = atol(optarg);
+	if ( p->ckptInterval < 0 )
+	{
+	  cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --checkpoint has to be non-negative" << endl;
+	  exit(1);
+	}
+	break;
+
       case 'h':
 	printHelp(argv[0]);
 	exit (EXIT_SUCCESS);
@@ -1103,6 +3214,108 @@ void parseArgs( int argc, char ** argv, inPar2_t *p )
     exit (EXIT_FAILURE);
   }
 
+  if ( p->dumpNCprobs )
+    p->printNCprobs = true;
+
+  if ( p->binNoIds || p->binHalf )
+    p->binResults = 1;
+
+  if ( p->binResults && p->serveSocket )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --serve sends text results; it cannot be combined with --bin-results" << endl;
+    exit(1);
+  }
+
+  if ( p->mate2File && p->inFiles.size() != 1 )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": --mate2 requires a single -i file (use a manifest for several paired-end samples)" << endl;
+    exit(1);
+  }
+
+  if ( p->gzip && ( p->binResults || p->serveSocket || p->ckptInterval || p->resume ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": --gzip cannot be combined with --bin-results, --serve, --checkpoint or --resume" << endl;
+    exit(1);
+  }
+
+  if ( p->flat && ( p->regionsFile || p->serveSocket || p->printNCprobs || p->traceFile ||
+		   p->marginsFile || p->binResults ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": --flat cannot be combined with --regions, --serve, -s, --trace, --margins or --bin-results" << endl;
+    exit(1);
+  }
+
+  if ( p->traceTaxa && !p->traceFile )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__ << ": --trace-taxa requires --trace" << endl;
+    exit(1);
+  }
+
+  if ( p->serveSocket &&
+       ( p->inFiles.size() || p->manifestFile || p->printNCprobs || p->dimProbs ||
+	 p->traceFile || p->marginsFile || p->metricsFile || p->countTbl ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": --serve cannot be combined with -i, --manifest, -s, -a, --trace, --margins, --metrics or --count-tbl" << endl;
+    exit(1);
+  }
+
+  if ( p->toStdout && ( p->serveSocket || p->inFiles.size() > 1 || p->manifestFile ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": --stdout requires a single input file and cannot be combined with --serve or --manifest" << endl;
+    exit(1);
+  }
+
+  if ( p->toStdout && !p->outDir && ( p->printNCprobs || p->dimProbs || p->countTbl ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": -s, -a and --count-tbl write to the output directory; please specify it with the -o flag" << endl;
+    exit(1);
+  }
+
+  if ( ( p->ckptInterval || p->resume ) &&
+       ( p->serveSocket || p->toStdout || p->printNCprobs || p->dimProbs ||
+	 p->traceFile || p->marginsFile || p->countTbl ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": --checkpoint and --resume only cover the results file and cannot be combined with\n"
+	 << "--serve, --stdout, -s, -a, --trace, --margins or --count-tbl" << endl;
+    exit(1);
+  }
+
+  if ( p->regionsFile &&
+       ( p->mcDir || p->treeFile || p->serveSocket || p->printNCprobs || p->dimProbs ||
+	 p->traceFile || p->marginsFile || p->metricsFile || p->countTbl || p->binResults ||
+	 p->ckptInterval || p->resume ) )
+  {
+    cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	 << ": --regions cannot be combined with -d, -r, --serve, -s, -a, --trace, --margins, --metrics,\n"
+	 << "--count-tbl, --bin-results, --checkpoint or --resume" << endl;
+    exit(1);
+  }
+
+  if ( p->nShards )
+  {
+    bool fromStdin = false;
+    for ( int i = 0; i < (int)p->inFiles.size(); i++ )
+      if ( strcmp(p->inFiles[i], "-") == 0 )
+	fromStdin = true;
+
+    // mergeResults does not merge the -s, -a, --trace or --margins outputs
+    if ( fromStdin || p->serveSocket || p->printNCprobs || p->dimProbs ||
+	 p->traceFile || p->marginsFile || !p->outDir )
+    {
+      cerr << "ERROR in " << __FILE__ << " at line " << __LINE__
+	   << ": --shard requires input files and -o, and cannot be combined with -i -, --serve, -s, -a,\n"
+	   << "--trace or --margins" << endl;
+      exit(1);
+    }
+  }
+
   for ( ; optind < argc; ++ optind )
     p->trgFiles.push_back( strdup(argv[optind]) );
 }
@@ -0,0 +1,231 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <iostream>
+
+#include "UnixSocket.hh"
+
+using namespace std;
+
+//----------------------------------------------------------- printUsage ----
+void printUsage( const char *s )
+{
+  cout << endl
+
+       << "USAGE " << endl
+       << endl
+       << " Sends sequences to a classify --serve process and prints the classification results" << endl
+       << endl
+       << s << " -s <socket> -i <input fasta file> [-o <output file>]" << endl
+       << s << " -s <socket> -f <fasta file on the server's file system> [-o <output file>]" << endl
+       << endl
+       << "\tOptions:\n"
+       << "\t-s <socket>  - Unix domain socket given to classify --serve\n"
+       << "\t-i <inFile>  - fasta file sent to the server; - for the standard input\n"
+       << "\t-f <file>    - fasta file read by the server itself\n"
+       << "\t-o <outFile> - output file; by default the results are written to the standard output\n"
+       << "\t-h|--help    - this message\n\n"
+
+       << "\tThe output has the format of the MC_order<k>_results.txt file of classify\n\n"
+
+       << "\n\tExample: \n"
+
+       << "\tclassify -d vaginal_v2_MCdir --serve /tmp/classify.sock &" << endl
+       << "\t" << s << " -s /tmp/classify.sock -i vaginal_v2.1.fa -o vaginal_v2.1_results.txt" << endl << endl;
+}
+
+//================================================= response_t ====
+//! reader of the server's response
+typedef struct
+{
+  int fd;
+  FILE *out;
+  int nReads;     /// number of reads reported by the server; -1 if there was no "# END" line
+  bool error;     /// true if the server reported an error
+} response_t;
+
+//-------------------------------------------------------- readResponse ----
+/// copies result lines from the socket to out; runs in its own thread so
+/// that the results are consumed while the input is still being sent
+void *readResponse( void *arg )
+{
+  response_t *r = (response_t *)arg;
+  FILE *in = fdopen(r->fd, "r");
+
+  char *line = NULL;
+  size_t lineAlloc = 0;
+  ssize_t len;
+
+  while ( (len = getline(&line, &lineAlloc, in)) != -1 )
+  {
+    if ( line[0] != '#' )
+    {
+      fwrite(line, 1, len, r->out);
+    }
+    else if ( strncmp(line, "# END ", 6) == 0 )
+    {
+      r->nReads = atoi(line + 6);
+    }
+    else
+    {
+      if ( strncmp(line, "# ERROR", 7) == 0 )
+	r->error = true;
+      fprintf(stderr, "%s", line + 2);
+    }
+  }
+
+  free(line);
+  fclose(in);
+
+  return NULL;
+}
+
+//============================== main ======================================
+int main(int argc, char **argv)
+{
+  const char *socketFile = NULL;
+  const char *inFile     = NULL;
+  const char *serverFile = NULL;
+  const char *outFile    = NULL;
+
+  static struct option longOptions[] = {
+    {"help"               ,no_argument, 0,                'h'},
+    {0, 0, 0, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv,"s:i:f:o:h",longOptions, NULL)) != -1)
+    switch (c)
+    {
+      case 's':
+	socketFile = optarg;
+	break;
+
+      case 'i':
+	inFile = optarg;
+	break;
+
+      case 'f':
+	serverFile = optarg;
+	break;
+
+      case 'o':
+	outFile = optarg;
+	break;
+
+      case 'h':
+	printUsage(argv[0]);
+	exit (EXIT_SUCCESS);
+	break;
+
+      default:
+	printUsage(argv[0]);
+	exit (EXIT_FAILURE);
+    }
+
+  if ( !socketFile || !inFile == !serverFile )
+  {
+    cerr << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__
+	 << ": Please specify the socket with -s and exactly one of -i or -f" << endl;
+    printUsage(argv[0]);
+    exit(1);
+  }
+
+  FILE *in = NULL;
+  if ( inFile )
+  {
+    in = strcmp(inFile, "-") ? fopen(inFile, "r") : stdin;
+    if ( !in )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: cannot open %s\n", __FILE__, __LINE__, inFile);
+      exit(1);
+    }
+  }
+
+  response_t r;
+  r.fd     = unixConnect( socketFile );
+  r.out    = outFile ? fopen(outFile, "w") : stdout;
+  r.nReads = -1;
+  r.error  = false;
+
+  if ( !r.out )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot open %s\n", __FILE__, __LINE__, outFile);
+    exit(1);
+  }
+
+  signal(SIGPIPE, SIG_IGN); // write errors are reported below
+
+  int fd = dup(r.fd);
+  pthread_t reader;
+  if ( pthread_create(&reader, NULL, readResponse, &r) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: cannot create thread\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  bool sent;
+  if ( in )
+  {
+    sent = writeAll(fd, "FASTA\n", 6);
+
+    char buf[64*1024];
+    size_t n;
+    while ( sent && (n = fread(buf, 1, sizeof(buf), in)) > 0 )
+      sent = writeAll(fd, buf, n);
+
+    if ( in != stdin )
+      fclose(in);
+  }
+  else
+  {
+    string req = string("FILE ") + string(serverFile) + string("\n");
+    sent = writeAll(fd, req.c_str(), req.size());
+  }
+
+  shutdown(fd, SHUT_WR); // end of the request
+  close(fd);
+
+  pthread_join(reader, NULL);
+
+  if ( r.out != stdout )
+    fclose(r.out);
+  else
+    fflush(stdout);
+
+  if ( !sent && !r.error )
+    fprintf(stderr, "ERROR: the server closed the connection before the request was sent\n");
+
+  if ( r.error || r.nReads < 0 )
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
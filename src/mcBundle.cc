@@ -0,0 +1,257 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+
+/*
+  Converts an MC models directory into a single file model bundle (.mcb)
+  that classify maps into memory instead of parsing the text tables
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "CUtilities.h"
+#include "IOCUtilities.h"
+#include "IOCppUtilities.hh"
+#include "MarkovChains2.hh"
+#include "DecisionTree.hh"
+#include "ModelBundle.hh"
+
+using namespace std;
+
+//----------------------------------------------------------- printUsage ----
+void printUsage( const char *s )
+{
+  cout << endl
+
+       << "USAGE " << endl
+       << endl
+       << " Converts an MC models directory into a model bundle file, or checks a bundle" << endl
+       << endl
+       << s << " -d <MC models directory> -o <bundle file> [-r <ref tree>]" << endl
+       << s << " -c <bundle file>" << endl
+       << endl
+       << "\tOptions:\n"
+       << "\t-d <dir>      - directory of the MC models\n"
+       << "\t-o <file>     - bundle file to write\n"
+       << "\t-r <ref tree> - reference tree to bundle instead of <dir>/refTx.tree\n"
+       << "\t-c <file>     - verify the checksums of all sections of a bundle and print its contents\n"
+       << "\t-h|--help     - this message\n\n"
+
+       << "\tThe bundle holds the models (MC<k>.log10cProb, modelIds.txt), the error tables (<model>_error.txt),\n"
+       << "\tthe thresholds (ncProbThlds.txt) and the reference tree of the directory. classify -d accepts it\n"
+       << "\tin place of the directory.\n"
+
+       << "\n\tExample: \n"
+
+       << "\t" << s << " -d vaginal_v2_MCdir -o vaginal_v2.mcb" << endl
+       << "\tclassify -d vaginal_v2.mcb -i test10k.fa -o mcDir" << endl << endl;
+}
+
+//============================== local sub-routines =========================
+void checkBundle( const char *file );
+string readFileStr( const char *file );
+
+//============================== main ======================================
+int main(int argc, char **argv)
+{
+  char *mcDir = NULL;
+  char *outFile = NULL;
+  char *treeFile = NULL;
+  char *checkFile = NULL;
+
+  static struct option longOptions[] = {
+    {"help"               ,no_argument, 0,                'h'},
+    {0, 0, 0, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "d:o:r:c:h", longOptions, NULL)) != -1)
+    switch (c)
+    {
+      case 'd':
+	mcDir = strdup(optarg);
+	break;
+
+      case 'o':
+	outFile = strdup(optarg);
+	break;
+
+      case 'r':
+	treeFile = strdup(optarg);
+	break;
+
+      case 'c':
+	checkFile = strdup(optarg);
+	break;
+
+      case 'h':
+	printUsage(argv[0]);
+	exit(EXIT_SUCCESS);
+	break;
+
+      default:
+	printUsage(argv[0]);
+	exit(EXIT_FAILURE);
+    }
+
+  if ( checkFile )
+  {
+    checkBundle( checkFile );
+    free(checkFile);
+    return EXIT_SUCCESS;
+  }
+
+  if ( !mcDir || !outFile )
+  {
+    printUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  // the order of the models is given by the number of MC<k>.log10cProb files
+  int k = 0;
+  char countStr[16];
+  sprintf(countStr,"%d",k);
+  while ( exists( (string(mcDir) + string("/MC") + string(countStr) + string(".log10cProb")).c_str() ) )
+  {
+    k++;
+    sprintf(countStr,"%d",k);
+  }
+
+  if ( !k )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s has no MC0.log10cProb file\n", __FILE__, __LINE__, mcDir);
+    exit(1);
+  }
+
+  string idsFile = string(mcDir) + string("/modelIds.txt");
+  if ( !exists( idsFile.c_str() ) )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is missing\n", __FILE__, __LINE__, idsFile.c_str());
+    exit(1);
+  }
+
+  vector<char *> trgFiles;
+  MarkovChains2_t *probModel = new MarkovChains2_t( k - 1, trgFiles, mcDir );
+
+  const vector<char *> &modelIds = probModel->modelIds();
+  int nModels = modelIds.size();
+
+  // models without an error table can still be used with --skip-err-thld
+  vector<errTbl_t *> errTbls( nModels, (errTbl_t *)NULL );
+  int nErrTbls = 0;
+  for ( int i = 0; i < nModels; i++ )
+  {
+    string file = string(mcDir) + string("/") + string(modelIds[i]) + string("_error.txt");
+    if ( exists( file.c_str() ) )
+    {
+      errTbls[i] = readErrTbl( file.c_str() );
+      nErrTbls++;
+    }
+  }
+
+  vector<string> thldIds;
+  vector<double> thlds;
+  string file = string(mcDir) + string("/ncProbThlds.txt");
+  if ( exists( file.c_str() ) )
+  {
+    double **tbl;
+    int nrow, ncol;
+    char **rowNames;
+    char **colNames;
+    readTable( file.c_str(), &tbl, &nrow, &ncol, &rowNames, &colNames );
+    for ( int i = 0; i < nrow; i++ )
+    {
+      thldIds.push_back( string(rowNames[i]) );
+      thlds.push_back( tbl[i][0] );
+    }
+  }
+
+  string tree = readFileStr( treeFile ? treeFile : (string(mcDir) + string("/refTx.tree")).c_str() );
+
+  writeModelBundle( outFile, probModel, errTbls, thldIds, thlds, tree );
+
+  fprintf(stderr, "--- %d models of order %d, %d error tables and %d thresholds written to %s\n",
+	  nModels, k - 1, nErrTbls, (int)thlds.size(), outFile);
+
+  delete probModel;
+  free(mcDir);
+  free(outFile);
+  if ( treeFile )
+    free(treeFile);
+
+  return EXIT_SUCCESS;
+}
+
+//-------------------------------------------------------- checkBundle ----
+/// verifies all checksums of a bundle and prints a summary of its contents
+void checkBundle( const char *file )
+{
+  modelBundle_t bundle( file );
+
+  if ( !bundle.verify() )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: the checksums of %s do not match; it is corrupted\n",
+	    __FILE__, __LINE__, file);
+    exit(1);
+  }
+
+  int nErrTbls = 0;
+  for ( int i = 0; i < bundle.nModels(); i++ )
+  {
+    errTbl_t *errObj = bundle.errTbl( i );
+    if ( errObj )
+    {
+      nErrTbls++;
+      free(errObj->errTbl);
+      delete errObj;
+    }
+  }
+
+  printf("%s: OK\n", file);
+  printf("models:       %d\n", bundle.nModels());
+  printf("order:        %d\n", bundle.order());
+  printf("error tables: %d\n", nErrTbls);
+  printf("thresholds:   %d\n", bundle.nThlds());
+}
+
+//-------------------------------------------------------- readFileStr ----
+/// contents of a text file
+string readFileStr( const char *file )
+{
+  FILE *in = fOpen(file, "r");
+
+  string s;
+  char buf[64*1024];
+  size_t n;
+  while ( (n = fread(buf, 1, sizeof(buf), in)) > 0 )
+    s.append(buf, n);
+
+  fclose(in);
+
+  return s;
+}
@@ -0,0 +1,542 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+  Merges the output directories of classify --shard i/N runs into the
+  output directory of a single run over the whole input
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iostream>
+
+#include "CUtilities.h"
+#include "IOCUtilities.h"
+#include "Newick.hh"
+#include "DecisionTree.hh"
+#include "CountTable.hh"
+#include "Checkpoint.hh"
+#include "ResultsFile.hh"
+#include "ModelBundle.hh"
+
+using namespace std;
+
+//----------------------------------------------------------- printUsage ----
+void printUsage( const char *s )
+{
+  cout << endl
+
+       << "USAGE " << endl
+       << endl
+       << " Merges the output directories of classify --shard i/N runs over the same input" << endl
+       << endl
+       << s << " -o <output directory> [-d <MC models directory> | -r <ref tree>] <shard dir> ... <shard dir>" << endl
+       << endl
+       << "\tOptions:\n"
+       << "\t-o <dir>      - output directory\n"
+       << "\t-d <dir>      - directory of the MC models used by classify, or their model bundle; its refTx.tree\n"
+       << "\t                is read\n"
+       << "\t-r <ref tree> - reference tree used by classify\n"
+       << "\t-h|--help     - this message\n\n"
+
+       << "\tThe shard directories can be given in any order; all N shards have to be present.\n"
+       << "\tThe MC_order<k>_results.txt (or .txt.gz or .mcr) files (of each sample in the batch mode) are concatenated in the order\n"
+       << "\tof the input, summary.txt counts are added and, if the shards were run with --count-tbl, the\n"
+       << "\tsample x phylotype count tables are summed; this requires -d or -r\n"
+
+       << "\n\tExample: \n"
+
+       << "\tclassify --shard 0/2 -d vaginal_v2_MCdir -i big.fa -o out0" << endl
+       << "\tclassify --shard 1/2 -d vaginal_v2_MCdir -i big.fa -o out1" << endl
+       << "\t" << s << " -d vaginal_v2_MCdir -o out out0 out1" << endl << endl;
+}
+
+//================================================= shard_t ====
+//! contents of the shard.txt file of a shard's output directory
+typedef struct
+{
+  string dir;
+  int idx;
+  int n;
+  string inputs;   /// input and manifest lines; have to be the same for all shards
+} shard_t;
+
+bool shardLess( const shard_t &a, const shard_t &b ) { return a.idx < b.idx; }
+
+//============================== local sub-routines =========================
+void readShard( const char *dir, shard_t &shard );
+void skipLine( FILE *in );
+void resultsFiles( const string &dir, vector<string> &files );
+void concatFiles( const vector<shard_t> &shards, const string &subDir,
+		  const string &file, const string &outDir );
+void mergeSummaries( const vector<shard_t> &shards, const string &outDir,
+		     vector<string> &samples );
+void mergeCountTbls( const vector<shard_t> &shards, const char *treeFile,
+		     const modelBundle_t *bundle, const string &outDir );
+
+//============================== main ======================================
+int main(int argc, char **argv)
+{
+  char *outDir = NULL;
+  char *mcDir = NULL;
+  char *treeFile = NULL;
+
+  static struct option longOptions[] = {
+    {"help"               ,no_argument, 0,                'h'},
+    {0, 0, 0, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "o:d:r:h", longOptions, NULL)) != -1)
+    switch (c)
+    {
+      case 'o':
+	outDir = strdup(optarg);
+	break;
+
+      case 'd':
+	mcDir = strdup(optarg);
+	break;
+
+      case 'r':
+	treeFile = strdup(optarg);
+	break;
+
+      case 'h':
+	printUsage(argv[0]);
+	exit(EXIT_SUCCESS);
+	break;
+
+      default:
+	printUsage(argv[0]);
+	exit(EXIT_FAILURE);
+    }
+
+  if ( !outDir || optind >= argc )
+  {
+    cerr << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__ << ": Output directory or shard directories are missing." << endl;
+    printUsage(argv[0]);
+    exit(1);
+  }
+
+  // the tree of a model bundle is used in place, as classify does
+  modelBundle_t *bundle = NULL;
+  if ( !treeFile && mcDir && modelBundle_t::isBundle( mcDir ) )
+    bundle = new modelBundle_t( mcDir );
+  else if ( !treeFile && mcDir )
+  {
+    string file = string(mcDir) + string("/refTx.tree");
+    STRDUP(treeFile, file.c_str());
+  }
+
+  //-- shards sorted by their index; all of them have to be there
+  vector<shard_t> shards;
+  for ( ; optind < argc; optind++ )
+  {
+    shard_t shard;
+    readShard( argv[optind], shard );
+    shards.push_back( shard );
+  }
+
+  sort( shards.begin(), shards.end(), shardLess );
+
+  int nShards = shards.size();
+  for ( int i = 0; i < nShards; i++ )
+  {
+    if ( shards[i].n != shards[0].n )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %s is one of %d shards and %s one of %d\n",
+	      __FILE__, __LINE__, shards[0].dir.c_str(), shards[0].n, shards[i].dir.c_str(), shards[i].n);
+      exit(1);
+    }
+
+    if ( shards[i].inputs != shards[0].inputs )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %s and %s are shards of different inputs\n",
+	      __FILE__, __LINE__, shards[0].dir.c_str(), shards[i].dir.c_str());
+      exit(1);
+    }
+  }
+
+  vector<int> seen( shards[0].n, 0 );
+  for ( int i = 0; i < nShards; i++ )
+    seen[ shards[i].idx ]++;
+
+  for ( int i = 0; i < shards[0].n; i++ )
+    if ( seen[i] != 1 )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: the outputs of all %d shards have to be given exactly once; shard %d/%d is %s\n",
+	      __FILE__, __LINE__, shards[0].n, i, shards[0].n, seen[i] ? "given more than once" : "missing");
+      exit(1);
+    }
+
+  mkDir( outDir );
+
+  //-- results files; in the batch mode each sample has its own directory
+  vector<string> samples;
+  string summary = shards[0].dir + string("/summary.txt");
+  if ( exists( summary.c_str() ) )
+    mergeSummaries( shards, string(outDir), samples );
+  else
+    samples.push_back( string("") );
+
+  int nFiles = 0;
+  int nSamples = samples.size();
+  for ( int i = 0; i < nSamples; i++ )
+  {
+    string subDir = samples[i].size() ? string("/") + samples[i] : string("");
+    string dir = string(outDir) + subDir;
+    if ( samples[i].size() )
+      mkDir( dir.c_str() );
+
+    vector<string> files;
+    resultsFiles( shards[0].dir + subDir, files );
+
+    int n = files.size();
+    for ( int j = 0; j < n; j++ )
+      concatFiles( shards, subDir, files[j], dir );
+    nFiles += n;
+  }
+
+  //-- count tables
+  string triplets = shards[0].dir + string("/spp_count_tbl_triplets.txt");
+  if ( exists( triplets.c_str() ) )
+  {
+    if ( !treeFile && !bundle )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: the shards have count tables; please specify the reference tree with -r or -d\n",
+	      __FILE__, __LINE__);
+      exit(1);
+    }
+
+    mergeCountTbls( shards, treeFile, bundle, string(outDir) );
+  }
+
+  fprintf(stderr, "--- Merged %d results files of %d shards into %s\n", nFiles, nShards, outDir);
+
+  free(outDir);
+  if ( mcDir )
+    free(mcDir);
+  if ( bundle )
+    delete bundle;
+  if ( treeFile )
+    free(treeFile);
+
+  return EXIT_SUCCESS;
+}
+
+//---------------------------------------------------------- readShard ----
+/// reads <dir>/shard.txt written by classify --shard
+void readShard( const char *dir, shard_t &shard )
+{
+  shard.dir = string(dir);
+  shard.idx = -1;
+  shard.n   = -1;
+
+  string file = shard.dir + string("/shard.txt");
+  FILE *in = fopen(file.c_str(), "r");
+  if ( !in )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is not an output directory of classify --shard: cannot open %s\n",
+	    __FILE__, __LINE__, dir, file.c_str());
+    exit(1);
+  }
+
+  char key[64];
+  char value[4096];
+  while ( fscanf(in, "%63s %4095[^\n]", key, value) == 2 )
+  {
+    if ( strcmp(key, "shard") == 0 )
+      shard.idx = atoi(value);
+    else if ( strcmp(key, "shards") == 0 )
+      shard.n = atoi(value);
+    else
+      shard.inputs += string(key) + string("\t") + string(value) + string("\n");
+  }
+  fclose(in);
+
+  if ( shard.idx < 0 || shard.n < 1 || shard.idx >= shard.n )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: %s is malformed\n", __FILE__, __LINE__, file.c_str());
+    exit(1);
+  }
+}
+
+//----------------------------------------------------------- skipLine ----
+void skipLine( FILE *in )
+{
+  int ch;
+  while ( (ch = getc(in)) != '\n' && ch != EOF )
+    ;
+}
+
+//------------------------------------------------------- resultsFiles ----
+/// names of the MC_order<k>_results.txt, MC_order<k>_results.txt.gz
+/// and MC_order<k>_results.mcr files of dir
+void resultsFiles( const string &dir, vector<string> &files )
+{
+  DIR *d = opendir(dir.c_str());
+  if ( !d )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot open directory %s\n", __FILE__, __LINE__, dir.c_str());
+    exit(1);
+  }
+
+  struct dirent *e;
+  while ( (e = readdir(d)) )
+  {
+    int len = strlen(e->d_name);
+    if ( strncmp(e->d_name, "MC_order", 8) == 0 && len > 12 &&
+	 (strcmp(e->d_name + len - 12, "_results.txt") == 0 ||
+	  strcmp(e->d_name + len - 12, "_results.mcr") == 0 ||
+	  (len > 15 && strcmp(e->d_name + len - 15, "_results.txt.gz") == 0)) )
+      files.push_back( string(e->d_name) );
+  }
+  closedir(d);
+
+  sort( files.begin(), files.end() );
+}
+
+//-------------------------------------------------------- concatFiles ----
+/// writes to outDir/file the concatenation of <shard dir><subDir>/file
+/// of all shards in the order of their indices; of binary results files
+/// only the header of the first shard is kept. Gzip compressed files of
+/// --gzip are concatenated as they are, as members of one gzip file
+void concatFiles( const vector<shard_t> &shards, const string &subDir,
+		  const string &file, const string &outDir )
+{
+  string outFile = outDir + string("/") + file;
+  FILE *out = fOpen(outFile.c_str(), "w");
+
+  size_t bufSize = 1024*1024;
+  char *buf;
+  MALLOC(buf, char*, bufSize * sizeof(char));
+
+  bool bin = file.size() > 4 && file.compare(file.size() - 4, 4, ".mcr") == 0;
+  string header;
+
+  int nShards = shards.size();
+  for ( int i = 0; i < nShards; i++ )
+  {
+    string inFile = shards[i].dir + subDir + string("/") + file;
+
+    // a shard that was checkpointed has to have finished
+    checkpoint_t ckpt;
+    string ckptFile = inFile + string(".ckpt");
+    if ( readCheckpoint( ckptFile.c_str(), ckpt ) && !ckpt.complete )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: %s is incomplete; please finish it with classify --resume\n",
+	      __FILE__, __LINE__, inFile.c_str());
+      exit(1);
+    }
+
+    FILE *in = fOpen(inFile.c_str(), "r");
+
+    if ( bin )
+    {
+      // the blocks of all shards have to share the header of the first one
+      long len = resultsReader_t( inFile.c_str() ).headerSize();
+      string h(len, '\0');
+      if ( fread(&h[0], 1, len, in) != (size_t)len )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: Cannot read %s\n", __FILE__, __LINE__, inFile.c_str());
+	exit(1);
+      }
+
+      if ( i == 0 )
+      {
+	header = h;
+	fwrite(h.data(), 1, len, out);
+      }
+      else if ( h != header )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: %s was written with different --bin-* options or models than %s%s/%s\n",
+		__FILE__, __LINE__, inFile.c_str(), shards[0].dir.c_str(), subDir.c_str(), file.c_str());
+	exit(1);
+      }
+    }
+
+    size_t n;
+    while ( (n = fread(buf, 1, bufSize, in)) > 0 )
+      if ( fwrite(buf, 1, n, out) != n )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: Cannot write to %s\n", __FILE__, __LINE__, outFile.c_str());
+	exit(1);
+      }
+    fclose(in);
+  }
+
+  free(buf);
+
+  if ( fclose(out) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write to %s\n", __FILE__, __LINE__, outFile.c_str());
+    exit(1);
+  }
+}
+
+//----------------------------------------------------- mergeSummaries ----
+/// writes to outDir/summary.txt the sums of the read counts and run times
+/// of the samples of the shards' summary.txt files; samples is set to
+/// the sample names in the order of the first shard
+void mergeSummaries( const vector<shard_t> &shards, const string &outDir,
+		     vector<string> &samples )
+{
+  vector<string> files;
+  map<string, int> sampleIdx;
+  vector<long> reads, leaves;
+  vector<double> seconds;
+
+  int nShards = shards.size();
+  for ( int i = 0; i < nShards; i++ )
+  {
+    string file = shards[i].dir + string("/summary.txt");
+    FILE *in = fOpen(file.c_str(), "r");
+
+    char name[4096], inFile[4096];
+    long nReads, nLeaves, nNonLeaves;
+    double sec;
+
+    skipLine( in ); // header
+
+    while ( fscanf(in, "%4095[^\t]\t%4095[^\t]\t%ld\t%ld\t%ld\t%lf\n",
+		   name, inFile, &nReads, &nLeaves, &nNonLeaves, &sec) == 6 )
+    {
+      map<string, int>::iterator it = sampleIdx.find( string(name) );
+      int idx;
+      if ( it == sampleIdx.end() )
+      {
+	idx = samples.size();
+	sampleIdx[ string(name) ] = idx;
+	samples.push_back( string(name) );
+	files.push_back( string(inFile) );
+	reads.push_back(0);
+	leaves.push_back(0);
+	seconds.push_back(0);
+      }
+      else
+      {
+	idx = it->second;
+      }
+
+      reads[idx]   += nReads;
+      leaves[idx]  += nLeaves;
+      seconds[idx] += sec;
+    }
+    fclose(in);
+  }
+
+  string file = outDir + string("/summary.txt");
+  FILE *out = fOpen(file.c_str(), "w");
+
+  fprintf(out, "sample\tfile\treads\tleaf\tnonLeaf\tseconds\n");
+
+  int n = samples.size();
+  for ( int i = 0; i < n; i++ )
+    fprintf(out, "%s\t%s\t%ld\t%ld\t%ld\t%.2f\n", samples[i].c_str(), files[i].c_str(),
+	    reads[i], leaves[i], reads[i] - leaves[i], seconds[i]);
+
+  fclose(out);
+}
+
+//----------------------------------------------------- mergeCountTbls ----
+/// sums the spp_count_tbl_triplets.txt tables of the shards and writes
+/// the count tables of classify --count-tbl to outDir; the reference
+/// tree is read from treeFile or, if it is NULL, from bundle
+void mergeCountTbls( const vector<shard_t> &shards, const char *treeFile,
+		     const modelBundle_t *bundle, const string &outDir )
+{
+  NewickTree_t nt;
+  if ( treeFile )
+  {
+    if ( !nt.loadTree(treeFile) )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: Could not load Newick tree from %s\n", __FILE__, __LINE__, treeFile);
+      exit(1);
+    }
+  }
+  else
+  {
+    FILE *fp = fmemopen( (void *)bundle->tree(), strlen(bundle->tree()), "r" );
+    if ( !fp || !nt.loadTree(fp, bundle->file()) )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: Could not load the Newick tree of %s\n", __FILE__, __LINE__, bundle->file());
+      exit(1);
+    }
+    fclose(fp);
+  }
+
+  // only the labels and the order of the nodes are used
+  map<string, errTbl_t *> noErrTbls;
+  decisionTree_t dt;
+  dt.compile( nt, noErrTbls );
+
+  map<string, int> nodeIdx;
+  for ( int i = 0; i < dt.size(); i++ )
+    nodeIdx[ string(dt[i].label) ] = i;
+
+  sampleIdRule_t rule;
+  countTable_t counts( dt, rule );
+
+  int nShards = shards.size();
+  for ( int i = 0; i < nShards; i++ )
+  {
+    string file = shards[i].dir + string("/spp_count_tbl_triplets.txt");
+    FILE *in = fOpen(file.c_str(), "r");
+
+    char sampleId[4096], taxon[4096];
+    long count;
+
+    skipLine( in ); // header
+
+    while ( fscanf(in, "%4095[^\t]\t%4095[^\t]\t%ld\n", sampleId, taxon, &count) == 3 )
+    {
+      map<string, int>::iterator it = nodeIdx.find( string(taxon) );
+      if ( it == nodeIdx.end() )
+      {
+	fprintf(stderr, "ERROR in %s at line %d: %s of %s is not in the reference tree %s\n",
+		__FILE__, __LINE__, taxon, file.c_str(), treeFile ? treeFile : bundle->file());
+	exit(1);
+      }
+
+      counts.addToSample( sampleId, it->second, count );
+    }
+    fclose(in);
+  }
+
+  string file = outDir + string("/spp_count_tbl.txt");
+  counts.printTbl( file.c_str() );
+
+  file = outDir + string("/spp_count_tbl_triplets.txt");
+  counts.printTriplets( file.c_str() );
+
+  file = outDir + string("/spp_count_tbl.biom");
+  counts.printBiom( file.c_str() );
+}
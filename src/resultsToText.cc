@@ -0,0 +1,192 @@
+/*
+Copyright (C) 2016 Pawel Gajer pgajer@gmail.com and Jacques Ravel jravel@som.umaryland.edu
+
+Permission to use, copy, modify, and distribute this software and its
+documentation with or without modifications and for any purpose and
+without fee is hereby granted, provided that any copyright notices
+appear in all copies and that both those copyright notices and this
+permission notice appear in supporting documentation, and that the
+names of the contributors or copyright holders not be used in
+advertising or publicity pertaining to distribution of the software
+without specific prior permission.
+
+THE CONTRIBUTORS AND COPYRIGHT HOLDERS OF THIS SOFTWARE DISCLAIM ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL THE
+CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT
+OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE
+OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+  Converts binary results files written by classify --bin-results to the
+  text format of MC_order<k>_results.txt and builds count tables from them
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <iostream>
+
+#include "IOCUtilities.h"
+#include "ResultsFile.hh"
+#include "CountTable.hh"
+
+using namespace std;
+
+// codes of long options without a short equivalent
+enum {
+  COUNT_TBL = 256,
+  SAMPLE_ID_RULE
+};
+
+//----------------------------------------------------------- printUsage ----
+void printUsage( const char *s )
+{
+  cout << endl
+
+       << "USAGE " << endl
+       << endl
+       << " Converts a binary results file of classify --bin-results to the text format" << endl
+       << endl
+       << s << " -i <results.mcr> [-o <output file>] [--count-tbl <dir>] [--sample-id-rule <rule>]" << endl
+       << endl
+       << "\tOptions:\n"
+       << "\t-i <inFile>          - binary results file\n"
+       << "\t-o <outFile>         - text results file; by default the results are written to the standard output\n"
+       << "\t                       unless --count-tbl is given\n"
+       << "\t--count-tbl <dir>    - write sample x phylotype count tables to <dir>/spp_count_tbl.txt,\n"
+       << "\t                       spp_count_tbl_triplets.txt and spp_count_tbl.biom\n"
+       << "\t--sample-id-rule <r> - how sample IDs are obtained from read IDs; see classify -h.\n"
+       << "\t                       Default value: default\n"
+       << "\t-h|--help            - this message\n\n"
+
+       << "\tReads without IDs (classify --bin-no-ids) are given their 1-based index in the input as the ID\n\n"
+
+       << "\n\tExample: \n"
+
+       << "\t" << s << " -i mcDir/MC_order7_results.mcr -o mcDir/MC_order7_results.txt" << endl << endl;
+}
+
+//============================== main ======================================
+int main(int argc, char **argv)
+{
+  char *inFile = NULL;
+  char *outFile = NULL;
+  char *countDir = NULL;
+  const char *rule = "default";
+
+  static struct option longOptions[] = {
+    {"count-tbl"          ,required_argument, 0, COUNT_TBL},
+    {"sample-id-rule"     ,required_argument, 0, SAMPLE_ID_RULE},
+    {"help"               ,no_argument, 0,                'h'},
+    {0, 0, 0, 0}
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "i:o:h", longOptions, NULL)) != -1)
+    switch (c)
+    {
+      case 'i':
+	inFile = strdup(optarg);
+	break;
+
+      case 'o':
+	outFile = strdup(optarg);
+	break;
+
+      case COUNT_TBL:
+	countDir = strdup(optarg);
+	break;
+
+      case SAMPLE_ID_RULE:
+	rule = optarg;
+	break;
+
+      case 'h':
+	printUsage(argv[0]);
+	exit(EXIT_SUCCESS);
+	break;
+
+      default:
+	printUsage(argv[0]);
+	exit(EXIT_FAILURE);
+    }
+
+  if ( !inFile )
+  {
+    cerr << endl << "ERROR in "<< __FILE__ << " at line " << __LINE__ << ": Input file is missing. Please specify it with the -i flag." << endl;
+    printUsage(argv[0]);
+    exit(1);
+  }
+
+  resultsReader_t reader( inFile );
+
+  FILE *out = NULL;
+  if ( outFile )
+    out = fOpen(outFile, "w");
+  else if ( !countDir )
+    out = stdout;
+
+  sampleIdRule_t sampleIdRule( rule );
+  countTable_t *counts = NULL;
+  if ( countDir )
+  {
+    if ( sampleIdRule.byFile() )
+    {
+      fprintf(stderr, "ERROR in %s at line %d: --sample-id-rule file needs the input files; please use classify --count-tbl\n",
+	      __FILE__, __LINE__);
+      exit(1);
+    }
+    counts = new countTable_t( reader.taxa(), sampleIdRule );
+  }
+
+  const char *id;
+  int node;
+  double err;
+  while ( reader.next( id, node, err ) )
+  {
+    if ( out )
+      fprintf(out, "%s\t%s\t%.4f%s\n", id, reader.taxon(node), err, reader.degraded() ? "\tdegraded" : "");
+
+    if ( counts )
+      counts->add( id, node );
+  }
+
+  if ( out && fclose(out) != 0 )
+  {
+    fprintf(stderr, "ERROR in %s at line %d: Cannot write the results\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  if ( counts )
+  {
+    mkDir( countDir );
+
+    string file = string(countDir) + string("/spp_count_tbl.txt");
+    counts->printTbl( file.c_str() );
+
+    file = string(countDir) + string("/spp_count_tbl_triplets.txt");
+    counts->printTriplets( file.c_str() );
+
+    file = string(countDir) + string("/spp_count_tbl.biom");
+    counts->printBiom( file.c_str() );
+
+    if ( counts->nUnmatched() )
+      fprintf(stderr, "WARNING: %ld of %ld read IDs do not match the sample ID rule; they are not counted\n",
+	      counts->nUnmatched(), counts->nReads());
+
+    delete counts;
+    free(countDir);
+  }
+
+  free(inFile);
+  if ( outFile )
+    free(outFile);
+
+  return EXIT_SUCCESS;
+}